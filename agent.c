@@ -0,0 +1,254 @@
+#include "bcm.h"
+#include "agent.h"
+#include "timer.h"
+
+#define AG_PILHA             16           // profundidade da pilha
+#define AG_MAX_PASSOS        1024         // instruções por avaliação (evita laços infinitos)
+#define AG_NUM_REGS          42           // tamanho de user_regs
+
+/*
+ * Buffer circular de trace: registros formados por cabeçalho (tamanho dos
+ * dados, pc e instante em us) e dados, alinhados em palavras. Os índices
+ * crescem livremente. Registros que não cabem são descartados e contados.
+ */
+#define TRACE_SIZE           16384        // potência de 2
+#define TRACE_CABECALHO      12
+
+static uint8_t trace[TRACE_SIZE];
+static uint32_t trace_head, trace_tail;
+static uint32_t trace_perdidos;
+
+/*
+ * Registro sendo montado durante uma avaliação.
+ */
+static uint8_t registro[AGENT_TRACE_MAX];
+static uint32_t registro_len;
+static int registro_usado;
+
+typedef struct {
+   uint8_t codigo[AGENT_MAX_CODIGO];
+   uint32_t len;                          // 0 = posição livre
+} programa_t;
+
+static programa_t progs[AGENT_MAX_PROGS];
+
+/**
+ * Guarda um programa.
+ * @return Identificador (1 a AGENT_MAX_PROGS), ou -1 se não houver espaço.
+ */
+int agent_store(const uint8_t *codigo, uint32_t len) {
+   if((len == 0) || (len > AGENT_MAX_CODIGO)) return -1;
+   for(int i=0; i<AGENT_MAX_PROGS; i++) {
+      if(progs[i].len) continue;
+      for(uint32_t k=0; k<len; k++) progs[i].codigo[k] = codigo[k];
+      progs[i].len = len;
+      return i + 1;
+   }
+   return -1;
+}
+
+/**
+ * Libera um programa.
+ */
+void agent_free(int prog) {
+   if((prog < 1) || (prog > AGENT_MAX_PROGS)) return;
+   progs[prog - 1].len = 0;
+}
+
+static void trace_escreve(const void *src, uint32_t n) {
+   const uint8_t *p = src;
+   while(n--) {
+      trace[trace_head & (TRACE_SIZE - 1)] = *p++;
+      trace_head++;
+   }
+}
+
+static void trace_le(void *dst, uint32_t n) {
+   uint8_t *p = dst;
+   while(n--) {
+      *p++ = trace[trace_tail & (TRACE_SIZE - 1)];
+      trace_tail++;
+   }
+}
+
+/**
+ * Acrescenta o registro montado ao buffer de trace.
+ */
+static void grava_registro(uint32_t pc) {
+   uint32_t cab[3] = { registro_len, pc, timer_ticks() };
+   uint32_t total = TRACE_CABECALHO + ((registro_len + 3) & ~3);
+   if(TRACE_SIZE - (trace_head - trace_tail) < total) {
+      trace_perdidos++;
+      return;
+   }
+   trace_escreve(cab, TRACE_CABECALHO);
+   trace_escreve(registro, registro_len);
+   trace_head += total - TRACE_CABECALHO - registro_len;   // alinhamento
+}
+
+static void registro_add(const void *src, uint32_t n) {
+   const uint8_t *p = src;
+   registro_usado = 1;
+   while(n-- && (registro_len < AGENT_TRACE_MAX)) registro[registro_len++] = *p++;
+}
+
+/**
+ * Verifica se um endereço pode ser lido pelos programas (somente RAM,
+ * leituras de periféricos podem ter efeitos colaterais).
+ */
+static int legivel(uint32_t addr, uint32_t n) {
+   return (addr < PERIPH_BASE) && (n <= PERIPH_BASE - addr);
+}
+
+static uint32_t le_mem(uint32_t addr, uint32_t n) {
+   const uint8_t *p = (const uint8_t*)addr;
+   uint32_t v = 0;
+   while(n--) v = (v << 8) | p[n];
+   return v;
+}
+
+#define EMPILHA(V)   do { if(sp == AG_PILHA) goto erro; pilha[sp++] = (V); } while(0)
+#define DESEMPILHA(V) do { if(sp == 0) goto erro; (V) = pilha[--sp]; } while(0)
+#define IMEDIATO(N)  do { if(ip + (N) > n) goto erro; } while(0)
+
+/**
+ * Avalia o programa de um breakpoint.
+ * Erros (pilha, endereço inválido, fim do código, laço) param a execução.
+ * @param prog Identificador retornado por agent_store.
+ * @param regs Registradores do usuário.
+ * @param hits Número de paradas do breakpoint.
+ * @return AGENT_PARA ou AGENT_CONTINUA.
+ */
+int agent_run(int prog, const uint32_t *regs, uint32_t hits) {
+   uint32_t pilha[AG_PILHA];
+   uint32_t sp = 0, ip = 0, passos = 0, a, b;
+   int res = AGENT_PARA;
+
+   if((prog < 1) || (prog > AGENT_MAX_PROGS)) return AGENT_PARA;
+   const uint8_t *c = progs[prog - 1].codigo;
+   uint32_t n = progs[prog - 1].len;
+   registro_len = 0;
+   registro_usado = 0;
+
+   for(;;) {
+      if((ip >= n) || (++passos > AG_MAX_PASSOS)) goto erro;
+      switch(c[ip++]) {
+         case AG_END:
+            DESEMPILHA(a);
+            res = a ? AGENT_PARA : AGENT_CONTINUA;
+            goto fim;
+         case AG_STOP:
+            res = AGENT_PARA;
+            goto fim;
+         case AG_CONT:
+            res = AGENT_CONTINUA;
+            goto fim;
+         case AG_CONST8:
+            IMEDIATO(1);
+            EMPILHA(c[ip]);
+            ip++;
+            break;
+         case AG_CONST32:
+            IMEDIATO(4);
+            EMPILHA(c[ip] | (c[ip+1] << 8) | (c[ip+2] << 16) | ((uint32_t)c[ip+3] << 24));
+            ip += 4;
+            break;
+         case AG_REG:
+            IMEDIATO(1);
+            if(c[ip] >= AG_NUM_REGS) goto erro;
+            EMPILHA(regs[c[ip]]);
+            ip++;
+            break;
+         case AG_REF8:
+         case AG_REF16:
+         case AG_REF32:
+            b = (c[ip-1] == AG_REF8) ? 1 : (c[ip-1] == AG_REF16) ? 2 : 4;
+            DESEMPILHA(a);
+            if(!legivel(a, b)) goto erro;
+            EMPILHA(le_mem(a, b));
+            break;
+         case AG_ADD: DESEMPILHA(b); DESEMPILHA(a); EMPILHA(a + b); break;
+         case AG_SUB: DESEMPILHA(b); DESEMPILHA(a); EMPILHA(a - b); break;
+         case AG_MUL: DESEMPILHA(b); DESEMPILHA(a); EMPILHA(a * b); break;
+         case AG_AND: DESEMPILHA(b); DESEMPILHA(a); EMPILHA(a & b); break;
+         case AG_OR:  DESEMPILHA(b); DESEMPILHA(a); EMPILHA(a | b); break;
+         case AG_XOR: DESEMPILHA(b); DESEMPILHA(a); EMPILHA(a ^ b); break;
+         case AG_LSH: DESEMPILHA(b); DESEMPILHA(a); EMPILHA((b < 32) ? a << b : 0); break;
+         case AG_RSH: DESEMPILHA(b); DESEMPILHA(a); EMPILHA((b < 32) ? a >> b : 0); break;
+         case AG_EQ:  DESEMPILHA(b); DESEMPILHA(a); EMPILHA(a == b); break;
+         case AG_LT:  DESEMPILHA(b); DESEMPILHA(a); EMPILHA((int32_t)a < (int32_t)b); break;
+         case AG_LTU: DESEMPILHA(b); DESEMPILHA(a); EMPILHA(a < b); break;
+         case AG_NOT:  DESEMPILHA(a); EMPILHA(~a); break;
+         case AG_LNOT: DESEMPILHA(a); EMPILHA(!a); break;
+         case AG_DUP:  DESEMPILHA(a); EMPILHA(a); EMPILHA(a); break;
+         case AG_POP:  DESEMPILHA(a); break;
+         case AG_SWAP: DESEMPILHA(b); DESEMPILHA(a); EMPILHA(b); EMPILHA(a); break;
+         case AG_IF_GOTO:
+         case AG_GOTO:
+            IMEDIATO(2);
+            a = 1;
+            if(c[ip-1] == AG_IF_GOTO) DESEMPILHA(a);
+            ip = a ? (uint32_t)(c[ip] | (c[ip+1] << 8)) : ip + 2;
+            break;
+         case AG_TRACE_REG:
+            IMEDIATO(1);
+            if(c[ip] >= AG_NUM_REGS) goto erro;
+            registro_add(&regs[c[ip]], 4);
+            ip++;
+            break;
+         case AG_TRACE_MEM:
+            DESEMPILHA(b);
+            DESEMPILHA(a);
+            if((b > AGENT_TRACE_MAX) || !legivel(a, b)) goto erro;
+            registro_add((const void*)a, b);
+            break;
+         case AG_TRACE_VAL:
+            DESEMPILHA(a);
+            registro_add(&a, 4);
+            break;
+         case AG_HITS:
+            EMPILHA(hits);
+            break;
+         default:
+            goto erro;
+      }
+   }
+
+erro:
+   res = AGENT_PARA;
+fim:
+   if(registro_usado) grava_registro(regs[15]);
+   return res;
+}
+
+/**
+ * Descarta os registros de trace.
+ */
+void agent_trace_clear(void) {
+   trace_tail = trace_head;
+   trace_perdidos = 0;
+}
+
+/**
+ * Quantidade de registros descartados por falta de espaço.
+ */
+uint32_t agent_trace_lost(void) {
+   return trace_perdidos;
+}
+
+/**
+ * Retira o registro mais antigo do buffer de trace.
+ * @param dados Destino dos dados (AGENT_TRACE_MAX bytes).
+ * @return 0 se o buffer estiver vazio.
+ */
+int agent_trace_next(uint32_t *pc, uint32_t *tempo, uint8_t *dados, uint32_t *len) {
+   uint32_t cab[3];
+   if(trace_head == trace_tail) return 0;
+   trace_le(cab, TRACE_CABECALHO);
+   *len = cab[0];
+   *pc = cab[1];
+   *tempo = cab[2];
+   trace_le(dados, cab[0]);
+   trace_tail += ((cab[0] + 3) & ~3) - cab[0];
+   return 1;
+}
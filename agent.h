@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Programas de condição e ação associados aos breakpoints: bytecode de
+ * uma máquina de pilha de 32 bits, no estilo das "agent expressions" do gdb.
+ * Os operandos imediatos são little endian; os destinos de desvio são
+ * deslocamentos a partir do início do programa.
+ */
+#define AG_END               0x00         // fim: para se o topo for diferente de zero
+#define AG_STOP              0x01         // fim: para
+#define AG_CONT              0x02         // fim: continua
+#define AG_CONST8            0x03         // imm8
+#define AG_CONST32           0x04         // imm32
+#define AG_REG               0x05         // imm8: registrador do usuário (0-15, 41 = cpsr)
+#define AG_REF8              0x06         // endereço -> byte
+#define AG_REF16             0x07         // endereço -> meia palavra
+#define AG_REF32             0x08         // endereço -> palavra
+#define AG_ADD               0x09
+#define AG_SUB               0x0a
+#define AG_MUL               0x0b
+#define AG_AND               0x0c
+#define AG_OR                0x0d
+#define AG_XOR               0x0e
+#define AG_NOT               0x0f         // complemento bit a bit
+#define AG_LNOT              0x10         // negação lógica
+#define AG_LSH               0x11
+#define AG_RSH               0x12         // deslocamento lógico
+#define AG_EQ                0x13
+#define AG_LT                0x14         // com sinal
+#define AG_LTU               0x15         // sem sinal
+#define AG_DUP               0x16
+#define AG_POP               0x17
+#define AG_SWAP              0x18
+#define AG_IF_GOTO           0x19         // imm16: desvia se o topo for diferente de zero
+#define AG_GOTO              0x1a         // imm16
+#define AG_TRACE_REG         0x1b         // imm8: registrador no registro de trace
+#define AG_TRACE_MEM         0x1c         // (endereço tamanho --): memória no trace
+#define AG_TRACE_VAL         0x1d         // (valor --): valor no trace
+#define AG_HITS              0x1e         // empilha o número de paradas do breakpoint
+
+#define AGENT_MAX_CODIGO     64           // bytes por programa
+#define AGENT_MAX_PROGS      32
+#define AGENT_TRACE_MAX      128          // bytes de dados por registro de trace
+
+/*
+ * Resultado da avaliação
+ */
+#define AGENT_CONTINUA       0
+#define AGENT_PARA           1
+
+int agent_store(const uint8_t *codigo, uint32_t len);
+void agent_free(int prog);
+int agent_run(int prog, const uint32_t *regs, uint32_t hits);
+
+void agent_trace_clear(void);
+uint32_t agent_trace_lost(void);
+int agent_trace_next(uint32_t *pc, uint32_t *tempo, uint8_t *dados, uint32_t *len);
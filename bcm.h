@@ -20,7 +20,17 @@
 #error Versão do Raspberry pi não definida
 #endif
 
-#if RPICPU == 2
+#ifndef HOST
+#define HOST         0
+#endif
+
+#if HOST
+/*
+ * Build nativo (make host): periféricos simulados por host/sim.c.
+ */
+extern uint8_t sim_periph[];
+#define PERIPH_BASE  ((uint32_t)(uintptr_t)sim_periph)
+#elif RPICPU == 2
 #define PERIPH_BASE  0x3f000000
 #elif RPICPU == 0
 #define PERIPH_BASE  0x20000000
@@ -30,6 +40,8 @@
 #define GPIO_ADDR    (PERIPH_BASE + 0x200000)
 #define AUX_ADDR     (PERIPH_BASE + 0x215000)
 #define AUX_MU_ADDR  (PERIPH_BASE + 0x215040)
+#define PL011_ADDR   (PERIPH_BASE + 0x201000)
+#define SYSTIMER_ADDR (PERIPH_BASE + 0x003000)
 #define TIMER_ADDR   (PERIPH_BASE + 0x00B400)
 #define IRQ_ADDR     (PERIPH_BASE + 0x00B200)
 #define DMA_BASE     (PERIPH_BASE + 0x7000)
@@ -48,6 +60,8 @@
 #define DMA12_ADDR   (DMA_BASE + 0xc00)
 #define DMA13_ADDR   (DMA_BASE + 0xd00)
 #define DMA14_ADDR   (DMA_BASE + 0xe00)
+#define PWM_ADDR     (PERIPH_BASE + 0x20c000)
+#define CM_PWM_ADDR  (PERIPH_BASE + 0x1010a0)
 #define DMA_STATUS_ADDR (DMA_BASE + 0xfe0)
 #define DMA_ENABLE_ADDR (DMA_BASE + 0xff0)
 
@@ -109,6 +123,43 @@ typedef struct {
 } mu_reg_t;
 #define MU_REG(X)    ((mu_reg_t*)(AUX_MU_ADDR))->X
 
+/*
+ * UART PL011
+ */
+typedef struct {
+   uint32_t dr;
+   uint32_t rsrecr;
+   unsigned : 32;
+   unsigned : 32;
+   unsigned : 32;
+   unsigned : 32;
+   uint32_t fr;
+   unsigned : 32;
+   uint32_t ilpr;
+   uint32_t ibrd;
+   uint32_t fbrd;
+   uint32_t lcrh;
+   uint32_t cr;
+   uint32_t ifls;
+   uint32_t imsc;
+   uint32_t ris;
+   uint32_t mis;
+   uint32_t icr;
+   uint32_t dmacr;
+} pl011_reg_t;
+#define PL011_REG(X) ((pl011_reg_t*)(PL011_ADDR))->X
+
+/*
+ * System timer (contador livre de 1 MHz)
+ */
+typedef struct {
+   uint32_t cs;
+   uint32_t clo;
+   uint32_t chi;
+   uint32_t c[4];
+} systimer_reg_t;
+#define SYSTIMER_REG(X)   ((systimer_reg_t*)(SYSTIMER_ADDR))->X
+
 /*
  * Timer
  */
@@ -125,6 +176,33 @@ typedef struct {
 } timer_reg_t;
 #define TIMER_REG(X)   ((timer_reg_t*)(TIMER_ADDR))->X
 
+/*
+ * PWM (usado como marcador de tempo do DMA: cada palavra escrita na FIFO
+ * é consumida em um período de rng1 ciclos do clock do PWM)
+ */
+typedef struct {
+   uint32_t ctl;
+   uint32_t sta;
+   uint32_t dmac;
+   unsigned : 32;
+   uint32_t rng1;
+   uint32_t dat1;
+   uint32_t fif1;
+   unsigned : 32;
+   uint32_t rng2;
+   uint32_t dat2;
+} pwm_reg_t;
+#define PWM_REG(X)     ((pwm_reg_t*)(PWM_ADDR))->X
+
+/*
+ * Gerenciador de clocks: clock do PWM
+ */
+typedef struct {
+   uint32_t ctl;
+   uint32_t div;
+} cm_reg_t;
+#define CM_PWM_REG(X)  ((cm_reg_t*)(CM_PWM_ADDR))->X
+
 /*
  * Controlador de interrupções.
  */
@@ -168,14 +246,27 @@ typedef struct {
    uint32_t debug;
 } dma_reg_t;
 #define DMA_CHN_REG(X,Y)  ((dma_reg_t*)(DMA ## X ## _ADDR))->Y
+#define DMA_REG(X,Y)      ((dma_reg_t*)(DMA_BASE + 0x100 * (X)))->Y
 #define DMA_STATUS_REG (*(uint32_t*)DMA_STATUS_ADDR)
 #define DMA_ENABLE_REG (*(uint32_t*)DMA_ENABLE_ADDR)
 
+/*
+ * Periféricos locais do ARM (somente BCM2836/7): mailboxes entre núcleos.
+ * O mailbox 3 de cada núcleo é usado para liberar os núcleos secundários:
+ * escrever em SET ativa os bits, escrever em CLR os desativa.
+ */
+#if RPICPU == 2
+#define LOCAL_ADDR   0x40000000
+#define LOCAL_MBOX_SET(N,M)  (*(volatile uint32_t*)(LOCAL_ADDR + 0x80 + 0x10 * (N) + 4 * (M)))
+#define LOCAL_MBOX_CLR(N,M)  (*(volatile uint32_t*)(LOCAL_ADDR + 0xc0 + 0x10 * (N) + 4 * (M)))
+#endif
+
 /*
  * Funções em assembler
  */
 void delay(uint32_t dur);
 uint32_t get_cpsr(void);
 void enable_irq(uint32_t en);
+void enable_fiq(uint32_t en);
 
 #endif
@@ -0,0 +1,297 @@
+#include "bcm.h"
+#include "bkpt.h"
+#include "hwdebug.h"
+#include "agent.h"
+#include "mmu.h"
+#include "nextpc.h"
+
+#define MEMORY(X)            *((volatile uint32_t*)(X))
+#define MEMORY16(X)          *((volatile uint16_t*)(X))
+
+/*
+ * Tabela hash com endereçamento aberto (sondagem linear), no máximo
+ * metade ocupada. A remoção desloca as entradas seguintes da mesma
+ * sequência, dispensando marcas de remoção.
+ */
+#define TAB_BITS             10
+#define TAB_SIZE             (1 << TAB_BITS)
+
+static bkpt_t tabela[TAB_SIZE];
+static uint32_t quantidade;
+
+/*
+ * Trap do passo (comando s), independente da tabela.
+ */
+static uint32_t passo_addr, passo_cont;
+static int passo_plantado;
+
+/*
+ * Breakpoint cujo trap foi retirado para executar a instrução dele
+ * (recolocado por bkpt_skip_done).
+ */
+static bkpt_t *pulado;
+
+static uint32_t hash(uint32_t addr) {
+   return ((addr >> 1) * 2654435761u) >> (32 - TAB_BITS);
+}
+
+/**
+ * Esvazia a tabela.
+ */
+void bkpt_init(void) {
+   for(int i=0; i<TAB_SIZE; i++) tabela[i].addr = 0;
+   quantidade = 0;
+   passo_addr = 0;
+   passo_plantado = 0;
+}
+
+/**
+ * Procura o breakpoint de um endereço.
+ * @return Breakpoint ou 0.
+ */
+bkpt_t *bkpt_find(uint32_t addr) {
+   if(addr == 0) return 0;
+   for(uint32_t i = hash(addr); ; i = (i + 1) & (TAB_SIZE - 1)) {
+      if(tabela[i].addr == addr) return &tabela[i];
+      if(tabela[i].addr == 0) return 0;
+   }
+}
+
+/**
+ * Escolhe como implementar um breakpoint ativo: registrador da unidade de
+ * depuração, se houver livre, senão instrução de trap.
+ */
+static void implementa(bkpt_t *b) {
+   b->hw = (hwdbg_bkpt_add(b->addr, b->kind) == 0);
+}
+
+/**
+ * Inclui um breakpoint (ativo, sem contagens).
+ * @param addr Endereço da instrução.
+ * @param kind Tamanho da instrução (2 ou 3 = Thumb, 4 = ARM).
+ * @return Breakpoint, ou 0 se a tabela estiver cheia.
+ */
+bkpt_t *bkpt_add(uint32_t addr, uint32_t kind) {
+   bkpt_t *b = bkpt_find(addr);
+   if(b) return b;                                     // breakpoint redefinido
+   if((addr == 0) || (quantidade >= BKPT_MAX)) return 0;
+
+   uint32_t i = hash(addr);
+   while(tabela[i].addr) i = (i + 1) & (TAB_SIZE - 1);
+   b = &tabela[i];
+   b->addr = addr;
+   b->hits = 0;
+   b->ignorar = 0;
+   b->ativo = 1;
+   b->kind = ((kind == 2) || (kind == 3)) ? 2 : 4;
+   b->plantado = 0;
+   b->cond = 0;
+   implementa(b);
+   quantidade++;
+   return b;
+}
+
+/**
+ * Remove um breakpoint.
+ * @return 0, ou -1 se não houver breakpoint no endereço.
+ */
+int bkpt_remove(uint32_t addr) {
+   bkpt_t *b = bkpt_find(addr);
+   if(b == 0) return -1;
+   if(b->hw) hwdbg_bkpt_remove(addr);
+   agent_free(b->cond);
+   if(pulado == b) pulado = 0;
+
+   uint32_t i = b - tabela;
+   uint32_t j = i;
+   for(;;) {
+      j = (j + 1) & (TAB_SIZE - 1);
+      if(tabela[j].addr == 0) break;
+      uint32_t k = hash(tabela[j].addr);
+      /*
+       * A entrada j pode ocupar a posição vaga i se i estiver entre
+       * sua posição ideal k e j (circularmente).
+       */
+      if(((j > i) && ((k <= i) || (k > j))) || ((j < i) && (k <= i) && (k > j))) {
+         tabela[i] = tabela[j];
+         i = j;
+      }
+   }
+   tabela[i].addr = 0;
+   quantidade--;
+   return 0;
+}
+
+/**
+ * Ativa ou desativa um breakpoint, mantendo as contagens.
+ * @return 0.
+ */
+int bkpt_enable(bkpt_t *b, int ativo) {
+   ativo = (ativo != 0);
+   if(b->ativo == ativo) return 0;
+   b->ativo = ativo;
+   if(ativo) implementa(b);
+   else if(b->hw) {
+      hwdbg_bkpt_remove(b->addr);
+      b->hw = 0;
+   }
+   return 0;
+}
+
+/**
+ * Percorre os breakpoints.
+ * @param i Posição na tabela (iniciar com 0).
+ * @return Próximo breakpoint, ou 0 no fim.
+ */
+bkpt_t *bkpt_next(uint32_t *i) {
+   while(*i < TAB_SIZE) {
+      bkpt_t *b = &tabela[(*i)++];
+      if(b->addr) return b;
+   }
+   return 0;
+}
+
+/**
+ * Quantidade de breakpoints na tabela.
+ */
+uint32_t bkpt_count(void) {
+   return quantidade;
+}
+
+/**
+ * Define o endereço do trap de passo (0 = nenhum); bit 0 em 1 para uma
+ * instrução Thumb.
+ */
+void bkpt_set_step(uint32_t addr) {
+   passo_addr = addr;
+}
+
+/**
+ * Endereço do trap de passo.
+ */
+uint32_t bkpt_step(void) {
+   return passo_addr & ~1;
+}
+
+/*
+ * Endereço do trap de um breakpoint, com o bit 0 indicando Thumb.
+ */
+#define LOCAL(B)             ((B)->addr | ((B)->kind == 2))
+
+static void planta(uint32_t addr, uint32_t *cont) {
+   if(addr & 1) {
+      addr &= ~1;
+      *cont = MEMORY16(addr);
+      MEMORY16(addr) = TRAP_THUMB;
+      cache_sync_code((void*)addr, 2);
+      return;
+   }
+   *cont = MEMORY(addr);
+   MEMORY(addr) = TRAP_INST;
+   cache_sync_code((void*)addr, 4);
+}
+
+static void restaura(uint32_t addr, uint32_t cont) {
+   if(addr & 1) {
+      addr &= ~1;
+      MEMORY16(addr) = cont;
+      cache_sync_code((void*)addr, 2);
+      return;
+   }
+   MEMORY(addr) = cont;
+   cache_sync_code((void*)addr, 4);
+}
+
+/**
+ * Coloca traps na memória nas posições dos breakpoints ativos de software
+ * e do passo, e liga os breakpoints de hardware.
+ * @param exceto Endereço que não recebe trap (instrução a ser executada
+ *               para sair de um breakpoint), ou 0. Durante essa instrução
+ *               a unidade de depuração fica desligada.
+ */
+void bkpt_activate(uint32_t exceto) {
+   uint32_t i = 0;
+   bkpt_t *b;
+   pulado = 0;
+   while((b = bkpt_next(&i))) {
+      if(!b->ativo || b->hw) continue;
+      if(b->addr == exceto) {
+         pulado = b;
+         continue;
+      }
+      planta(LOCAL(b), &b->cont);
+      b->plantado = 1;
+   }
+   if(exceto == 0) hwdbg_enable();
+   b = bkpt_find(passo_addr & ~1);
+   if(passo_addr && !(b && b->plantado)) {
+      planta(passo_addr, &passo_cont);
+      passo_plantado = 1;
+   }
+}
+
+/**
+ * Limpa a memória de instruções trap.
+ */
+void bkpt_restore_contents(void) {
+   uint32_t i = 0;
+   bkpt_t *b;
+   hwdbg_disable();
+   pulado = 0;
+   if(passo_plantado) {
+      restaura(passo_addr, passo_cont);
+      passo_plantado = 0;
+   }
+   while((b = bkpt_next(&i))) {
+      if(!b->plantado) continue;
+      restaura(LOCAL(b), b->cont);
+      b->plantado = 0;
+   }
+}
+
+/**
+ * Prepara a execução de uma instrução sem parar no breakpoint do endereço
+ * dela, mantendo os demais traps na memória (usado para continuar depois de
+ * uma parada resolvida pelo próprio PiCLIs). Se houver breakpoint no
+ * endereço, a unidade de depuração fica desligada durante a instrução.
+ * O trap de passo vai na instrução seguinte, decodificada só depois de a
+ * instrução original voltar à memória (o trap em si nunca é desvio).
+ * @param regs Registradores do usuário (r0-r15, cpsr).
+ */
+void bkpt_skip(const uint32_t *regs) {
+   uint32_t addr = regs[15], prox;
+   bkpt_t *b = bkpt_find(addr);
+   if(b) {
+      hwdbg_disable();
+      if(b->plantado) {
+         restaura(LOCAL(b), b->cont);
+         b->plantado = 0;
+      }
+      pulado = b;
+   }
+   prox = next_pc(regs);
+   passo_addr = prox;
+   b = bkpt_find(prox & ~1);
+   if(!(b && b->plantado)) {
+      planta(prox, &passo_cont);
+      passo_plantado = 1;
+   }
+}
+
+/**
+ * Conclui o passo iniciado por bkpt_skip ou bkpt_activate: retira o trap
+ * de passo, recoloca o breakpoint pulado e religa a unidade de depuração.
+ */
+void bkpt_skip_done(void) {
+   if(passo_plantado) {
+      restaura(passo_addr, passo_cont);
+      passo_plantado = 0;
+   }
+   passo_addr = 0;
+   if(pulado && pulado->ativo && !pulado->hw) {
+      planta(LOCAL(pulado), &pulado->cont);
+      pulado->plantado = 1;
+   }
+   pulado = 0;
+   hwdbg_enable();
+}
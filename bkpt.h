@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Instruções usadas como trap (breakpoint): swi no estado ARM e svc de
+ * 16 bits no estado Thumb
+ */
+#define TRAP_INST            0xefaaaaaa
+#define TRAP_THUMB           0xdfaa
+
+#define BKPT_MAX             512          // breakpoints simultâneos
+
+/*
+ * Breakpoint. Os implementados pela unidade de depuração (hw) não alteram
+ * a memória; os demais usam a instrução de trap.
+ */
+typedef struct {
+   uint32_t addr;                         // 0 = posição livre
+   uint32_t cont;                         // instrução substituída pelo trap
+   uint32_t hits;                         // paradas neste endereço
+   uint32_t ignorar;                      // paradas a ignorar (continua sozinho)
+   uint8_t ativo;
+   uint8_t hw;
+   uint8_t kind;                          // 2 = Thumb, 4 = ARM
+   uint8_t plantado;                      // trap presente na memória
+   uint8_t cond;                          // programa de condição/ação (0 = nenhum)
+} bkpt_t;
+
+void bkpt_init(void);
+bkpt_t *bkpt_add(uint32_t addr, uint32_t kind);
+int bkpt_remove(uint32_t addr);
+bkpt_t *bkpt_find(uint32_t addr);
+int bkpt_enable(bkpt_t *b, int ativo);
+bkpt_t *bkpt_next(uint32_t *i);
+uint32_t bkpt_count(void);
+void bkpt_set_step(uint32_t addr);
+uint32_t bkpt_step(void);
+void bkpt_activate(uint32_t exceto);
+void bkpt_restore_contents(void);
+void bkpt_skip(const uint32_t *regs);
+void bkpt_skip_done(void);
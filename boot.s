@@ -10,6 +10,38 @@
   str r1, [r0]               // salva o r0 original
 .endm
 
+/*
+ * Verifica privilégio de execução EL2 (HYP) ou EL1 (SVC) e,
+ * se estiver em EL2, 'retorna' para o modo SVC.
+ */
+.macro sai_hyp
+  mrs r0, cpsr
+  and r0, r0, #0x1f
+  cmp r0, #0x1a
+  bne 1f
+  mrs r0, cpsr
+  bic r0, r0, #0x1f
+  orr r0, r0, #0x13
+  msr spsr_cxsf, r0
+  adr lr, 1f
+  msr ELR_hyp, lr
+  eret                 // 'retorna' do privilégio EL2 para o EL1
+1:
+.endm
+
+/*
+ * Habilita o cache de instruções e a previsão de desvios
+ * (não dependem da MMU)
+ */
+.macro habilita_icache
+  mov r0, #0
+  mcr p15, 0, r0, c7, c5, 0     // invalida cache de instruções
+  mcr p15, 0, r0, c7, c5, 6     // invalida previsão de desvios
+  mrc p15, 0, r0, c1, c0, 0
+  orr r0, r0, #0x1800           // bits I (12) e Z (11)
+  mcr p15, 0, r0, c1, c0, 0
+.endm
+
 .section .init
 .global start
 start:
@@ -32,7 +64,7 @@ start:
   _iabort:   .word   iabort
   _dabort:   .word   dabort
   _irq:      .word   irq
-  _fiq:      .word   irq
+  _fiq:      .word   fiq
 
 /*
  * Instrução inicial (vetor de reset).
@@ -41,31 +73,16 @@ start:
 reset:
 .if RPICPU == 2
   /*
-   * Verifica priviégio de execução EL2 (HYP) ou EL1 (SVC)
+   * Sai do modo EL2 (HYP), se for o caso
    * Somente para Raspberry Pi 2 e 3
    */
-  mrs r0, cpsr
-  and r0, r0, #0x1f
-  cmp r0, #0x1a
-  bne continua
+  sai_hyp
 
-  /*
-   * Sai do modo EL2 (HYP)
-   */
-  mrs r0, cpsr
-  bic r0, r0, #0x1f
-  orr r0, r0, #0x13
-  msr spsr_cxsf, r0
-  add lr, pc, #4       // aponta o rótulo 'continua'
-  msr ELR_hyp, lr
-  eret                 // 'retorna' do privilégio EL2 para o EL1
-
-continua:
   /*
    * Verifica o índice das CPUs
    */
   mrc p15,0,r0,c0,c0,5    // registrador MPIDR
-  ands r0, r0, #0xff
+  ands r0, r0, #0x03
   beq core0
   b trava
 
@@ -75,6 +92,10 @@ core0:
   /*
    * configura os stack pointers
    */
+  mov r0, #0xd1     // Modo FIQ
+  msr cpsr_c,r0
+  ldr sp, =stack_fiq
+
   mov r0, #0xd2     // Modo IRQ
   msr cpsr_c,r0
   ldr sp, =stack_irq
@@ -85,6 +106,10 @@ core0:
 
   // Continua executando no modo supervisor (SVC), interrupções desabilitadas
 
+.if CACHE
+  habilita_icache
+.endif
+
   /*
    * Move o vetor de interrupções para o endereço 0
    */
@@ -96,18 +121,34 @@ core0:
   stmia r1!, {r2,r3,r4,r5,r6,r7,r8,r9}
 
    /*
-    * Zera segmento BSS
+    * Zera segmento BSS (16 bytes por vez, depois o restante byte a byte)
     */
    ldr r0, =bss_begin
    ldr r1, =bss_end
    mov r2, #0
+   mov r3, #0
+   mov r4, #0
+   mov r5, #0
 loop_bss:
+   add r6, r0, #16
+   cmp r6, r1
+   bhi resto_bss
+   stmia r0!, {r2-r5}
+   b loop_bss
+resto_bss:
    cmp r0, r1
-   bge done_bss
+   bhs done_bss
    strb r2, [r0], #1
-   b loop_bss
+   b resto_bss
 
 done_bss:
+.if CACHE
+  /*
+   * Tabela de páginas, MMU e cache de dados
+   */
+  bl mmu_init
+.endif
+
   /*
    * Executa a função main
    */
@@ -131,26 +172,58 @@ dabort:
   mov r0, #0x0b      // SIG_SEGV
   b goto_piclis
 swi:
-  sub lr, lr, #4     // deve retornar para a instrução do trap, não a seguinte
+  push {r0}
+  mrs r0, spsr
+  tst r0, #0x20      // estado Thumb: trap de 16 bits
+  subne lr, lr, #2
+  subeq lr, lr, #4   // deve retornar para a instrução do trap, não a seguinte
+  pop {r0}
   salva_contexto
   mov r0, #0x05      // SIG_TRAP
   b goto_piclis
+/*
+ * IRQ: os tratadores (ver irq.c) preservam apenas os registradores que
+ * podem ser alterados pelo código em C, tanto no PiCLIs quanto no programa
+ * do usuário. O contexto do usuário só é salvo em user_regs quando um ^C
+ * interrompe o programa.
+ */
 irq:
   sub lr, lr, #4
-  salva_contexto
+  push {r0-r3, r12, lr}
   bl trata_irq
   cmp r0, #0
+  beq fim_irq
+  ldr r0, =user_running
+  ldr r0, [r0]
+  cmp r0, #0
   bne ctrlc
-  b switch_back
+fim_irq:
+  ldmfd sp!, {r0-r3, r12, pc}^
 ctrlc:
+  pop {r0-r3, r12, lr}
+  salva_contexto
   mov r0, #0x02      // SIG_INT
   b goto_piclis
 
+/*
+ * FIQ: uma única fonte, encaminhada por irq_fiq (r8 a r12 são próprios
+ * do modo FIQ).
+ */
+fiq:
+  sub lr, lr, #4
+  push {r0-r3, r12, lr}
+  bl trata_fiq
+  ldmfd sp!, {r0-r3, r12, pc}^
+
 goto_piclis:
+  ldr r1, =user_running
+  mov r2, #0
+  str r2, [r1]       // volta ao PiCLIs
   mrs r1, cpsr
   bic r1, #0b11111
   orr r1, #0b10011
   msr cpsr,r1        // modo svc
+  ldr sp, =stack_svr // piclis_main não retorna: descarta os quadros anteriores
   b piclis_main
 
 /*
@@ -158,6 +231,9 @@ goto_piclis:
  */
 .global switch_back
 switch_back:
+   ldr r0, =user_running
+   mov r1, #1
+   str r1, [r0]           // programa do usuário em execução
    ldr r0, =user_regs
    ldr r1, [r0, #164]
    msr spsr, r1           // spsr do usuário
@@ -167,15 +243,55 @@ switch_back:
    movs pc, lr            // retorna
 
 /*
- * Suspende o núcleo
+ * Núcleos secundários (1 a 3) iniciados junto com o núcleo 0 aguardam
+ * aqui até que o núcleo 0 escreva no mailbox 3 o endereço de entrada,
+ * o mesmo protocolo usado pelo armstub do firmware.
  */
 trava:
+.if RPICPU == 2
+  mrc p15,0,r0,c0,c0,5
+  and r0, r0, #0x03
+  ldr r1, =0x400000cc     // mailbox 3 (leitura/limpeza) do núcleo 0
+  add r1, r1, r0, lsl #4
+espera_mbox:
+  wfe
+  ldr r2, [r1]
+  cmp r2, #0
+  beq espera_mbox
+  str r2, [r1]            // limpa o mailbox
+  bx r2
+.else
   wfe
   b trava
+.endif
 
+.if RPICPU == 2
 /*
- * Suspende o processamento por um número de ciclos
- * param r0 Número de ciclos.
+ * Entrada dos núcleos secundários, liberados por mc_init.
+ * Cada núcleo usa sua própria pilha SVC e executa com interrupções
+ * desabilitadas (as interrupções são atendidas pelo núcleo 0).
+ */
+.global secundario
+secundario:
+  sai_hyp
+  mov r0, #0xd3           // modo SVC, IRQ e FIQ desabilitadas
+  msr cpsr_c, r0
+  mrc p15,0,r4,c0,c0,5
+  and r4, r4, #0x03
+  ldr sp, =stack_nucleos
+  add sp, sp, r4, lsl #13 // 8K por núcleo
+.if CACHE
+  habilita_icache
+  bl mmu_enable           // mesma tabela de páginas do núcleo 0
+.endif
+  mov r0, r4
+  b mc_secundario
+.endif
+
+/*
+ * Suspende o processamento por um número de iterações
+ * (duração depende do clock e do cache; prefira delay_us em timer.c)
+ * param r0 Número de iterações.
  */
 .text
 .global delay
@@ -202,6 +318,24 @@ disable:
   msr cpsr_c, r0
   mov pc, lr
 
+/*
+ * Habilita ou desabilita a FIQ
+ * param r0 0 = desabilita, diferente de zero = habilita
+ */
+.global enable_fiq
+enable_fiq:
+  movs r0, r0
+  beq disable_fiq
+  mrs r0, cpsr
+  bic r0, r0, #0x40
+  msr cpsr_c, r0
+  mov pc, lr
+disable_fiq:
+  mrs r0, cpsr
+  orr r0, r0, #0x40
+  msr cpsr_c, r0
+  mov pc, lr
+
 /*
  * Lê o valor atual do CPSR
  */
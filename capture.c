@@ -0,0 +1,116 @@
+#include "bcm.h"
+#include "timer.h"
+#include "irq.h"
+#include "capture.h"
+
+/*
+ * Fila de eventos: a interrupção só avança cabeca e o comando só avança
+ * cauda, de modo que nenhum dos lados precisa mascarar as interrupções.
+ * Com a fila cheia, os eventos são contados e descartados.
+ */
+static capture_evento_t fila[CAPTURE_EVENTOS];
+static volatile uint32_t cabeca, cauda;
+static volatile uint32_t perdidos;
+static uint32_t armados;
+
+/**
+ * Desliga a detecção de bordas nos GPIOs capturados.
+ */
+static void desarma(void) {
+   if(armados) irq_fiq_stop();
+   GPIO_REG(gpren[0]) &= ~armados;
+   GPIO_REG(gpfen[0]) &= ~armados;
+   GPIO_REG(gpeds[0]) = armados;
+   armados = 0;
+}
+
+/**
+ * Inicia uma captura, descartando os eventos da anterior.
+ * @param mask GPIOs capturados (bit n = GPIO n).
+ * @param bordas CAPTURE_SUBIDA, CAPTURE_DESCIDA ou ambas.
+ */
+void capture_start(uint32_t mask, int bordas) {
+   desarma();
+   cauda = cabeca;
+   perdidos = 0;
+   if((mask == 0) || (bordas == 0)) return;
+
+   armados = mask;
+   GPIO_REG(gpeds[0]) = mask;
+   if(bordas & CAPTURE_SUBIDA) GPIO_REG(gpren[0]) |= mask;
+   if(bordas & CAPTURE_DESCIDA) GPIO_REG(gpfen[0]) |= mask;
+   irq_fiq(IRQ_GPIO(0), capture_irq);
+}
+
+/**
+ * Encerra a captura; os eventos registrados continuam na fila.
+ */
+void capture_stop(void) {
+   desarma();
+}
+
+/**
+ * GPIOs capturados (0 = captura parada).
+ */
+uint32_t capture_mask(void) {
+   return armados;
+}
+
+/**
+ * Quantidade de eventos na fila.
+ */
+uint32_t capture_pendentes(void) {
+   return cabeca - cauda;
+}
+
+/**
+ * Eventos descartados por falta de espaço na fila.
+ */
+uint32_t capture_perdidos(void) {
+   return perdidos;
+}
+
+/**
+ * Copia os eventos mais antigos da fila sem retirá-los.
+ * @param dst Destino.
+ * @param max Máximo de eventos.
+ * @return Quantidade copiada.
+ */
+uint32_t capture_copia(capture_evento_t *dst, uint32_t max) {
+   uint32_t n = cabeca - cauda;
+   if(n > max) n = max;
+   for(uint32_t i=0; i<n; i++) dst[i] = fila[(cauda + i) & (CAPTURE_EVENTOS-1)];
+   return n;
+}
+
+/**
+ * Retira da fila os n eventos mais antigos (já enviados).
+ */
+void capture_descarta(uint32_t n) {
+   if(n > cabeca - cauda) n = cabeca - cauda;
+   cauda += n;
+}
+
+/**
+ * Registra as bordas detectadas: trata a interrupção do banco 0 dos GPIOs,
+ * encaminhada para a FIQ durante a captura.
+ * @return 0 (ver irq.h).
+ */
+uint32_t capture_irq(void) {
+   uint32_t bordas = GPIO_REG(gpeds[0]) & armados;
+   if(bordas == 0) return 0;
+   GPIO_REG(gpeds[0]) = bordas;
+   uint32_t t = timer_ticks();
+   uint32_t nivel = GPIO_REG(gplev[0]) & armados;
+
+   if(cabeca - cauda == CAPTURE_EVENTOS) {
+      perdidos++;
+      return 0;
+   }
+   capture_evento_t *e = &fila[cabeca & (CAPTURE_EVENTOS-1)];
+   e->t = t;
+   e->bordas = bordas;
+   e->nivel = nivel;
+   cabeca++;
+   return 0;
+}
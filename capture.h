@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Captura de bordas dos GPIOs 0 a 31 (os do conector estão entre 0 e 27):
+ * a interrupção do GPIO, atendida pela FIQ, registra cada evento, com o
+ * instante em microssegundos, em uma fila circular lida pelo comando $pCAP.
+ */
+#define CAPTURE_SUBIDA       1
+#define CAPTURE_DESCIDA      2
+
+#define CAPTURE_EVENTOS      4096         // capacidade da fila (potência de 2)
+
+typedef struct {
+   uint32_t t;                            // system timer (us) na interrupção
+   uint32_t bordas;                       // GPIOs com borda detectada (bit n = GPIO n)
+   uint32_t nivel;                        // nível dos GPIOs capturados após as bordas
+} capture_evento_t;
+
+void capture_start(uint32_t mask, int bordas);
+void capture_stop(void);
+uint32_t capture_mask(void);
+uint32_t capture_pendentes(void);
+uint32_t capture_perdidos(void);
+uint32_t capture_copia(capture_evento_t *dst, uint32_t max);
+void capture_descarta(uint32_t n);
+uint32_t capture_irq(void);
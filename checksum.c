@@ -0,0 +1,237 @@
+#include "checksum.h"
+
+/*
+ * CRC-32 (polinômio refletido 0xedb88320, o mesmo do zlib e do Intel HEX
+ * gerado pelo objcopy), calculado 8 bytes por vez com 8 tabelas.
+ */
+#define CRC32_POLI           0xedb88320
+static uint32_t crc_tab[8][256];
+
+/*
+ * Adler-32: maior primo menor que 2^16 e maior bloco que não estoura 32 bits.
+ */
+#define ADLER_MOD            65521
+#define ADLER_NMAX           5552
+
+/*
+ * Constantes do xxHash32.
+ */
+#define XXH_P1               2654435761u
+#define XXH_P2               2246822519u
+#define XXH_P3               3266489917u
+#define XXH_P4               668265263u
+#define XXH_P5               374761393u
+
+/**
+ * Gera as tabelas do CRC-32.
+ */
+void checksum_init(void) {
+   for(uint32_t i=0; i<256; i++) {
+      uint32_t c = i;
+      for(int k=0; k<8; k++) c = (c & 1) ? (c >> 1) ^ CRC32_POLI : (c >> 1);
+      crc_tab[0][i] = c;
+   }
+   for(uint32_t i=0; i<256; i++) {
+      for(int t=1; t<8; t++) {
+         uint32_t c = crc_tab[t-1][i];
+         crc_tab[t][i] = (c >> 8) ^ crc_tab[0][c & 0xff];
+      }
+   }
+}
+
+/**
+ * Atualiza um CRC-32.
+ * @param crc CRC anterior (0 no início).
+ * @param buf Dados.
+ * @param n Quantidade de bytes.
+ * @return CRC atualizado.
+ */
+uint32_t crc32(uint32_t crc, const void *buf, uint32_t n) {
+   const uint8_t *p = buf;
+   crc = ~crc;
+
+   while(n && ((uint32_t)p & 3)) {
+      crc = crc_tab[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+      n--;
+   }
+   while(n >= 8) {
+      uint32_t um = ((const uint32_t*)p)[0] ^ crc;
+      uint32_t dois = ((const uint32_t*)p)[1];
+      crc = crc_tab[7][um & 0xff] ^ crc_tab[6][(um >> 8) & 0xff]
+          ^ crc_tab[5][(um >> 16) & 0xff] ^ crc_tab[4][um >> 24]
+          ^ crc_tab[3][dois & 0xff] ^ crc_tab[2][(dois >> 8) & 0xff]
+          ^ crc_tab[1][(dois >> 16) & 0xff] ^ crc_tab[0][dois >> 24];
+      p += 8;
+      n -= 8;
+   }
+   while(n--) {
+      crc = crc_tab[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+   }
+   return ~crc;
+}
+
+/*
+ * Combinação de checksums calculados em partes (por exemplo, em núcleos
+ * diferentes): o CRC de um bloco deslocado de n bytes equivale a aplicar
+ * n * 8 vezes o operador de deslocamento do polinômio, uma matriz 32x32
+ * sobre GF(2) elevada por quadrados sucessivos.
+ */
+static uint32_t gf2_vezes(const uint32_t *mat, uint32_t vec) {
+   uint32_t soma = 0;
+   while(vec) {
+      if(vec & 1) soma ^= *mat;
+      vec >>= 1;
+      mat++;
+   }
+   return soma;
+}
+
+static void gf2_quadrado(uint32_t *quad, const uint32_t *mat) {
+   for(int i=0; i<32; i++) quad[i] = gf2_vezes(mat, mat[i]);
+}
+
+/**
+ * Combina os CRC-32 de dois blocos consecutivos.
+ * @param crc1 CRC do primeiro bloco.
+ * @param crc2 CRC do segundo bloco.
+ * @param len2 Tamanho do segundo bloco em bytes.
+ * @return CRC dos dois blocos concatenados.
+ */
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint32_t len2) {
+   uint32_t par[32], impar[32];
+   if(len2 == 0) return crc1;
+
+   impar[0] = CRC32_POLI;                    // operador para 1 bit
+   for(int i=1; i<32; i++) impar[i] = 1 << (i - 1);
+   gf2_quadrado(par, impar);                 // 2 bits
+   gf2_quadrado(impar, par);                 // 4 bits
+
+   do {
+      gf2_quadrado(par, impar);              // primeira passagem: 1 byte
+      if(len2 & 1) crc1 = gf2_vezes(par, crc1);
+      len2 >>= 1;
+      if(len2 == 0) break;
+      gf2_quadrado(impar, par);
+      if(len2 & 1) crc1 = gf2_vezes(impar, crc1);
+      len2 >>= 1;
+   } while(len2);
+   return crc1 ^ crc2;
+}
+
+/**
+ * Combina os Adler-32 de dois blocos consecutivos.
+ * @param adler1 Adler-32 do primeiro bloco.
+ * @param adler2 Adler-32 do segundo bloco.
+ * @param len2 Tamanho do segundo bloco em bytes.
+ * @return Adler-32 dos dois blocos concatenados.
+ */
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, uint32_t len2) {
+   uint32_t resto = len2 % ADLER_MOD;
+   uint32_t a = adler1 & 0xffff;
+   uint32_t b = (resto * a) % ADLER_MOD;
+   a += (adler2 & 0xffff) + ADLER_MOD - 1;
+   b += (adler1 >> 16) + (adler2 >> 16) + ADLER_MOD - resto;
+   if(a >= ADLER_MOD) a -= ADLER_MOD;
+   if(a >= ADLER_MOD) a -= ADLER_MOD;
+   if(b >= 2 * ADLER_MOD) b -= 2 * ADLER_MOD;
+   if(b >= ADLER_MOD) b -= ADLER_MOD;
+   return (b << 16) | a;
+}
+
+/**
+ * Atualiza um Adler-32.
+ * @param adler Valor anterior (1 no início).
+ * @param buf Dados.
+ * @param n Quantidade de bytes.
+ * @return Valor atualizado.
+ */
+uint32_t adler32(uint32_t adler, const void *buf, uint32_t n) {
+   const uint8_t *p = buf;
+   uint32_t a = adler & 0xffff, b = adler >> 16;
+
+   while(n) {
+      uint32_t k = (n < ADLER_NMAX) ? n : ADLER_NMAX;
+      n -= k;
+      while(k >= 8) {
+         a += p[0]; b += a;
+         a += p[1]; b += a;
+         a += p[2]; b += a;
+         a += p[3]; b += a;
+         a += p[4]; b += a;
+         a += p[5]; b += a;
+         a += p[6]; b += a;
+         a += p[7]; b += a;
+         p += 8;
+         k -= 8;
+      }
+      while(k--) {
+         a += *p++;
+         b += a;
+      }
+      a %= ADLER_MOD;
+      b %= ADLER_MOD;
+   }
+   return (b << 16) | a;
+}
+
+static uint32_t rotl(uint32_t x, int r) {
+   return (x << r) | (x >> (32 - r));
+}
+
+/**
+ * Lê uma palavra little-endian (sem exigir alinhamento).
+ */
+static uint32_t le32(const uint8_t *p) {
+   if(((uint32_t)p & 3) == 0) return *(const uint32_t*)p;
+   return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t xxh_round(uint32_t acc, uint32_t v) {
+   return rotl(acc + v * XXH_P2, 13) * XXH_P1;
+}
+
+/**
+ * Calcula o hash xxHash32 (não criptográfico, 16 bytes por iteração).
+ * @param buf Dados.
+ * @param n Quantidade de bytes.
+ * @param seed Semente.
+ */
+uint32_t xxh32(const void *buf, uint32_t n, uint32_t seed) {
+   const uint8_t *p = buf;
+   uint32_t total = n, h;
+
+   if(n >= 16) {
+      uint32_t v1 = seed + XXH_P1 + XXH_P2;
+      uint32_t v2 = seed + XXH_P2;
+      uint32_t v3 = seed;
+      uint32_t v4 = seed - XXH_P1;
+      do {
+         v1 = xxh_round(v1, le32(p));
+         v2 = xxh_round(v2, le32(p + 4));
+         v3 = xxh_round(v3, le32(p + 8));
+         v4 = xxh_round(v4, le32(p + 12));
+         p += 16;
+         n -= 16;
+      } while(n >= 16);
+      h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+   } else {
+      h = seed + XXH_P5;
+   }
+
+   h += total;
+   while(n >= 4) {
+      h = rotl(h + le32(p) * XXH_P3, 17) * XXH_P4;
+      p += 4;
+      n -= 4;
+   }
+   while(n--) {
+      h = rotl(h + (*p++) * XXH_P5, 11) * XXH_P1;
+   }
+
+   h ^= h >> 15;
+   h *= XXH_P2;
+   h ^= h >> 13;
+   h *= XXH_P3;
+   h ^= h >> 16;
+   return h;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+
+void checksum_init(void);
+uint32_t crc32(uint32_t crc, const void *buf, uint32_t n);
+uint32_t adler32(uint32_t adler, const void *buf, uint32_t n);
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint32_t len2);
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, uint32_t len2);
+uint32_t xxh32(const void *buf, uint32_t n, uint32_t seed);
@@ -0,0 +1,214 @@
+#include "uart.h"
+#include "cmd.h"
+#include "hex.h"
+
+/*
+ * Índice dos comandos: tabela hash com endereçamento aberto.
+ * O tamanho deve ser potência de 2 e maior que o número de comandos.
+ */
+#define HASH_SIZE            128
+#define FNV_BASE             2166136261u
+#define FNV_PRIMO            16777619u
+
+typedef struct {
+   uint32_t hash;
+   uint8_t len;
+   int16_t cmd;                           // -1 = posição vaga
+} cmd_hash_t;
+
+static cmd_hash_t indice[HASH_SIZE];
+static const cmd_t *comandos;
+static int num_comandos;
+
+static int separador(char c) {
+   return (c == ' ') || (c == ',') || (c == '=') || (c == ':') || (c == ';')
+       || (c == 0);
+}
+
+static uint32_t fnv(uint32_t h, char c) {
+   return (h ^ (uint8_t)c) * FNV_PRIMO;
+}
+
+/**
+ * Monta o índice de comandos.
+ * @param tab Tabela de comandos.
+ * @param n Número de comandos na tabela.
+ */
+void cmd_init(const cmd_t *tab, int n) {
+   comandos = tab;
+   num_comandos = n;
+   for(int i=0; i<HASH_SIZE; i++) indice[i].cmd = -1;
+
+   for(int i=0; i<n; i++) {
+      uint32_t h = FNV_BASE;
+      int len = 0;
+      for(const char *p = tab[i].nome; *p; p++, len++) h = fnv(h, *p);
+      uint32_t j = h & (HASH_SIZE-1);
+      while(indice[j].cmd >= 0) j = (j + 1) & (HASH_SIZE-1);
+      indice[j].hash = h;
+      indice[j].len = len;
+      indice[j].cmd = i;
+   }
+}
+
+/**
+ * Procura no índice um comando com o nome exato s[0..len-1].
+ */
+static const cmd_t *procura(uint32_t h, const char *s, int len) {
+   uint32_t j = h & (HASH_SIZE-1);
+   while(indice[j].cmd >= 0) {
+      if((indice[j].hash == h) && (indice[j].len == len)) {
+         const char *nome = comandos[indice[j].cmd].nome;
+         int k = 0;
+         while((k < len) && (nome[k] == s[k])) k++;
+         if(k == len) return &comandos[indice[j].cmd];
+      }
+      j = (j + 1) & (HASH_SIZE-1);
+   }
+   return 0;
+}
+
+/**
+ * Identifica o comando no início de uma linha.
+ * Usa o maior prefixo que corresponde a um comando registrado, o que permite
+ * argumentos colados ao nome (ex.: "P1=ab", "Z0,2000,4").
+ * @param s Linha de comando.
+ * @param len Retorna o tamanho do nome identificado.
+ * @return Comando encontrado ou 0.
+ */
+const cmd_t *cmd_lookup(const char *s, int *len) {
+   const cmd_t *achado = 0;
+   uint32_t h = FNV_BASE;
+   for(int i=0; !separador(s[i]); i++) {
+      const cmd_t *c;
+      h = fnv(h, s[i]);
+      c = procura(h, s, i + 1);
+      if(c) {
+         achado = c;
+         *len = i + 1;
+      }
+   }
+   return achado;
+}
+
+/**
+ * Recebe uma linha de comando, terminada por CR ou, em pacotes no formato
+ * do gdb, por '#' seguido de dois caracteres de checksum (ignorados).
+ * @param linha Buffer para a linha.
+ * @param max Tamanho do buffer.
+ * @param pacote Retorna 1 se a linha terminou com '#'.
+ * @return Tamanho da linha, ou -1 se ela não coube no buffer.
+ */
+int cmd_readline(char *linha, int max, int *pacote) {
+   int n = 0, excesso = 0;
+   uint8_t c;
+   *pacote = 0;
+   for(;;) {
+      c = uart_getc();
+      if(c == '\n') continue;
+      if(c == '\r') break;
+      if(c == '#') {
+         uart_getc();                        // ignora checksum
+         uart_getc();
+         *pacote = 1;
+         break;
+      }
+      if(n < max - 1) linha[n++] = c;
+      else excesso = 1;
+   }
+   linha[n] = 0;
+   return excesso ? -1 : n;
+}
+
+/**
+ * Converte os argumentos de um comando.
+ * @param spec Especificação dos argumentos (ver cmd.h).
+ * @param p Texto após o nome do comando (é modificado).
+ * @param args Retorna os argumentos convertidos.
+ * @return 0 em caso de sucesso, -1 se faltar argumento ou houver erro de formato.
+ */
+int cmd_parse(const char *spec, char *p, cmd_args_t *args) {
+   int opcional = 0;
+   args->argc = 0;
+
+   for(; *spec; spec++) {
+      char tipo = *spec;
+      int i = args->argc;
+      if(tipo == '[') {
+         opcional = 1;
+         continue;
+      }
+      if(i == CMD_MAX_ARGS) return -1;
+
+      if(tipo == 's') {
+         if(*p == ' ') p++;
+         if((*p == 0) && !opcional) return -1;
+         if(*p == 0) break;
+         args->str[i] = p;
+         args->v[i] = 0;
+         args->argc++;
+         break;                              // consome o restante da linha
+      }
+
+      while(*p && separador(*p)) p++;
+      if(*p == 0) {
+         if(opcional) break;
+         return -1;
+      }
+      args->str[i] = p;
+
+      if(tipo == 'x') {
+         uint32_t v = 0;
+         int d;
+         if(hex_value(*p) < 0) return -1;
+         while((d = hex_value(*p)) >= 0) {
+            v = (v << 4) | d;
+            p++;
+         }
+         args->v[i] = v;
+      } else if(tipo == 'd') {
+         int32_t v = 0, neg = 0;
+         if(*p == '-') {
+            neg = 1;
+            p++;
+         }
+         if((*p < '0') || (*p > '9')) return -1;
+         while((*p >= '0') && (*p <= '9')) {
+            v = v * 10 + (*p - '0');
+            p++;
+         }
+         args->v[i] = neg ? -v : v;
+      } else if(tipo == 'w') {
+         while(!separador(*p)) p++;
+         if(*p) *p++ = 0;
+         args->v[i] = 0;
+         args->argc++;
+         continue;
+      } else return -1;
+
+      if(!separador(*p)) return -1;
+      args->argc++;
+   }
+   return 0;
+}
+
+/**
+ * Identifica e executa uma linha de comando.
+ * Pacotes do gdb ("$g", "$m...") são aceitos sem o '$' inicial.
+ * @param linha Linha de comando (é modificada).
+ * @return Resultado do tratador (CMD_...).
+ */
+int cmd_exec(char *linha) {
+   static cmd_args_t args;
+   const cmd_t *c;
+   int len;
+
+   c = cmd_lookup(linha, &len);
+   if((c == 0) && (linha[0] == '$')) {
+      linha++;
+      c = cmd_lookup(linha, &len);
+   }
+   if(c == 0) return CMD_NULO;
+   if(cmd_parse(c->args, linha + len, &args) < 0) return CMD_ERRO;
+   return c->handler(&args);
+}
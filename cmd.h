@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+
+#define CMD_MAX_ARGS         8
+#define CMD_LINHA            1024         // tamanho máximo de uma linha de comando
+
+/*
+ * Valores de retorno dos tratadores de comandos.
+ */
+#define CMD_PRONTO           0            // resposta já enviada pelo tratador
+#define CMD_ENVIA_OK         1
+#define CMD_ERRO             2
+#define CMD_NULO             3            // comando não reconhecido
+#define CMD_EXECUTA          4            // retoma o programa do usuário
+
+/*
+ * Argumentos de um comando, convertidos conforme a especificação:
+ *   'x'  número hexadecimal de 32 bits
+ *   'd'  número decimal com sinal
+ *   'w'  palavra (até o próximo separador)
+ *   's'  restante da linha
+ *   '['  os argumentos seguintes são opcionais
+ */
+typedef struct {
+   int argc;
+   uint32_t v[CMD_MAX_ARGS];
+   char *str[CMD_MAX_ARGS];
+} cmd_args_t;
+
+typedef int (*cmd_handler_t)(cmd_args_t *args);
+
+typedef struct {
+   const char *nome;
+   cmd_handler_t handler;
+   const char *args;
+} cmd_t;
+
+void cmd_init(const cmd_t *tab, int n);
+int cmd_readline(char *linha, int max, int *pacote);
+const cmd_t *cmd_lookup(const char *s, int *len);
+int cmd_parse(const char *spec, char *p, cmd_args_t *args);
+int cmd_exec(char *linha);
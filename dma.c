@@ -0,0 +1,191 @@
+#include "bcm.h"
+#include "dma.h"
+#include "mmu.h"
+
+/*
+ * Canais disponíveis para o ARM (os demais são usados pelo firmware da GPU).
+ * Canais 0 a 6 são completos; 7 a 14 são "lite" (no máximo 64 KiB por bloco).
+ */
+#define DMA_CANAIS           0x7f35
+#define DMA_NUM_CANAIS       15
+#define DMA_MAX_FULL         0x3ffffff0
+#define DMA_MAX_LITE         0xfff0
+
+/*
+ * Blocos de controle de cada canal (devem estar alinhados em 32 bytes)
+ * e padrões de preenchimento usados por dma_fill.
+ */
+static dma_cb_t cbs[DMA_NUM_CANAIS][DMA_MAX_CBS] __attribute__((aligned(32)));
+static uint32_t padroes[DMA_NUM_CANAIS][8] __attribute__((aligned(32)));
+static uint32_t alocados;
+
+/*
+ * Área de destino de cada canal, descartada do cache ao fim da transferência.
+ */
+static uint8_t *destino[DMA_NUM_CANAIS];
+static uint32_t destino_len[DMA_NUM_CANAIS];
+
+/**
+ * Inicializa o controlador de DMA.
+ */
+void dma_init(void) {
+   alocados = 0;
+}
+
+/**
+ * Reserva um canal de DMA, preferindo os canais completos.
+ * @return Índice do canal, ou -1 se não houver canal livre.
+ */
+int dma_alloc(void) {
+   for(int ch=0; ch<DMA_NUM_CANAIS; ch++) {
+      if(bit_not_set(DMA_CANAIS, ch)) continue;
+      if(bit_is_set(alocados, ch)) continue;
+      set_bit(alocados, ch);
+      set_bit(DMA_ENABLE_REG, ch);
+      DMA_REG(ch, cs) = DMA_CS_RESET;
+      DMA_REG(ch, debug) = 7;             // limpa erros
+      return ch;
+   }
+   return -1;
+}
+
+/**
+ * Libera um canal de DMA, interrompendo a transferência em andamento.
+ * @param ch Índice do canal.
+ */
+void dma_free(int ch) {
+   if((ch < 0) || (ch >= DMA_NUM_CANAIS)) return;
+   DMA_REG(ch, cs) = DMA_CS_RESET;
+   clr_bit(alocados, ch);
+}
+
+/**
+ * Blocos de controle reservados para um canal (DMA_MAX_CBS blocos).
+ * @param ch Índice do canal.
+ */
+dma_cb_t *dma_cbs(int ch) {
+   return cbs[ch];
+}
+
+/**
+ * Inicia a execução de uma cadeia de blocos de controle.
+ * @param ch Índice do canal.
+ * @param cb Primeiro bloco da cadeia.
+ */
+void dma_start(int ch, dma_cb_t *cb) {
+   cache_clean(cbs[ch], sizeof(cbs[ch]));
+   DMA_REG(ch, cs) = DMA_CS_END | DMA_CS_INT;
+   DMA_REG(ch, cb) = BUS_ADDR(cb);
+   DMA_REG(ch, cs) = DMA_CS_ACTIVE | DMA_CS_PRIORITY(8) | DMA_CS_PANIC(15)
+                   | DMA_CS_WAIT_WRITES;
+}
+
+/**
+ * Verifica se um canal ainda está transferindo.
+ * @param ch Índice do canal.
+ */
+int dma_busy(int ch) {
+   return (DMA_REG(ch, cs) & DMA_CS_ACTIVE) != 0;
+}
+
+/**
+ * Aguarda o fim da cadeia de blocos de controle de um canal.
+ * @param ch Índice do canal.
+ * @return 0 em caso de sucesso, -1 se o controlador sinalizou erro.
+ */
+int dma_wait(int ch) {
+   uint32_t cs;
+   while((cs = DMA_REG(ch, cs)) & DMA_CS_ACTIVE) {
+      if(cs & DMA_CS_ERROR) break;
+   }
+   DMA_REG(ch, cs) = DMA_CS_END | DMA_CS_INT;
+   if(destino_len[ch]) {
+      cache_invalidate(destino[ch], destino_len[ch]);
+      destino_len[ch] = 0;
+   }
+   if(cs & DMA_CS_ERROR) {
+      DMA_REG(ch, cs) = DMA_CS_RESET;
+      DMA_REG(ch, debug) = 7;
+      return -1;
+   }
+   return 0;
+}
+
+/**
+ * Monta uma cadeia de blocos de controle para uma transferência longa.
+ * @return Primeiro bloco da cadeia, ou 0 se a transferência não couber.
+ */
+static dma_cb_t *monta_cadeia(int ch, uint32_t ti, uint32_t dst, uint32_t src,
+                              uint32_t len) {
+   uint32_t max = (ch < 7) ? DMA_MAX_FULL : DMA_MAX_LITE;
+   dma_cb_t *cb = cbs[ch];
+   int n = 0;
+
+   while(len) {
+      uint32_t k = (len > max) ? max : len;
+      if(n == DMA_MAX_CBS) return 0;
+      cb[n].ti = ti;
+      cb[n].saddr = BUS_ADDR(src);
+      cb[n].daddr = BUS_ADDR(dst);
+      cb[n].length = k;
+      cb[n].stride = 0;
+      cb[n].nextcb = 0;
+      if(n > 0) cb[n-1].nextcb = BUS_ADDR(&cb[n]);
+      if(ti & DMA_TI_SRC_INC) src += k;
+      dst += k;
+      len -= k;
+      n++;
+   }
+   return (n > 0) ? cb : 0;
+}
+
+/**
+ * Inicia uma cópia de memória. Não aguarda o término (ver dma_wait,
+ * que também descarta do cache a área de destino). As leituras e escritas
+ * de 128 bits são usadas só com as áreas alinhadas em 16 bytes; nas demais,
+ * o próprio DMA agrupa os acessos desalinhados.
+ * @param ch Índice do canal.
+ * @param dst Endereço de destino.
+ * @param src Endereço de origem.
+ * @param len Quantidade de bytes.
+ * @return 0 se a transferência foi iniciada, -1 em caso de erro ou se o
+ *         destino começar dentro da origem (a cópia é sempre crescente).
+ */
+int dma_copy(int ch, void *dst, const void *src, uint32_t len) {
+   uint32_t ti = DMA_TI_SRC_INC | DMA_TI_DEST_INC | DMA_TI_BURST(8);
+   dma_cb_t *cb;
+   if(((uint32_t)dst > (uint32_t)src) && ((uint32_t)dst < (uint32_t)src + len)) return -1;
+   if((ch < 7) && !(((uint32_t)dst | (uint32_t)src | len) & 15))
+      ti |= DMA_TI_SRC_WIDTH | DMA_TI_DEST_WIDTH;
+   cb = monta_cadeia(ch, ti, (uint32_t)dst, (uint32_t)src, len);
+   if(cb == 0) return -1;
+   cache_clean(src, len);
+   cache_flush(dst, len);
+   destino[ch] = dst;
+   destino_len[ch] = len;
+   dma_start(ch, cb);
+   return 0;
+}
+
+/**
+ * Inicia o preenchimento de uma área com uma palavra de 32 bits.
+ * Não aguarda o término (ver dma_wait).
+ * @param ch Índice do canal.
+ * @param dst Endereço de destino (alinhado em 4 bytes).
+ * @param pattern Palavra a repetir.
+ * @param len Quantidade de bytes (múltiplo de 4).
+ * @return 0 se a transferência foi iniciada, -1 em caso de erro.
+ */
+int dma_fill(int ch, void *dst, uint32_t pattern, uint32_t len) {
+   dma_cb_t *cb;
+   padroes[ch][0] = pattern;
+   cb = monta_cadeia(ch, DMA_TI_DEST_INC | DMA_TI_BURST(8), (uint32_t)dst,
+                     (uint32_t)padroes[ch], len);
+   if(cb == 0) return -1;
+   cache_clean(padroes[ch], sizeof(padroes[ch]));
+   cache_flush(dst, len);
+   destino[ch] = dst;
+   destino_len[ch] = len;
+   dma_start(ch, cb);
+   return 0;
+}
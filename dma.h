@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include "bcm.h"
+
+/*
+ * Endereços vistos pelo controlador de DMA (barramento VC).
+ * A memória é acessada pelo alias que não passa pelo cache L2 da GPU.
+ */
+#if RPICPU == 2
+#define BUS_ADDR(X)          ((uint32_t)(X) | 0xc0000000)
+#else
+#define BUS_ADDR(X)          ((uint32_t)(X) | 0x40000000)
+#endif
+#define PERIPH_BUS_ADDR(X)   ((uint32_t)(X) - PERIPH_BASE + 0x7e000000)
+
+/*
+ * Campo TI (transfer information) dos blocos de controle
+ */
+#define DMA_TI_INTEN         __bit(0)
+#define DMA_TI_TDMODE        __bit(1)
+#define DMA_TI_WAIT_RESP     __bit(3)
+#define DMA_TI_DEST_INC      __bit(4)
+#define DMA_TI_DEST_WIDTH    __bit(5)     // 128 bits
+#define DMA_TI_DEST_DREQ     __bit(6)
+#define DMA_TI_SRC_INC       __bit(8)
+#define DMA_TI_SRC_WIDTH     __bit(9)     // 128 bits
+#define DMA_TI_SRC_DREQ      __bit(10)
+#define DMA_TI_SRC_IGNORE    __bit(11)
+#define DMA_TI_BURST(X)      ((X) << 12)
+#define DMA_TI_PERMAP(X)     ((X) << 16)
+#define DMA_TI_WAITS(X)      ((X) << 21)
+#define DMA_TI_NO_WIDE       __bit(26)
+
+/*
+ * Registrador CS dos canais
+ */
+#define DMA_CS_ACTIVE        __bit(0)
+#define DMA_CS_END           __bit(1)
+#define DMA_CS_INT           __bit(2)
+#define DMA_CS_ERROR         __bit(8)
+#define DMA_CS_PRIORITY(X)   ((X) << 16)
+#define DMA_CS_PANIC(X)      ((X) << 20)
+#define DMA_CS_WAIT_WRITES   __bit(28)
+#define DMA_CS_ABORT         __bit(30)
+#define DMA_CS_RESET         __bit(31)
+
+#define DMA_MAX_CBS          16           // blocos de controle por canal
+
+void dma_init(void);
+int dma_alloc(void);
+void dma_free(int ch);
+dma_cb_t *dma_cbs(int ch);
+void dma_start(int ch, dma_cb_t *cb);
+int dma_busy(int ch);
+int dma_wait(int ch);
+int dma_copy(int ch, void *dst, const void *src, uint32_t len);
+int dma_fill(int ch, void *dst, uint32_t pattern, uint32_t len);
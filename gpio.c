@@ -1,6 +1,93 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include "bcm.h"
+#include "timer.h"
+#include "gpio.h"
+
+/**
+ * Configura um conjunto de GPIOs com uma leitura e uma escrita por
+ * registro gpfsel afetado (cada registro agrupa 10 GPIOs).
+ * @param mask Máscara dos GPIOs (bit n = GPIO n).
+ * @param func Função desejada (INPUT, OUTPUT, ALT0, ... ALT5)
+ */
+void gpio_init_mask(uint64_t mask, int func) {
+   mask &= GPIO_MASK_TODOS;
+   for(int b=0; b<6; b++) {
+      uint32_t limpa = 0, novo = 0;
+      for(int i=0; i<10; i++) {
+         if(!((mask >> (10 * b + i)) & 1)) continue;
+         limpa |= 0x07 << (3 * i);
+         novo |= func << (3 * i);
+      }
+      if(limpa) GPIO_REG(gpfsel[b]) = (GPIO_REG(gpfsel[b]) & ~limpa) | novo;
+   }
+}
+
+/**
+ * Liga um conjunto de GPIOs de saída (uma escrita em gpset por banco).
+ * @param mask Máscara dos GPIOs.
+ */
+void gpio_set_mask(uint64_t mask) {
+   if((uint32_t)mask) GPIO_REG(gpset[0]) = (uint32_t)mask;
+   if(mask >> 32) GPIO_REG(gpset[1]) = (mask >> 32) & (GPIO_MASK_TODOS >> 32);
+}
+
+/**
+ * Desliga um conjunto de GPIOs de saída (uma escrita em gpclr por banco).
+ * @param mask Máscara dos GPIOs.
+ */
+void gpio_clr_mask(uint64_t mask) {
+   if((uint32_t)mask) GPIO_REG(gpclr[0]) = (uint32_t)mask;
+   if(mask >> 32) GPIO_REG(gpclr[1]) = (mask >> 32) & (GPIO_MASK_TODOS >> 32);
+}
+
+/**
+ * Escreve um valor em um conjunto de GPIOs de saída. Os bits desligados são
+ * escritos em gpclr e, logo depois, os ligados em gpset: os pinos de cada
+ * grupo mudam juntos.
+ * @param mask Máscara dos GPIOs.
+ * @param valor Valor dos GPIOs (bit n = GPIO n).
+ */
+void gpio_write_mask(uint64_t mask, uint64_t valor) {
+   gpio_clr_mask(mask & ~valor);
+   gpio_set_mask(mask & valor);
+}
+
+/**
+ * Lê o nível de todos os GPIOs.
+ * @return Níveis (bit n = GPIO n).
+ */
+uint64_t gpio_read_mask(void) {
+   uint64_t alto = GPIO_REG(gplev[1]) & (GPIO_MASK_TODOS >> 32);
+   return (alto << 32) | GPIO_REG(gplev[0]);
+}
+
+/**
+ * Troca o estado de um conjunto de GPIOs de saída, com uma leitura dos
+ * níveis e as escritas de gpio_write_mask.
+ * @param mask Máscara dos GPIOs.
+ */
+void gpio_toggle_mask(uint64_t mask) {
+   gpio_write_mask(mask, ~gpio_read_mask());
+}
+
+/**
+ * Configura os resistores de pull-up ou pull-down de um conjunto de GPIOs
+ * com uma única sequência de gppud e gppudclk.
+ * @param mask Máscara dos GPIOs.
+ * @param pull PULL_NONE, PULL_UP ou PULL_DOWN
+ */
+void gpio_set_pulls_mask(uint64_t mask, int pull) {
+   mask &= GPIO_MASK_TODOS;
+   GPIO_REG(gppud) = pull;
+   delay_us(1);
+   GPIO_REG(gppudclk[0]) = (uint32_t)mask;
+   GPIO_REG(gppudclk[1]) = mask >> 32;
+   delay_us(1);
+   GPIO_REG(gppud) = GPIO_PULL_NONE;
+   GPIO_REG(gppudclk[0]) = 0;
+   GPIO_REG(gppudclk[1]) = 0;
+}
 
 /**
  * Configura um GPIO.
@@ -9,11 +96,7 @@
  */
 void gpio_init(unsigned gpio, int func) {
    if(gpio > 53) return;
-   int a = 3 * (gpio % 10);
-   int b = gpio / 10;
-   int c = GPIO_REG(gpfsel[b]);
-   int mask = 0x07 << a;
-   GPIO_REG(gpfsel[b]) = (c & (~mask)) | (func << a);
+   gpio_init_mask(GPIO_BIT(gpio), func);
 }
 
 /**
@@ -23,13 +106,8 @@ void gpio_init(unsigned gpio, int func) {
  */
 void gpio_put(unsigned gpio, int valor) {
    if(gpio > 53) return;
-   if(valor) {
-      if(gpio < 32) GPIO_REG(gpset[0]) = (1 << gpio);
-      else GPIO_REG(gpset[1]) = (1 << (gpio-32));
-   } else {
-      if(gpio < 32) GPIO_REG(gpclr[0]) = (1 << gpio);
-      else GPIO_REG(gpclr[1]) = (1 << (gpio-32));
-   }
+   if(valor) gpio_set_mask(GPIO_BIT(gpio));
+   else gpio_clr_mask(GPIO_BIT(gpio));
 }
 
 /**
@@ -49,7 +127,7 @@ int gpio_get(unsigned gpio) {
  */
 void gpio_toggle(unsigned gpio) {
    if(gpio > 53) return;
-   gpio_put(gpio, !gpio_get(gpio));
+   gpio_toggle_mask(GPIO_BIT(gpio));
 }
 
 /**
@@ -58,15 +136,6 @@ void gpio_toggle(unsigned gpio) {
  * @param pull PULL_NONE, PULL_UP ou PULL_DOWN
  */
 void gpio_set_pulls(unsigned gpio, int pull) {
-   GPIO_REG(gppud) = pull;
-   delay(150);
-   if(gpio < 32) {
-      GPIO_REG(gppudclk[0]) = (1 << gpio);
-      delay(150);
-      GPIO_REG(gppudclk[0]) = 0;
-   } else {
-      GPIO_REG(gppudclk[1]) = (1 << (gpio-32));
-      delay(150);
-      GPIO_REG(gppudclk[1]) = 0;
-   } 
-}
\ No newline at end of file
+   if(gpio > 53) return;
+   gpio_set_pulls_mask(GPIO_BIT(gpio), pull);
+}
@@ -1,3 +1,6 @@
+#pragma once
+#include <stdint.h>
+
 #define GPIO_FUNC_INPUT       0
 #define GPIO_FUNC_OUTPUT      1
 #define GPIO_FUNC_ALT5        2
@@ -11,6 +14,9 @@
 #define GPIO_PULL_DOWN        1
 #define GPIO_PULL_UP          2
 
+#define GPIO_BIT(n)           (1ull << (n))
+#define GPIO_MASK_TODOS       (GPIO_BIT(54) - 1)
+
 #define ARM_MODE_USER         0b10000
 #define ARM_MODE_FIQ          0b10001
 #define ARM_MODE_IRQ          0b10010
@@ -28,7 +34,7 @@
  * -- retorno -
  * Configura um GPIO antes do uso.
  ***/
-void gpio_init(unsigned, unsigned);
+void gpio_init(unsigned, int);
 
 /*** 
  * gpio_put 
@@ -37,7 +43,7 @@ void gpio_init(unsigned, unsigned);
  * -- retorno -
  * Altera o valor de um GPIO configurado como saída
  ***/
-void gpio_put(unsigned, unsigned);
+void gpio_put(unsigned, int);
 
 /***
  * gpio_get 
@@ -45,7 +51,7 @@ void gpio_put(unsigned, unsigned);
  * -- retorno r0 (valor atual do GPIO)
  * Lê o estado atual de um GPIO
  ***/
-unsigned gpio_get(unsigned);
+int gpio_get(unsigned);
 
 /***
  * gpio_toggle 
@@ -62,4 +68,56 @@ void gpio_toggle(unsigned);
  * -- retorno -
  * Configura os resistores internos conectados a um GPIO.
  ***/
-void gpio_set_pulls(unsigned, unsigned);
\ No newline at end of file
+void gpio_set_pulls(unsigned, int);
+
+/***
+ * gpio_init_mask
+ * -- parâmtros: máscara dos GPIOs (bit n = GPIO n)
+ * --            função desejada GPIO_FUNC_...
+ * -- retorno -
+ * Configura um conjunto de GPIOs, com uma escrita por registro gpfsel.
+ ***/
+void gpio_init_mask(uint64_t, int);
+
+/***
+ * gpio_set_mask, gpio_clr_mask
+ * -- parâmtros: máscara dos GPIOs
+ * -- retorno -
+ * Liga ou desliga um conjunto de GPIOs de saída (uma escrita por banco).
+ ***/
+void gpio_set_mask(uint64_t);
+void gpio_clr_mask(uint64_t);
+
+/***
+ * gpio_write_mask
+ * -- parâmtros: máscara dos GPIOs
+ * --            valor (bit n = GPIO n)
+ * -- retorno -
+ * Escreve um valor nos GPIOs da máscara (gpclr e depois gpset).
+ ***/
+void gpio_write_mask(uint64_t, uint64_t);
+
+/***
+ * gpio_toggle_mask
+ * -- parâmtros: máscara dos GPIOs
+ * -- retorno -
+ * Alterna o estado de um conjunto de GPIOs de saída.
+ ***/
+void gpio_toggle_mask(uint64_t);
+
+/***
+ * gpio_read_mask
+ * -- parâmtros -
+ * -- retorno níveis de todos os GPIOs (bit n = GPIO n)
+ * Lê os dois bancos de GPIOs.
+ ***/
+uint64_t gpio_read_mask(void);
+
+/***
+ * gpio_set_pulls_mask
+ * -- parâmtros: máscara dos GPIOs
+ * --            configuração de pull-up (GPIO_PULL_...)
+ * -- retorno -
+ * Configura os resistores internos de um conjunto de GPIOs.
+ ***/
+void gpio_set_pulls_mask(uint64_t, int);
@@ -0,0 +1,96 @@
+#include "hex.h"
+
+/*
+ * Tabelas de conversão:
+ *   digitos   valor de 4 bits -> caractere
+ *   pares     byte -> dois caracteres (na ordem da memória)
+ *   valores   caractere -> valor de 4 bits, ou 0xff se não for hexadecimal
+ */
+static const char digitos[16] = "0123456789abcdef";
+static uint16_t pares[256];
+static uint8_t valores[256];
+
+/**
+ * Gera as tabelas de conversão.
+ */
+void hex_init(void) {
+   for(int i=0; i<256; i++) {
+      char par[2] = { digitos[i >> 4], digitos[i & 0x0f] };
+      pares[i] = *(uint16_t*)par;
+      valores[i] = 0xff;
+   }
+   for(int i=0; i<16; i++) valores[(uint8_t)digitos[i]] = i;
+   for(int i=10; i<16; i++) valores['A' + i - 10] = i;
+}
+
+/**
+ * Caractere hexadecimal de um valor de 4 bits.
+ */
+char hex_to_char(uint8_t n) {
+   if(n < 16) return digitos[n];
+   return '0';
+}
+
+/**
+ * Valor de um caractere hexadecimal (0 se inválido).
+ */
+int char_to_hex(char c) {
+   uint8_t v = valores[(uint8_t)c];
+   return (v == 0xff) ? 0 : v;
+}
+
+/**
+ * Valor de um caractere hexadecimal.
+ * @return Valor de 0 a 15, ou -1 se o caractere não for hexadecimal.
+ */
+int hex_value(char c) {
+   uint8_t v = valores[(uint8_t)c];
+   return (v == 0xff) ? -1 : v;
+}
+
+/**
+ * Converte um bloco de bytes em caracteres hexadecimais (dois por byte,
+ * sem terminador).
+ * @param dst Destino (2 * n caracteres).
+ * @param src Bytes a converter.
+ * @param n Quantidade de bytes.
+ */
+void hex_encode(char *dst, const uint8_t *src, uint32_t n) {
+   if(((uint32_t)dst & 1) == 0) {
+      uint16_t *d = (uint16_t*)dst;
+      while(n >= 4) {
+         d[0] = pares[src[0]];
+         d[1] = pares[src[1]];
+         d[2] = pares[src[2]];
+         d[3] = pares[src[3]];
+         d += 4;
+         src += 4;
+         n -= 4;
+      }
+      while(n--) *d++ = pares[*src++];
+      return;
+   }
+   while(n--) {
+      *dst++ = digitos[*src >> 4];
+      *dst++ = digitos[*src++ & 0x0f];
+   }
+}
+
+/**
+ * Converte caracteres hexadecimais (dois por byte) em bytes.
+ * @param dst Destino.
+ * @param src Caracteres hexadecimais.
+ * @param n Quantidade máxima de bytes.
+ * @return Quantidade de bytes convertidos (para no primeiro caractere inválido).
+ */
+uint32_t hex_decode(uint8_t *dst, const char *src, uint32_t n) {
+   uint32_t i;
+   for(i=0; i<n; i++) {
+      uint8_t a = valores[(uint8_t)src[0]];
+      uint8_t b = valores[(uint8_t)src[1]];
+      if((a | b) & 0xf0) break;
+      *dst++ = (a << 4) | b;
+      src += 2;
+   }
+   return i;
+}
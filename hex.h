@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+
+void hex_init(void);
+char hex_to_char(uint8_t n);
+int char_to_hex(char c);
+int hex_value(char c);
+void hex_encode(char *dst, const uint8_t *src, uint32_t n);
+uint32_t hex_decode(uint8_t *dst, const char *src, uint32_t n);
@@ -0,0 +1,528 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "../cmd.h"
+#include "../hex.h"
+#include "../search.h"
+#include "../checksum.h"
+#include "../lz.h"
+#include "conexao.h"
+
+/*
+ * Benchmarks do build nativo: vazão dos caminhos críticos do PiCLIs
+ * (conversão hexadecimal, busca, checksums, despacho de comandos),
+ * compilados com as mesmas opções de otimização do firmware.
+ *
+ *   piclis-bench [-o resultado] [-b referência] [-c piclis-host | -t endereço:porta]
+ *
+ * -o grava os resultados; -b compara com um arquivo gravado antes e
+ * termina com erro se algum resultado piorar mais que TOLERANCIA;
+ * -c executa também o roteiro de comandos (verificações, vazão e latência
+ * de ida e volta) pelo executável nativo completo (uart por pipe);
+ * -t executa apenas o roteiro, pela uart ligada a um socket TCP (o
+ * firmware sob o QEMU, ver host/qemu-bench.sh).
+ */
+#define AREA_SIZE            (16 << 20)
+#define TOLERANCIA           10           // %
+#define MAX_RESULTADOS       32
+#define RESPOSTA_SIZE        (1 << 18)
+
+/*
+ * O roteiro de comandos grava um laço em 0x300000 e usa os dados em
+ * 0x400000, fora do PiCLIs tanto na placa quanto no build nativo.
+ */
+#define ROTEIRO_PROGRAMA     0x300000
+
+static uint8_t area[AREA_SIZE];           // em endereços de 32 bits (ligado sem PIE)
+static char texto[2 * AREA_SIZE];
+
+typedef struct {
+   const char *nome;
+   double valor;
+   const char *unidade;
+   int maior_melhor;
+} resultado_t;
+
+static resultado_t resultados[MAX_RESULTADOS];
+static int num_resultados;
+static int falhas;
+
+static double agora(void) {
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void registra(const char *nome, double valor, const char *unidade, int maior_melhor) {
+   resultado_t *r = &resultados[num_resultados++];
+   r->nome = nome;
+   r->valor = valor;
+   r->unidade = unidade;
+   r->maior_melhor = maior_melhor;
+   printf("%-20s %12.2f %s\n", nome, valor, unidade);
+   fflush(stdout);
+}
+
+/*
+ * Repete uma operação sobre n bytes por pelo menos 0,5 s e registra MB/s.
+ */
+#define VAZAO(NOME, N, OP)                                              \
+   do {                                                                 \
+      double t0 = agora(), t;                                           \
+      uint64_t total = 0;                                               \
+      do {                                                              \
+         OP;                                                            \
+         total += (N);                                                  \
+      } while((t = agora() - t0) < 0.5);                                \
+      registra(NOME, total / t / 1e6, "MB/s", 1);                       \
+   } while(0)
+
+static volatile uint32_t sumidouro;
+
+static void conta(uint32_t addr, void *ctx) {
+   (void)addr;
+   (*(uint32_t*)ctx)++;
+}
+
+static void bench_hex(void) {
+   const uint32_t n = 1 << 20;
+   VAZAO("hex_encode", n, hex_encode(texto, area, n));
+   VAZAO("hex_decode", n, sumidouro = hex_decode(area, texto, n));
+}
+
+static void bench_busca(void) {
+   static const uint8_t padrao[] = { 0xde, 0xad, 0xbe, 0xef, 0x01, 0x23, 0x45, 0x67 };
+   static const uint8_t mascara[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x0f, 0xff };
+   search_t s;
+   uint32_t achados = 0;
+   memcpy(area + AREA_SIZE - 64, padrao, sizeof(padrao));
+   search_compile(&s, padrao, 0, sizeof(padrao), 1);
+   VAZAO("search", AREA_SIZE, search_run(&s, (uint32_t)(uintptr_t)area, AREA_SIZE, conta, &achados));
+   search_compile(&s, padrao, mascara, sizeof(padrao), 1);
+   VAZAO("search_mask", AREA_SIZE, search_run(&s, (uint32_t)(uintptr_t)area, AREA_SIZE, conta, &achados));
+   sumidouro = achados;
+}
+
+static void bench_checksum(void) {
+   VAZAO("crc32", AREA_SIZE, sumidouro = crc32(0, area, AREA_SIZE));
+   VAZAO("adler32", AREA_SIZE, sumidouro = adler32(1, area, AREA_SIZE));
+   VAZAO("xxh32", AREA_SIZE, sumidouro = xxh32(area, AREA_SIZE, 0));
+}
+
+/*
+ * Compressão do $pMZ sobre uma área que imita um dump de memória: blocos
+ * de zeros, de uma palavra repetida, de uma tabela crescente e aleatórios.
+ */
+static void bench_lz(void) {
+   static uint8_t dump[1 << 20], saida[1024 + 1];
+   static uint8_t volta[1024];
+   uint32_t *w = (uint32_t*)dump;
+   uint64_t comprimido = 0;
+   for(uint32_t b=0; b<sizeof(dump)/1024; b++) {
+      for(uint32_t i=0; i<256; i++) {
+         uint32_t v = 0;
+         if((b & 3) == 1) v = 0xe59f0000 | b;
+         else if((b & 3) == 2) v = 0x8000 + 4 * i;
+         else if((b & 3) == 3) v = area[b * 1024 + i];
+         w[b * 256 + i] = v;
+      }
+   }
+   VAZAO("lz_encode", sizeof(dump),
+         for(uint32_t b=0; b<sizeof(dump); b+=1024) sumidouro = lz_encode(saida, 1024, dump + b, 1024));
+   for(uint32_t b=0; b<sizeof(dump); b+=1024) {
+      uint32_t k = lz_encode(saida, 1024, dump + b, 1024);
+      if(k == 0) k = 1024;
+      else if((lz_decode(volta, 1024, saida, k) != 1024) || memcmp(volta, dump + b, 1024)) {
+         printf("%-20s FALHOU: bloco %u\n", "lz_decode", b / 1024);
+         falhas++;
+      }
+      comprimido += k + 1;
+   }
+   registra("lz_razao", 100.0 * comprimido / sizeof(dump), "%", 0);
+}
+
+/*
+ * Despacho: tabela com os nomes e argumentos da tabela de piclis.c e
+ * tratadores vazios, medindo a identificação e a conversão dos argumentos.
+ */
+static int nada(cmd_args_t *args) {
+   (void)args;
+   return CMD_PRONTO;
+}
+
+static const cmd_t comandos[] = {
+   { "?", nada, "" },              { "g", nada, "" },              { "G", nada, "s" },
+   { "P", nada, "xx" },            { "m", nada, "xx" },            { "M", nada, "xx" },
+   { "x", nada, "xx" },            { "X", nada, "xx" },            { "$pMZ", nada, "xx" },
+   { "c", nada, "[x" },            { "s", nada, "[x" },            { "$pSTEP", nada, "d" },
+   { "Z0", nada, "x[x" },          { "z0", nada, "x[x" },          { "Z1", nada, "x[x" },
+   { "z1", nada, "x[x" },          { "Z2", nada, "xx" },           { "z2", nada, "xx" },
+   { "Z3", nada, "xx" },           { "z3", nada, "xx" },           { "Z4", nada, "xx" },
+   { "z4", nada, "xx" },           { "D", nada, "" },              { "k", nada, "" },
+   { "$pBIN", nada, "d" },         { "$pCHK", nada, "xx[w" },      { "$pSCH", nada, "wxx[wx" },
+   { "$pPSCH", nada, "wxx[wx" },   { "$pPCHK", nada, "xx[w" },     { "$pMT", nada, "xx" },
+   { "$pJOB", nada, "[w" },        { "$pECHO", nada, "s" },        { "$pMORSE", nada, "s" },
+   { "$pWPM", nada, "d" },         { "$pGPIO", nada, "[www" },     { "$pCAP", nada, "[www" },
+   { "$pWAVE", nada, "[ws" },      { "$pDMA", nada, "xxx" },       { "$pFILL", nada, "xxw[w" },
+   { "$pCOPY", nada, "xxx[w" },    { "$pCMP", nada, "xxx" },       { "$pBKLIST", nada, "" },
+   { "$pBKIGN", nada, "xd" },      { "$pBKEN", nada, "xd" },       { "$pBKCOND", nada, "x[w" },
+   { "$pTRACE", nada, "[w" },      { "$pBAUD", nada, "[d" },       { "$pFIFO", nada, "dd" },
+};
+
+static const char *linhas[] = {
+   "m8000,40", "$M8000,4:deadbeef", "Z0,8040,4", "$pCHK 100000 10000 crc32",
+   "$pSCH deadbeef 100000 100000", "$pBIN -12345", "$pBKIGN 8040 10", "c",
+};
+#define NUM_LINHAS           (sizeof(linhas) / sizeof(linhas[0]))
+
+static void bench_despacho(void) {
+   char linha[CMD_LINHA];
+   uint32_t n = 0;
+   cmd_init(comandos, sizeof(comandos) / sizeof(comandos[0]));
+   double t0 = agora(), t;
+   do {
+      for(int k=0; k<1000; k++, n++) {
+         strcpy(linha, linhas[n % NUM_LINHAS]);
+         sumidouro = cmd_exec(linha);
+      }
+   } while((t = agora() - t0) < 0.5);
+   registra("cmd_exec", n / t / 1e6, "Mcmd/s", 1);
+}
+
+/*
+ * Roteiro de comandos: envia cada linha e espera o prompt seguinte,
+ * guardando a resposta para as verificações.
+ */
+static conexao_t cli;
+static char resposta[RESPOSTA_SIZE];
+static uint32_t resposta_n;
+
+static void espera_prompt(void) {
+   char buf[4096];
+   char ant = 0;
+   resposta_n = 0;
+   for(;;) {
+      ssize_t n = read(cli.rx, buf, sizeof(buf));
+      if(n <= 0) {
+         fprintf(stderr, "bench: o PiCLIs encerrou\n");
+         exit(1);
+      }
+      uint32_t k = (resposta_n + n < RESPOSTA_SIZE) ? n : RESPOSTA_SIZE - 1 - resposta_n;
+      memcpy(resposta + resposta_n, buf, k);
+      resposta_n += k;
+      if((n == 1) && (ant == '>') && (buf[0] == ' ')) break;
+      if((n >= 2) && (buf[n-2] == '>') && (buf[n-1] == ' ')) break;
+      ant = buf[n-1];
+   }
+   resposta[resposta_n] = 0;
+}
+
+static void envia(const char *linha) {
+   if(write(cli.tx, linha, strlen(linha)) < 0) exit(1);
+   espera_prompt();
+}
+
+/**
+ * Descarta o que chegou antes (mensagem inicial, prompts) até o PiCLIs
+ * devolver uma marca.
+ */
+static void sincroniza(void) {
+   static const char marca[] = "sincroniza-bench";
+   if(write(cli.tx, "$pECHO sincroniza-bench\r", 24) < 0) exit(1);
+   do espera_prompt(); while(strstr(resposta, marca) == 0);
+}
+
+/**
+ * Envia um comando e verifica se a resposta contém o texto esperado.
+ */
+static void confere(const char *nome, const char *linha, const char *esperado) {
+   envia(linha);
+   if(strstr(resposta, esperado)) return;
+   printf("%-20s FALHOU: esperado \"%s\"\n", nome, esperado);
+   falhas++;
+}
+
+/**
+ * Lê o pc do programa do usuário com o comando g.
+ */
+static uint32_t le_pc(void) {
+   char hex[16 * 8 + 1];
+   uint32_t n = 0, pc = 0;
+   envia("g\r");
+   for(uint32_t i=0; (i<resposta_n) && (n<sizeof(hex)-1); i++) {
+      char c = resposta[i];
+      if(((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'f'))) hex[n++] = c;
+   }
+   hex[n] = 0;
+   if(n < sizeof(hex) - 1) return 0;
+   for(int i=3; i>=0; i--) {                 // bytes na ordem da memória
+      unsigned b;
+      sscanf(hex + 15 * 8 + 2 * i, "%2x", &b);
+      pc = (pc << 8) | b;
+   }
+   return pc;
+}
+
+static void confere_pc(const char *nome, uint32_t esperado) {
+   uint32_t pc = le_pc();
+   if(pc == esperado) return;
+   printf("%-20s FALHOU: pc %08x, esperado %08x\n", nome, pc, esperado);
+   falhas++;
+}
+
+static void latencia(const char *nome, const char *linha, int n) {
+   double t0 = agora();
+   for(int i=0; i<n; i++) envia(linha);
+   registra(nome, (agora() - t0) / n * 1e6, "us", 0);
+}
+
+/**
+ * Vazão de um comando que transfere bytes (em MB/s de dados, não de texto).
+ */
+static void vazao_cli(const char *nome, const char *linha, uint32_t bytes, int n) {
+   double t0 = agora();
+   for(int i=0; i<n; i++) envia(linha);
+   registra(nome, (double)bytes * n / (agora() - t0) / 1e6, "MB/s", 1);
+}
+
+/**
+ * Monta o comando $pLOAD seguido de uma imagem de 4 KB em 0x500000 em
+ * Intel HEX (registros de 16 bytes), sem quebra de linha após o registro
+ * de fim.
+ * @return crc32 da imagem.
+ */
+static uint32_t monta_load(char *linha, uint8_t *img) {
+   int k = sprintf(linha, "$pLOAD\r:020000040050AA\r\n");
+   for(int i=0; i<4096; i++) img[i] = (i * 11 + 5) & 0xff;
+   for(int a=0; a<4096; a+=16) {
+      uint8_t soma = 16 + (a >> 8) + a;
+      k += sprintf(linha + k, ":10%04X00", a);
+      for(int i=0; i<16; i++) {
+         k += sprintf(linha + k, "%02X", img[a + i]);
+         soma += img[a + i];
+      }
+      k += sprintf(linha + k, "%02X\r\n", (uint8_t)-soma);
+   }
+   strcpy(linha + k, ":00000001FF");
+   return crc32(0, img, 4096);
+}
+
+static void roteiro(int rapido) {
+   static char linha_M[64 + 2 * 4096], linha_load[64 + 45 * 256 + 16];
+   static uint8_t img[4096];
+   char esperado[32];
+   int n = rapido ? 10 : 1;                   // repetições: o build nativo é mais rápido
+
+   sincroniza();
+
+   /*
+    * Memória e busca
+    */
+   int k = sprintf(linha_M, "M 400000 1000\r");
+   for(int i=0; i<4096; i++) k += sprintf(linha_M + k, "%02x", (i * 37) & 0xff);
+   envia(linha_M);
+   confere("m", "m 400000 4\r", "00254a6f");
+   envia("M 400ff0 4\rdeadbeef");
+   confere("$pSCH", "$pSCH deadbeef 400000 10000\r", "00400ff0");
+   confere("$pCHK", "$pCHK 400000 1000\r", "crc32");
+
+   latencia("cli_bin", "$pBIN 12345\r", 200 * n);
+   latencia("cli_m_256", "m 400000 100\r", 200 * n);
+   latencia("cli_M_256", "M 400000 100\r"
+            "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff"
+            "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff"
+            "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff"
+            "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff"
+            "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff"
+            "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff"
+            "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff"
+            "00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff", 200 * n);
+   vazao_cli("cli_m_4k", "m 400000 1000\r", 4096, 20 * n);
+   vazao_cli("cli_M_4k", linha_M, 4096, 20 * n);
+   confere("$pFILL", "$pFILL 500001 fffff a55a\r", "FILL");
+   confere("$pCOPY", "$pCOPY 600001 500001 fffff\r", "COPY");
+   confere("$pCMP", "$pCMP 500001 600001 fffff\r", "iguais");
+   envia("$pFILL 6ffff0 1 00\r");
+   confere("$pCMP", "$pCMP 500001 600001 fffff\r", "1 bytes diferentes, o primeiro em 005ffff0");
+   confere("$pCOPY", "$pCOPY 600001 500001 fffff dma\r", "COPY");   // desalinhada
+   confere("$pCMP", "$pCMP 500001 600001 fffff\r", "iguais");
+   confere("$pDMA", "$pDMA 500011 500001 100\r", "$E01");   // destino sobre a origem
+   confere("$pCOPY", "$pCOPY 500011 500001 100 dma\r", "$E01");
+   latencia("cli_chk_1M", "$pCHK 400000 100000\r", 2 * n);
+   latencia("cli_sch_1M", "$pSCH deadbeef 400000 100000\r", 2 * n);
+   latencia("cli_fill_1M", "$pFILL 500000 100000 00\r", 2 * n);
+   latencia("cli_copy_1M", "$pCOPY 600000 500000 100000\r", 2 * n);
+   latencia("cli_cmp_1M", "$pCMP 600000 500000 100000\r", 2 * n);
+
+   /*
+    * GPIOs em grupo, captura de bordas e formas de onda (o simulador aplica
+    * gpset e gpclr periodicamente)
+    */
+   confere("$pGPIO", "$pGPIO fn 3c00000 out\r", "OK");
+   envia("$pGPIO put 3c00000 1400000\r");
+   usleep(1000);
+   confere("$pGPIO", "$pGPIO\r", "01400000");
+   envia("$pGPIO tog 3c00000\r");
+   usleep(1000);
+   confere("$pGPIO", "$pGPIO\r", "02800000");
+   envia("$pGPIO clr 3c00000\r");
+   usleep(1000);
+   confere("$pCAP", "$pCAP start 3c00000\r", "OK");
+   envia("$pGPIO put 3c00000 1400000\r");   // 22 e 24 sobem
+   usleep(1000);
+   envia("$pGPIO tog 3c00000\r");           // 22 e 24 descem, 23 e 25 sobem
+   usleep(1000);
+   envia("$pCAP stop\r");
+   confere("$pCAP", "$pCAP\r", "CAP: 00000000, 2 eventos, 0 perdidos");
+   confere("$pCAP", "$pCAP start c000\r", "$E01");
+   envia("$pGPIO clr 3c00000\r");
+   confere("$pWAVE", "$pWAVE play +400000/300 -400000/300 +400000/300\r", "OK");
+   usleep(5000);
+   confere("$pWAVE", "$pWAVE\r", "WAVE: parada");
+   confere("$pWAVE", "$pGPIO\r", "00400000");
+   confere("$pWAVE", "$pWAVE loop +800000/100 -800000/100\r", "OK");
+   confere("$pWAVE", "$pWAVE\r", "WAVE: ativa, periodo 200 us");
+   confere("$pWAVE", "$pWAVE stop\r", "OK");
+   confere("$pWAVE", "$pWAVE loop +800000/0\r", "$E01");
+   confere("$pGPIO", "$pGPIO fn c000 in\r", "$E01");
+   latencia("cli_gpio_tog", "$pGPIO tog 3c00000\r", 200 * n);
+
+   /*
+    * Carga de programas
+    */
+   sprintf(esperado, "crc32 = %08x", monta_load(linha_load, img));
+   confere("$pLOAD", linha_load, esperado);
+   vazao_cli("cli_load_4k", linha_load, 4096, 20 * n);
+   k = sprintf(linha_M, "$pLOADB 500000 1000\r");
+   memcpy(linha_M + k, img, 4096);                 // binário: enviado com o tamanho
+   if(write(cli.tx, linha_M, k + 4096) < 0) exit(1);
+   espera_prompt();
+   if(strstr(resposta, esperado) == 0) {
+      printf("%-20s FALHOU: esperado \"%s\"\n", "$pLOADB", esperado);
+      falhas++;
+   }
+
+   /*
+    * Breakpoints e passos sobre um laço (add r0, r0, #1; b .-4)
+    */
+   envia("M 300000 8\r010080e2fdffffea");
+   envia("P 29 10000000\r");                 // cpsr: modo usuário, ARM
+   envia("P f 00003000\r");
+   confere("Z0", "Z0 300004 4\r", "$OK");
+   envia("c\r");
+   confere_pc("c", ROTEIRO_PROGRAMA + 4);
+   envia("s\r");
+   confere_pc("s", ROTEIRO_PROGRAMA);
+   latencia("cli_c_bkpt", "c\r", 100 * n);   // uma volta do laço por parada
+   latencia("cli_s", "s\r", 100 * n);
+   confere("z0", "z0 300004 4\r", "$OK");
+   uint32_t pc = le_pc();
+   latencia("cli_step_100", "$pSTEP 100\r", 5 * n);
+   confere_pc("$pSTEP", pc);                 // número par de passos no laço
+   envia("$pSTEP 5000\r");                  // sem acumular quadros na pilha do stub
+   confere_pc("$pSTEP", pc);
+
+   /*
+    * Paradas resolvidas pelo próprio PiCLIs no desvio do laço: paradas
+    * ignoradas e tracepoint (registra r0 e só para na 20ª parada)
+    */
+   confere("Z0", "Z0 300004 4\r", "$OK");
+   confere("$pBKIGN", "$pBKIGN 300004 5\r", "$OK");
+   envia("c\r");
+   confere_pc("$pBKIGN", ROTEIRO_PROGRAMA + 4);
+   confere("$pBKIGN", "$pBKLIST\r", "00300004 sw ativo 6 0");
+   envia("z0 300004 4\r");
+   confere("Z0", "Z0 300004 4\r", "$OK");
+   confere("$pBKCOND", "$pBKCOND 300004 1b001e03141300\r", "$OK");
+   envia("$pTRACE c\r");
+   envia("c\r");
+   confere_pc("$pBKCOND", ROTEIRO_PROGRAMA + 4);
+   confere("$pTRACE", "$pTRACE\r", "20 registros, 0 perdidos");
+   confere("$pBKCOND", "$pBKCOND 300004 1e04d00700001300\r", "$OK");
+   envia("c\r");                            // 1980 paradas sem o depurador
+   confere("$pBKCOND", "$pBKLIST\r", "00300004 sw ativo 2000 0 cond");
+   confere("z0", "z0 300004 4\r", "$OK");
+}
+
+static void grava(const char *arq) {
+   FILE *f = fopen(arq, "w");
+   if(f == 0) {
+      perror(arq);
+      exit(1);
+   }
+   for(int i=0; i<num_resultados; i++) {
+      fprintf(f, "%s %.2f %s\n", resultados[i].nome, resultados[i].valor, resultados[i].unidade);
+   }
+   fclose(f);
+}
+
+/**
+ * Compara com uma execução anterior.
+ * @return Número de resultados que pioraram além da tolerância.
+ */
+static int compara(const char *arq) {
+   char nome[64], unidade[16];
+   double ref;
+   int piores = 0;
+   FILE *f = fopen(arq, "r");
+   if(f == 0) {
+      perror(arq);
+      exit(1);
+   }
+   while(fscanf(f, "%63s %lf %15s", nome, &ref, unidade) == 3) {
+      for(int i=0; i<num_resultados; i++) {
+         resultado_t *r = &resultados[i];
+         if(strcmp(r->nome, nome) || (ref <= 0)) continue;
+         double var = (r->valor - ref) / ref * 100;
+         int pior = r->maior_melhor ? (var < -TOLERANCIA) : (var > TOLERANCIA);
+         printf("%-20s %+7.1f%%%s\n", nome, var, pior ? "  <-- regressão" : "");
+         piores += pior;
+      }
+   }
+   fclose(f);
+   return piores;
+}
+
+int main(int argc, char **argv) {
+   const char *saida = 0, *referencia = 0, *exe = 0, *tcp = 0;
+   int op;
+   while((op = getopt(argc, argv, "o:b:c:t:")) != -1) {
+      switch(op) {
+         case 'o': saida = optarg; break;
+         case 'b': referencia = optarg; break;
+         case 'c': exe = optarg; break;
+         case 't': tcp = optarg; break;
+         default:
+            fprintf(stderr, "uso: %s [-o resultado] [-b referência] [-c piclis-host | -t endereço:porta]\n", argv[0]);
+            return 1;
+      }
+   }
+
+   for(uint32_t i=0; i<AREA_SIZE; i++) area[i] = i * 2654435761u >> 24;
+   hex_init();
+   checksum_init();
+
+   if(tcp) {
+      conecta_tcp(&cli, tcp);
+      roteiro(0);
+      desconecta(&cli);
+   } else {
+      bench_hex();
+      bench_busca();
+      bench_checksum();
+      bench_lz();
+      bench_despacho();
+      if(exe) {
+         conecta_exe(&cli, exe);
+         roteiro(1);
+         desconecta(&cli);
+      }
+   }
+
+   if(saida) grava(saida);
+   if(referencia && compara(referencia)) return 2;
+   return falhas ? 3 : 0;
+}
@@ -0,0 +1,118 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "conexao.h"
+
+#define ESPERA_CONEXAO       100          // tentativas de conexão, a cada 0,1 s
+
+/**
+ * Executa o build nativo com a uart em pipes.
+ */
+void conecta_exe(conexao_t *c, const char *exe) {
+   int para[2], de[2];
+   pid_t pid;
+   if(pipe(para) || pipe(de)) exit(1);
+   if((pid = fork()) == 0) {
+      dup2(para[0], 0);
+      dup2(de[1], 1);
+      close(para[1]);
+      close(de[0]);
+      execl(exe, exe, "-g", "/dev/null", (char*)0);
+      perror(exe);
+      exit(1);
+   }
+   close(para[0]);
+   close(de[1]);
+   c->tx = para[1];
+   c->rx = de[0];
+   c->pid = pid;
+}
+
+/**
+ * Conecta à uart ligada a um socket TCP (endereço:porta), esperando o
+ * servidor (o QEMU) aceitar a conexão.
+ */
+void conecta_tcp(conexao_t *c, const char *destino) {
+   char ip[64];
+   unsigned porta;
+   struct sockaddr_in a = { 0 };
+   int s = -1, um = 1;
+   if((sscanf(destino, "%63[^:]:%u", ip, &porta) != 2) || (inet_pton(AF_INET, ip, &a.sin_addr) != 1)) {
+      fprintf(stderr, "destino inválido: %s\n", destino);
+      exit(1);
+   }
+   a.sin_family = AF_INET;
+   a.sin_port = htons(porta);
+   for(int i=0; i<ESPERA_CONEXAO; i++) {
+      s = socket(AF_INET, SOCK_STREAM, 0);
+      if(connect(s, (struct sockaddr*)&a, sizeof(a)) == 0) break;
+      close(s);
+      s = -1;
+      usleep(100000);
+   }
+   if(s < 0) {
+      perror(destino);
+      exit(1);
+   }
+   setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &um, sizeof(um));
+   c->tx = c->rx = s;
+   c->pid = 0;
+}
+
+static speed_t velocidade(unsigned baud) {
+   switch(baud) {
+      case 9600: return B9600;
+      case 19200: return B19200;
+      case 38400: return B38400;
+      case 57600: return B57600;
+      case 115200: return B115200;
+      case 230400: return B230400;
+      case 460800: return B460800;
+      case 921600: return B921600;
+      case 1000000: return B1000000;
+      case 1500000: return B1500000;
+      case 2000000: return B2000000;
+      case 3000000: return B3000000;
+   }
+   fprintf(stderr, "velocidade não suportada: %u\n", baud);
+   exit(1);
+}
+
+/**
+ * Abre a porta serial ligada à placa, em modo raw.
+ */
+void conecta_serial(conexao_t *c, const char *disp, unsigned baud) {
+   struct termios t;
+   int fd = open(disp, O_RDWR | O_NOCTTY);
+   if(fd < 0) {
+      perror(disp);
+      exit(1);
+   }
+   if(tcgetattr(fd, &t) == 0) {
+      cfmakeraw(&t);
+      cfsetspeed(&t, velocidade(baud));
+      t.c_cflag |= CLOCAL | CREAD;
+      tcsetattr(fd, TCSANOW, &t);
+   }
+   c->tx = c->rx = fd;
+   c->pid = 0;
+}
+
+void desconecta(conexao_t *c) {
+   close(c->tx);
+   if(c->rx != c->tx) close(c->rx);
+   if(c->pid) {
+      kill(c->pid, SIGTERM);
+      waitpid(c->pid, 0, 0);
+   }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+/*
+ * Conexão com a uart do PiCLIs a partir das ferramentas do computador
+ * (host/conexao.c).
+ */
+typedef struct {
+   int tx, rx;
+   int pid;                               // executável nativo (0 se não houver)
+} conexao_t;
+
+void conecta_exe(conexao_t *c, const char *exe);
+void conecta_tcp(conexao_t *c, const char *destino);
+void conecta_serial(conexao_t *c, const char *disp, unsigned baud);
+void desconecta(conexao_t *c);
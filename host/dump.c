@@ -0,0 +1,284 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include "../lz.h"
+#include "../xfer.h"
+#include "../capture.h"
+#include "conexao.h"
+
+/*
+ * Decodificador de referência do comando $pMZ: lê uma área de memória
+ * com os blocos comprimidos e grava os dados em um arquivo. Com -e, retira
+ * os eventos da captura de bordas ($pCAP read) e os grava em texto.
+ *
+ *   piclis-dump [-c piclis-host | -t endereço:porta | -d porta serial [-b baud]]
+ *               endereço tamanho arquivo | -e arquivo
+ *
+ * Protocolo: os quadros do comando x (ver xfer.h), confirmados com '+' ou
+ * rejeitados com '-' e o número do quadro esperado. O primeiro byte do
+ * conteúdo de cada quadro é XFER_BRUTO ou XFER_LZ (bloco no formato de lz.h).
+ */
+#define TIMEOUT_MS           5000
+#define ESCAPE               '}'
+#define LOTE_MAX             (8 + 1024 * sizeof(capture_evento_t))
+
+static conexao_t uart;
+static uint8_t rx_buf[4096];
+static uint32_t rx_ini, rx_fim;
+static uint64_t recebidos;                // bytes lidos da uart nos quadros
+
+static int le_byte(void) {
+   if(rx_ini == rx_fim) {
+      struct pollfd p = { uart.rx, POLLIN, 0 };
+      if(poll(&p, 1, TIMEOUT_MS) <= 0) {
+         fprintf(stderr, "dump: sem resposta\n");
+         exit(1);
+      }
+      ssize_t n = read(uart.rx, rx_buf, sizeof(rx_buf));
+      if(n <= 0) {
+         fprintf(stderr, "dump: conexão encerrada\n");
+         exit(1);
+      }
+      rx_ini = 0;
+      rx_fim = n;
+   }
+   return rx_buf[rx_ini++];
+}
+
+static void envia(const char *s) {
+   if(write(uart.tx, s, strlen(s)) < 0) exit(1);
+}
+
+/**
+ * Lê até o prompt, guardando o texto recebido.
+ */
+static void espera_prompt(char *texto, uint32_t max) {
+   uint32_t n = 0;
+   char ant = 0, c;
+   while(!(((c = le_byte()) == ' ') && (ant == '>'))) {
+      if(n + 1 < max) texto[n++] = c;
+      ant = c;
+   }
+   texto[n] = 0;
+}
+
+static const uint16_t crc_tab[16] = {
+   0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+   0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+};
+
+static uint16_t crc16(uint16_t crc, const uint8_t *b, uint32_t n) {
+   while(n--) {
+      crc = (crc << 4) ^ crc_tab[(crc >> 12) ^ (*b >> 4)];
+      crc = (crc << 4) ^ crc_tab[(crc >> 12) ^ (*b & 0x0f)];
+      b++;
+   }
+   return crc;
+}
+
+/**
+ * Lê um quadro.
+ * @return Tamanho do conteúdo, -1 em erro de formato ou CRC, -2 se for a
+ *         resposta de erro do PiCLIs.
+ */
+static int32_t le_quadro(uint8_t *seq, uint8_t *dados, uint32_t max) {
+   int32_t n = -1;
+   int esc = 0, c;
+   char hex[5];
+
+   while(le_byte() != '$') ;
+   recebidos++;
+   for(;;) {
+      c = le_byte();
+      recebidos++;
+      if(c == '#') break;
+      if(c == '$') return -1;
+      if(c == ESCAPE) {
+         esc = 1;
+         continue;
+      }
+      if(esc) c ^= 0x20;
+      esc = 0;
+      if(n < 0) *seq = c;
+      else if((uint32_t)n < max) dados[n] = c;
+      else return -1;
+      n++;
+   }
+   for(int i=0; i<4; i++) hex[i] = le_byte();
+   hex[4] = 0;
+   recebidos += 4;
+   if((n == 2) && (*seq == 'E')) return -2;     // "$E01#a5"
+   if((n < 0) || (strtoul(hex, 0, 16) != crc16(crc16(0xffff, seq, 1), dados, n))) return -1;
+   return n;
+}
+
+/**
+ * Recebe uma área em quadros, confirmando cada um.
+ * @param area Destino.
+ * @param tam Tamanho da área. Sem lz, é lido do cabeçalho do primeiro
+ *            quadro (resposta do $pCAP read, até LOTE_MAX bytes) e retornado.
+ * @param lz Quadros do $pMZ, com o byte de tipo; sem ele, os dados vêm
+ *           sem compressão.
+ * @return Soma do conteúdo dos quadros.
+ */
+static uint64_t recebe(uint8_t *area, uint32_t *tam, int lz) {
+   uint32_t total = lz ? (*tam + XFER_BLOCO - 1) / XFER_BLOCO : 1, esperado = 0;
+   uint64_t conteudo = 0;
+   int rejeitado = 0;
+   while(esperado < total) {
+      static uint8_t dados[XFER_BLOCO + 1];
+      uint32_t k = *tam - esperado * XFER_BLOCO;
+      uint8_t seq;
+      char r[4];
+
+      int32_t n = le_quadro(&seq, dados, sizeof(dados));
+      if(n == -2) {
+         fprintf(stderr, "dump: comando recusado\n");
+         exit(1);
+      }
+      int32_t ok = (n > 0) && (seq == (uint8_t)esperado);
+      if(ok && !lz && (esperado == 0) && (n >= 8)) {
+         uint32_t ev;
+         memcpy(&ev, dados, 4);
+         *tam = 8 + ev * sizeof(capture_evento_t);
+         if(*tam > LOTE_MAX) {
+            fprintf(stderr, "dump: lote inválido\n");
+            exit(1);
+         }
+         total = (*tam + XFER_BLOCO - 1) / XFER_BLOCO;
+         k = *tam;
+      }
+      if(k > XFER_BLOCO) k = XFER_BLOCO;
+      if(ok && !lz) ok = (n == (int32_t)k);
+      else if(ok && (dados[0] == XFER_BRUTO)) ok = (n - 1 == (int32_t)k);
+      else if(ok && (dados[0] == XFER_LZ)) ok = (lz_decode(area + esperado * XFER_BLOCO, k, dados + 1, n - 1) == (int32_t)k);
+      else ok = 0;
+      if(!ok) {
+         if(!rejeitado) {
+            sprintf(r, "-%02x", (uint8_t)esperado);
+            envia(r);
+         }
+         rejeitado = 1;
+         continue;
+      }
+      if(!lz) memcpy(area + esperado * XFER_BLOCO, dados, k);
+      else if(dados[0] == XFER_BRUTO) memcpy(area + esperado * XFER_BLOCO, dados + 1, k);
+      sprintf(r, "+%02x", seq);
+      envia(r);
+      conteudo += n;
+      rejeitado = 0;
+      esperado++;
+   }
+   return conteudo;
+}
+
+/**
+ * Retira os eventos da captura de bordas ($pCAP read) até esvaziar a fila
+ * e os grava em texto, um por linha: instante (us), bordas e nível.
+ */
+static int eventos(const char *arq) {
+   static uint8_t lote[LOTE_MAX];
+   static char texto[4096];
+   uint32_t total = 0, perdidos = 0;
+   FILE *f = fopen(arq, "w");
+   if(f == 0) {
+      perror(arq);
+      return 1;
+   }
+   fprintf(f, "# t(us) bordas nivel\n");
+   for(;;) {
+      uint32_t tam, n;
+      envia("$pCAP read\r");
+      recebe(lote, &tam, 0);
+      espera_prompt(texto, sizeof(texto));
+      memcpy(&n, lote, 4);
+      memcpy(&perdidos, lote + 4, 4);
+      for(uint32_t i=0; i<n; i++) {
+         capture_evento_t e;
+         memcpy(&e, lote + 8 + i * sizeof(e), sizeof(e));
+         fprintf(f, "%u %08x %08x\n", e.t, e.bordas, e.nivel);
+      }
+      total += n;
+      if(n == 0) break;
+   }
+   fclose(f);
+   printf("%u eventos, %u perdidos\n", total, perdidos);
+   return 0;
+}
+
+static void uso(const char *nome) {
+   fprintf(stderr, "uso: %s [-c piclis-host | -t endereço:porta | -d porta serial [-b baud]]\n"
+                   "          endereço tamanho arquivo | -e arquivo\n", nome);
+   exit(1);
+}
+
+int main(int argc, char **argv) {
+   const char *exe = 0, *tcp = 0, *disp = 0;
+   unsigned baud = 115200;
+   int op, captura = 0;
+   while((op = getopt(argc, argv, "c:t:d:b:e")) != -1) {
+      switch(op) {
+         case 'c': exe = optarg; break;
+         case 't': tcp = optarg; break;
+         case 'd': disp = optarg; break;
+         case 'b': baud = strtoul(optarg, 0, 0); break;
+         case 'e': captura = 1; break;
+         default: uso(argv[0]);
+      }
+   }
+   if((argc - optind != (captura ? 1 : 3)) || (!exe + !tcp + !disp != 2)) uso(argv[0]);
+   uint32_t addr = 0, tam = 0;
+   uint8_t *area = 0;
+   if(!captura) {
+      addr = strtoul(argv[optind], 0, 16);
+      tam = strtoul(argv[optind + 1], 0, 16);
+      area = malloc(tam + 1);
+      if((tam == 0) || (area == 0)) uso(argv[0]);
+   }
+
+   if(exe) conecta_exe(&uart, exe);
+   else if(tcp) conecta_tcp(&uart, tcp);
+   else conecta_serial(&uart, disp, baud);
+
+   /*
+    * Sincroniza com o prompt e pede a área ou os eventos.
+    */
+   static char texto[4096];
+   envia("$pECHO sincroniza-dump\r");
+   do espera_prompt(texto, sizeof(texto)); while(strstr(texto, "sincroniza-dump") == 0);
+   if(captura) {
+      int res = eventos(argv[optind]);
+      desconecta(&uart);
+      return res;
+   }
+
+   const char *arq = argv[optind + 2];
+   sprintf(texto, "$pMZ %x %x\r", addr, tam);
+   envia(texto);
+
+   uint64_t conteudo = recebe(area, &tam, 1);
+   espera_prompt(texto, sizeof(texto));
+   desconecta(&uart);
+
+   FILE *f = fopen(arq, "wb");
+   if((f == 0) || (fwrite(area, 1, tam, f) != tam)) {
+      perror(arq);
+      return 1;
+   }
+   fclose(f);
+
+   /*
+    * Razão de compressão: conteúdo dos quadros e bytes na uart (com a
+    * moldura, os escapes e as retransmissões), comparados com o comando m.
+    */
+   char *linha = strstr(texto, "MZ:");
+   if(linha && strchr(linha, '\r')) *strchr(linha, '\r') = 0;
+   printf("%s\n", linha ? linha : "");
+   printf("%u bytes: %llu bytes de conteúdo (%.1f%%), %llu bytes na uart (%.1f%%, m: 200%%)\n",
+          tam, (unsigned long long)conteudo, 100.0 * conteudo / tam,
+          (unsigned long long)recebidos, 100.0 * recebidos / tam);
+   return 0;
+}
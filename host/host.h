@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Build nativo (make host): os mesmos fontes do PiCLIs compilados para
+ * Linux. Os periféricos são um bloco de memória (sim_periph) atualizado
+ * por uma thread de simulação, a uart é um pipe/PTY e a memória do
+ * programa do usuário é uma área mapeada em endereços de 32 bits.
+ *
+ * O executável é ligado sem PIE em SIM_TEXTO, de modo que as variáveis
+ * estáticas também tenham endereços de 32 bits (os comandos tratam
+ * endereços como uint32_t).
+ */
+#define SIM_RAM_BASE         0x00100000
+#define SIM_RAM_FIM          0x08000000
+#define SIM_TEXTO            0x08000000
+
+#define SIM_PERIPH_SIZE      0x00220000
+#define SIM_CLOCK_ARM        250          // ciclos por us do contador livre do ARM timer
+
+/*
+ * host/sim.c
+ */
+void sim_init(const char *gpio_log);
+void sim_fim(void);
+
+/*
+ * host/uart.c
+ */
+int uart_host_open(const char *pty);
@@ -0,0 +1,102 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <setjmp.h>
+#include "../bcm.h"
+#include "../bkpt.h"
+#include "../nextpc.h"
+#include "../uart.h"
+#include "host.h"
+
+/*
+ * Ponto de entrada do build nativo.
+ *
+ * O programa do usuário não é executado: switch_back simula apenas o fluxo
+ * de controle, avançando o pc com next_pc até encontrar um trap (SIGTRAP),
+ * sair da memória simulada (SIGSEGV) ou receber ^C (SIGINT). Com isso os
+ * comandos c, s, $pSTEP e os breakpoints podem ser exercitados sem a placa.
+ */
+#define SIG_INT              0x02
+#define SIG_TRAP             0x05
+#define SIG_SEGV             0x0b
+
+#define PASSOS_POR_LEITURA   4096         // passos simulados entre verificações de ^C
+
+extern uint32_t user_regs[];
+void main_piclis(void);
+void piclis_main(int sig);
+
+static jmp_buf reinicio;
+
+static int trap(uint32_t pc, int thumb) {
+   if(thumb) return *(volatile uint16_t*)(uintptr_t)pc == TRAP_THUMB;
+   return *(volatile uint32_t*)(uintptr_t)pc == TRAP_INST;
+}
+
+/**
+ * Volta ao "programa do usuário" (ver acima) e reentra no PiCLIs com o
+ * sinal da parada, como goto_piclis em boot.s.
+ */
+void switch_back(void) {
+   uint32_t n = 0;
+   int sig;
+   for(;;) {
+      uint32_t pc = user_regs[15];
+      int thumb = (user_regs[41] & 0x20) != 0;
+      if((pc < SIM_RAM_BASE) || (pc > SIM_RAM_FIM - 4)) {
+         sig = SIG_SEGV;
+         break;
+      }
+      if(trap(pc & ~1, thumb)) {
+         sig = SIG_TRAP;
+         break;
+      }
+      if((++n % PASSOS_POR_LEITURA) == 0) {
+         int c = uart_try_getc();
+         if(c == 0x03) {
+            sig = SIG_INT;
+            break;
+         }
+      }
+      uint32_t prox = next_pc(user_regs);
+      if(prox & 1) user_regs[41] |= 0x20;
+      else user_regs[41] &= ~0x20;
+      user_regs[15] = prox & ~1;
+   }
+   longjmp(reinicio, sig);
+}
+
+static void uso(const char *nome) {
+   fprintf(stderr, "uso: %s [-p] [-g arquivo]\n"
+                   "  -p          uart em um pseudo-terminal (padrão: stdin/stdout)\n"
+                   "  -g arquivo  registro das mudanças dos GPIOs (padrão: stderr)\n", nome);
+   exit(1);
+}
+
+int main(int argc, char **argv) {
+   const char *pty = 0, *gpio_log = 0;
+   int op, sig;
+   while((op = getopt(argc, argv, "pg:")) != -1) {
+      switch(op) {
+         case 'p': pty = "pty"; break;
+         case 'g': gpio_log = optarg; break;
+         default: uso(argv[0]);
+      }
+   }
+   if(uart_host_open(pty) < 0) {
+      perror("uart");
+      return 1;
+   }
+   sim_init(gpio_log);
+   atexit(sim_fim);
+
+   sig = setjmp(reinicio);
+   if(sig == 0) {
+      main_piclis();                          // inicialização
+      sig = SIG_TRAP;
+   }
+   piclis_main(sig);
+   return 0;
+}
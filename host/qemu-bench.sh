@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# Executa o roteiro de comandos do piclis-bench no firmware sob o QEMU
+# (máquina raspi2b), com a uart (PL011) ligada a um socket TCP.
+#
+#   host/qemu-bench.sh [referência]
+#
+# Os resultados são gravados em qemu-<versão>.txt, com a versão dada pelo
+# git; com uma referência (resultado de outra versão), compara e termina
+# com erro se algum resultado piorar mais que a tolerância do piclis-bench.
+#
+# Variáveis: QEMU (padrão qemu-system-arm), PORTA (padrão 5555),
+# ELF (padrão piclis.elf).
+#
+QEMU=${QEMU:-qemu-system-arm}
+PORTA=${PORTA:-5555}
+ELF=${ELF:-piclis.elf}
+VERSAO=$(git describe --always --dirty 2>/dev/null || echo local)
+SAIDA=qemu-${VERSAO}.txt
+
+${QEMU} -M raspi2b -kernel ${ELF} -display none -monitor none \
+   -serial tcp:127.0.0.1:${PORTA},server=on,wait=off,nodelay=on &
+PID=$!
+trap 'kill ${PID} 2>/dev/null' EXIT INT TERM
+
+if [ -n "$1" ]; then
+   ./piclis-bench -t 127.0.0.1:${PORTA} -o ${SAIDA} -b "$1"
+else
+   ./piclis-bench -t 127.0.0.1:${PORTA} -o ${SAIDA}
+fi
+RES=$?
+echo "resultados em ${SAIDA}"
+exit ${RES}
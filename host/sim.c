@@ -0,0 +1,285 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "../bcm.h"
+#include "../dma.h"
+#include "../mmu.h"
+#include "../irq.h"
+#include "host.h"
+
+/*
+ * Periféricos simulados. Os drivers leem e escrevem o bloco como na placa;
+ * a thread de simulação atualiza os contadores, aplica as escritas em
+ * gpset/gpclr, executa as cadeias de DMA (cadenciadas pelo PWM, se for
+ * o caso) e gera a interrupção do canal 1 do system timer e as das bordas
+ * dos GPIOs.
+ */
+uint8_t sim_periph[SIM_PERIPH_SIZE] __attribute__((aligned(4096)));
+
+#define PERIODO_NS           20000        // intervalo entre atualizações da simulação
+#define TIMER_CANAL          1
+
+static pthread_t thread;
+static volatile int rodando;
+static FILE *log_gpio;
+static struct timespec t0;
+
+/*
+ * Interrupções: enquanto estão mascaradas, a thread principal (o "núcleo")
+ * mantém o mutex, e a thread de simulação só executa trata_irq com ele.
+ */
+static pthread_mutex_t irq_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int mascaradas;
+
+static uint64_t agora_ns(void) {
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return (uint64_t)(t.tv_sec - t0.tv_sec) * 1000000000u + t.tv_nsec - t0.tv_nsec;
+}
+
+/**
+ * Aplica as escritas em gpset e gpclr ao nível dos pinos e registra as mudanças.
+ * As bordas habilitadas em gpren/gpfen (ou gparen/gpafen) ficam pendentes
+ * até a entrega da interrupção do banco.
+ */
+static uint32_t eventos_gpio[2];
+
+static void atualiza_gpio(uint64_t us) {
+   for(int b=0; b<2; b++) {
+      uint32_t set = __atomic_exchange_n(&GPIO_REG(gpset[b]), 0, __ATOMIC_ACQ_REL);
+      uint32_t clr = __atomic_exchange_n(&GPIO_REG(gpclr[b]), 0, __ATOMIC_ACQ_REL);
+      if((set | clr) == 0) continue;
+      uint32_t antes = GPIO_REG(gplev[b]);
+      uint32_t depois = (antes | set) & ~clr;
+      GPIO_REG(gplev[b]) = depois;
+      eventos_gpio[b] |= (~antes & depois & (GPIO_REG(gpren[b]) | GPIO_REG(gparen[b])))
+                       | (antes & ~depois & (GPIO_REG(gpfen[b]) | GPIO_REG(gpafen[b])));
+      for(int i=0; i<32; i++) {
+         if(((antes ^ depois) >> i) & 1) {
+            fprintf(log_gpio, "%llu.%06llu gpio%d %d\n", (unsigned long long)(us / 1000000),
+                    (unsigned long long)(us % 1000000), 32 * b + i, (depois >> i) & 1);
+         }
+      }
+      fflush(log_gpio);
+   }
+}
+
+/**
+ * Executa a cadeia de blocos de controle de um canal ativo. Os blocos
+ * cadenciados pelo DREQ do PWM (escritas na FIFO, ver wave.c) apenas
+ * suspendem o canal pelo tempo que o PWM levaria para consumir os dados;
+ * os demais são executados imediatamente.
+ */
+#define DREQ_PWM             5
+static uint64_t retoma_dma[15];
+
+static void executa_dma(int ch) {
+   uint32_t cbaddr = DMA_REG(ch, cb) & 0x3fffffff;
+   while(cbaddr) {
+      dma_cb_t *cb = (dma_cb_t*)(uintptr_t)cbaddr;
+      if((cb->ti & DMA_TI_DEST_DREQ) && (((cb->ti >> 16) & 0x1f) == DREQ_PWM)) {
+         uint64_t ns = 2 * (uint64_t)PWM_REG(rng1) * ((CM_PWM_REG(div) >> 12) & 0xfff);
+         retoma_dma[ch] = agora_ns() + (cb->length / 4) * (ns ? ns : 1000);
+         DMA_REG(ch, cb) = cb->nextcb;
+         return;
+      }
+      uint8_t *src = (uint8_t*)(uintptr_t)(cb->saddr & 0x3fffffff);
+      uint8_t *dst = (uint8_t*)(uintptr_t)(cb->daddr & 0x3fffffff);
+      uint32_t x = cb->length, y = 1;
+      int32_t s_stride = 0, d_stride = 0;
+      if(cb->ti & DMA_TI_TDMODE) {
+         x = cb->length & 0xffff;
+         y = (cb->length >> 16) + 1;
+         s_stride = (int16_t)(cb->stride & 0xffff);
+         d_stride = (int16_t)(cb->stride >> 16);
+      }
+      if((cb->daddr >> 24) == 0x7e) dst = sim_periph + (cb->daddr & 0x00ffffff);
+      if((cb->saddr >> 24) == 0x7e) src = sim_periph + (cb->saddr & 0x00ffffff);
+      while(y--) {
+         for(uint32_t i=0; i<x; i+=4) {
+            uint32_t v = 0;
+            if(!(cb->ti & DMA_TI_SRC_IGNORE)) memcpy(&v, src + ((cb->ti & DMA_TI_SRC_INC) ? i : 0), 4);
+            memcpy(dst + ((cb->ti & DMA_TI_DEST_INC) ? i : 0), &v, 4);
+         }
+         if(cb->ti & DMA_TI_SRC_INC) src += x;
+         if(cb->ti & DMA_TI_DEST_INC) dst += x;
+         src += s_stride;
+         dst += d_stride;
+      }
+      if(cb->ti & DMA_TI_INTEN) DMA_REG(ch, cs) |= DMA_CS_INT;
+      cbaddr = cb->nextcb & 0x3fffffff;
+   }
+   DMA_REG(ch, cb) = 0;
+   DMA_REG(ch, cs) = (DMA_REG(ch, cs) & ~DMA_CS_ACTIVE) | DMA_CS_END;
+}
+
+static void atualiza_dma(void) {
+   for(int ch=0; ch<15; ch++) {
+      uint32_t cs = DMA_REG(ch, cs);
+      if(cs & DMA_CS_RESET) {
+         DMA_REG(ch, cs) = 0;
+         retoma_dma[ch] = 0;
+      } else if((cs & DMA_CS_ACTIVE) && bit_is_set(DMA_ENABLE_REG, ch)
+                && (agora_ns() >= retoma_dma[ch])) executa_dma(ch);
+   }
+}
+
+/*
+ * Fontes habilitadas (pending_1 e pending_2): as escritas em enable_* e
+ * disable_* são acumuladas aqui, já que na placa os registradores só
+ * ativam ou desativam os bits escritos.
+ */
+static uint32_t habilitadas[2];
+static volatile int fiq_mascarada = 1;
+
+static void atualiza_habilitadas(void) {
+   habilitadas[0] &= ~__atomic_exchange_n(&IRQ_REG(disable_1), 0, __ATOMIC_ACQ_REL);
+   habilitadas[0] |= __atomic_exchange_n(&IRQ_REG(enable_1), 0, __ATOMIC_ACQ_REL);
+   habilitadas[1] &= ~__atomic_exchange_n(&IRQ_REG(disable_2), 0, __ATOMIC_ACQ_REL);
+   habilitadas[1] |= __atomic_exchange_n(&IRQ_REG(enable_2), 0, __ATOMIC_ACQ_REL);
+}
+
+/**
+ * Entrega a interrupção de um banco de GPIOs (fontes 49 e 50, bits 17 e 18
+ * de pending_2) com os eventos pendentes em gpeds, que o tratador apaga
+ * com escritas de 1 (aqui, gpeds é zerado depois da entrega). Uma fonte
+ * encaminhada para a FIQ é entregue a trata_fiq mesmo com as IRQs
+ * mascaradas.
+ */
+static void atualiza_irq_gpio(void) {
+   for(int b=0; b<2; b++) {
+      int fiq = (IRQ_REG(fiq) == (0x80 | (49 + b))) && !fiq_mascarada;
+      if((eventos_gpio[b] == 0) || (!fiq && bit_not_set(habilitadas[1], 17 + b))) continue;
+      if(!fiq && pthread_mutex_trylock(&irq_mutex)) return;   // mascaradas: entrega depois
+      GPIO_REG(gpeds[b]) = eventos_gpio[b];
+      eventos_gpio[b] = 0;
+      if(fiq) trata_fiq();
+      else {
+         set_bit(IRQ_REG(pending_2), 17 + b);
+         trata_irq();
+         clr_bit(IRQ_REG(pending_2), 17 + b);
+      }
+      GPIO_REG(gpeds[b]) = 0;
+      if(!fiq) pthread_mutex_unlock(&irq_mutex);
+   }
+}
+
+/**
+ * Gera a interrupção do canal de comparação do system timer quando o
+ * contador alcança o valor programado.
+ */
+static void atualiza_irq(void) {
+   static uint32_t entregue;
+   uint32_t alvo = SYSTIMER_REG(c[TIMER_CANAL]);
+   atualiza_habilitadas();
+   atualiza_irq_gpio();
+   if(bit_not_set(habilitadas[0], TIMER_CANAL)) return;
+   if((alvo == entregue) || ((int32_t)(SYSTIMER_REG(clo) - alvo) < 0)) return;
+
+   if(pthread_mutex_trylock(&irq_mutex)) return;     // mascaradas: entrega depois
+   entregue = alvo;
+   set_bit(SYSTIMER_REG(cs), TIMER_CANAL);
+   set_bit(IRQ_REG(pending_1), TIMER_CANAL);
+   trata_irq();
+   clr_bit(IRQ_REG(pending_1), TIMER_CANAL);
+   clr_bit(SYSTIMER_REG(cs), TIMER_CANAL);
+   pthread_mutex_unlock(&irq_mutex);
+}
+
+static void atualiza_timers(void) {
+   uint64_t ns = agora_ns();
+   uint64_t us = ns / 1000;
+   SYSTIMER_REG(chi) = us >> 32;
+   SYSTIMER_REG(clo) = us;
+   TIMER_REG(counter) = ns * SIM_CLOCK_ARM / 1000;
+}
+
+static void *simula(void *arg) {
+   struct timespec periodo = { 0, PERIODO_NS };
+   (void)arg;
+   while(rodando) {
+      atualiza_timers();
+      atualiza_gpio(agora_ns() / 1000);
+      atualiza_dma();
+      atualiza_irq();
+      nanosleep(&periodo, 0);
+   }
+   return 0;
+}
+
+/**
+ * Mapeia a memória do usuário e inicia a simulação.
+ * Deve ser chamada pela thread que executa o PiCLIs, que começa com as
+ * interrupções mascaradas.
+ * @param gpio_log Arquivo para o registro das mudanças dos GPIOs (0 = stderr).
+ */
+void sim_init(const char *gpio_log) {
+   void *ram = mmap((void*)SIM_RAM_BASE, SIM_RAM_FIM - SIM_RAM_BASE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE | MAP_NORESERVE, -1, 0);
+   if(ram != (void*)SIM_RAM_BASE) {
+      perror("sim: memória do usuário");
+      exit(1);
+   }
+   log_gpio = stderr;
+   if(gpio_log && !(log_gpio = fopen(gpio_log, "w"))) {
+      perror(gpio_log);
+      exit(1);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   atualiza_timers();
+   enable_irq(0);
+   rodando = 1;
+   pthread_create(&thread, 0, simula, 0);
+}
+
+/**
+ * Encerra a thread de simulação.
+ */
+void sim_fim(void) {
+   if(!rodando) return;
+   rodando = 0;
+   if(mascaradas) {
+      mascaradas = 0;
+      pthread_mutex_unlock(&irq_mutex);
+   }
+   pthread_join(thread, 0);
+}
+
+/*
+ * Equivalentes das funções de boot.s
+ */
+void enable_irq(uint32_t en) {
+   if(en && mascaradas) {
+      mascaradas = 0;
+      pthread_mutex_unlock(&irq_mutex);
+   } else if(!en && !mascaradas) {
+      pthread_mutex_lock(&irq_mutex);
+      mascaradas = 1;
+   }
+}
+
+void enable_fiq(uint32_t en) {
+   fiq_mascarada = !en;
+}
+
+uint32_t get_cpsr(void) {
+   return 0x13 | (mascaradas ? 0x80 : 0) | (fiq_mascarada ? 0x40 : 0);
+}
+
+void delay(uint32_t dur) {
+   while(dur--) __asm__ volatile ("" ::: "memory");
+}
+
+/*
+ * Sem MMU nem caches a manter no processo nativo.
+ */
+void mmu_init(void) { }
+void mmu_enable(void) { }
+void cache_clean(const void *a, uint32_t n) { (void)a; (void)n; }
+void cache_invalidate(void *a, uint32_t n) { (void)a; (void)n; }
+void cache_flush(const void *a, uint32_t n) { (void)a; (void)n; }
+void cache_sync_code(const void *a, uint32_t n) { (void)a; (void)n; }
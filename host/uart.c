@@ -0,0 +1,196 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include "../uart.h"
+#include "host.h"
+
+/*
+ * Uart do build nativo: a mesma interface de uart.c sobre descritores de
+ * arquivo (entrada e saída padrão, ou um pseudo-terminal). A transmissão é
+ * acumulada e enviada antes de qualquer espera por dados, como o buffer
+ * esvaziado pela interrupção na placa.
+ */
+#define TX_BUF_SIZE          4096
+#define RX_BUF_SIZE          4096
+#define CARACTERE_FIM        0x1d         // ^] encerra o simulador no terminal
+
+static int fd_rx = 0, fd_tx = 1;
+static int terminal;
+static struct termios termios_original;
+
+static uint8_t tx_buf[TX_BUF_SIZE];
+static uint32_t tx_n;
+static uint8_t rx_buf[RX_BUF_SIZE];
+static uint32_t rx_ini, rx_fim;
+static uint32_t baud_atual = 115200;
+
+static void restaura_terminal(void) {
+   tcsetattr(fd_rx, TCSANOW, &termios_original);
+}
+
+/**
+ * Escolhe o canal da uart. Sem pty, usa a entrada e a saída padrão
+ * (em modo raw, se forem um terminal).
+ * @param pty Qualquer valor diferente de 0 cria um pseudo-terminal, cujo
+ *            nome é mostrado em stderr.
+ * @return 0, ou -1 em caso de erro.
+ */
+int uart_host_open(const char *pty) {
+   struct termios t;
+   if(pty) {
+      int m = posix_openpt(O_RDWR | O_NOCTTY);
+      if((m < 0) || grantpt(m) || unlockpt(m)) return -1;
+      int s = open(ptsname(m), O_RDWR | O_NOCTTY);   // mantida aberta: evita EIO sem cliente
+      if(s < 0) return -1;
+      tcgetattr(s, &t);
+      cfmakeraw(&t);
+      tcsetattr(s, TCSANOW, &t);
+      fprintf(stderr, "uart: %s\n", ptsname(m));
+      fd_rx = fd_tx = m;
+      return 0;
+   }
+   if(isatty(fd_rx)) {
+      terminal = 1;
+      tcgetattr(fd_rx, &termios_original);
+      t = termios_original;
+      cfmakeraw(&t);
+      tcsetattr(fd_rx, TCSANOW, &t);
+      atexit(restaura_terminal);
+   }
+   return 0;
+}
+
+static void envia(void) {
+   uint32_t i = 0;
+   while(i < tx_n) {
+      ssize_t k = write(fd_tx, tx_buf + i, tx_n - i);
+      if(k <= 0) exit(0);
+      i += k;
+   }
+   tx_n = 0;
+}
+
+/**
+ * Preenche o buffer de recepção.
+ * @param espera Bloqueia até chegar pelo menos um byte.
+ * @return Quantidade de bytes disponíveis.
+ */
+static uint32_t recebe(int espera) {
+   struct pollfd p = { fd_rx, POLLIN, 0 };
+   if(rx_ini < rx_fim) return rx_fim - rx_ini;
+   envia();
+   if(poll(&p, 1, espera ? -1 : 0) <= 0) return 0;
+   ssize_t k = read(fd_rx, rx_buf, RX_BUF_SIZE);
+   if(k <= 0) exit(0);                            // fim da entrada
+   if(terminal && (rx_buf[0] == CARACTERE_FIM)) exit(0);
+   rx_ini = 0;
+   rx_fim = k;
+   return k;
+}
+
+void uart_init(void) {
+   tx_n = 0;
+   rx_ini = rx_fim = 0;
+}
+
+int uart_try_putc(uint8_t c) {
+   if(tx_n == TX_BUF_SIZE) envia();
+   tx_buf[tx_n++] = c;
+   return 1;
+}
+
+void uart_putc(uint8_t c) {
+   uart_try_putc(c);
+}
+
+void uart_puts(char *s) {
+   while(*s) uart_try_putc(*s++);
+}
+
+uint32_t uart_try_write(const uint8_t *b, uint32_t n) {
+   for(uint32_t i=0; i<n; i++) uart_try_putc(b[i]);
+   return n;
+}
+
+void uart_write(const uint8_t *b, uint32_t n) {
+   uart_try_write(b, n);
+}
+
+int uart_try_getc(void) {
+   if(recebe(0) == 0) return -1;
+   return rx_buf[rx_ini++];
+}
+
+uint32_t uart_try_read(uint8_t *b, uint32_t n) {
+   uint32_t disp = recebe(0);
+   if(n > disp) n = disp;
+   for(uint32_t i=0; i<n; i++) b[i] = rx_buf[rx_ini++];
+   return n;
+}
+
+void uart_read(uint8_t *b, uint32_t n) {
+   while(n) {
+      uint32_t k = recebe(1);
+      if(k > n) k = n;
+      for(uint32_t i=0; i<k; i++) *b++ = rx_buf[rx_ini++];
+      n -= k;
+   }
+}
+
+uint8_t uart_getc(void) {
+   recebe(1);
+   return rx_buf[rx_ini++];
+}
+
+uint32_t uart_rx_available(void) {
+   return recebe(0);
+}
+
+uint32_t uart_tx_free(void) {
+   return TX_BUF_SIZE - tx_n;
+}
+
+void uart_flush(void) {
+   envia();
+}
+
+int uart_set_fifo(uint32_t rx, uint32_t tx) {
+   return ((rx > UART_FIFO_7_8) || (tx > UART_FIFO_7_8)) ? -1 : 0;
+}
+
+int uart_baud_valid(uint32_t baud) {
+   return baud != 0;
+}
+
+int uart_set_baud(uint32_t baud) {
+   if(baud == 0) return -1;
+   uart_flush();
+   baud_atual = baud;
+   return 0;
+}
+
+uint32_t uart_get_baud(void) {
+   return baud_atual;
+}
+
+void uart_discard(void) {
+   rx_ini = rx_fim;
+}
+
+/*
+ * O ^C é tratado pela simulação do programa do usuário (host/main.c).
+ */
+void uart_break_enable(void) { }
+void uart_break_disable(void) { }
+
+uint32_t uart_irq(void) {
+   return 0;
+}
+
+int uart_dma_channel(void) {
+   return -1;
+}
@@ -0,0 +1,294 @@
+#include "bcm.h"
+#include "hwdebug.h"
+#include "mmu.h"
+
+/*
+ * Breakpoints e watchpoints pela unidade de depuração (CP14) do Cortex-A7,
+ * em "monitor debug-mode": um breakpoint gera um prefetch abort e um
+ * watchpoint gera um data abort, com o código de falha "debug event".
+ * Os registradores são programados somente enquanto o programa do usuário
+ * executa (hwdbg_enable/hwdbg_disable), para que o próprio PiCLIs possa
+ * ler e escrever as áreas observadas.
+ * No ARM1176 (RPICPU 0) e no build nativo a unidade não é usada e os
+ * breakpoints ficam a cargo das instruções de trap.
+ */
+#define CP14                 ((RPICPU == 2) && !HOST)
+
+#define MAX_HW               16
+
+/*
+ * Campos de BCR e WCR
+ */
+#define CR_E                 __bit(0)
+#define CR_PL_TODOS          (3 << 1)     // PL0 e PL1
+#define BCR_BAS(X)           ((X) << 5)
+#define WCR_LSC(X)           ((X) << 3)   // 1 = leitura, 2 = escrita, 3 = ambos
+#define WCR_BAS(X)           ((X) << 5)
+#define WCR_MASK(X)          ((X) << 24)
+
+#define DSCR_MOE(X)          (((X) >> 2) & 0x0f)
+#define DSCR_MDBGEN          __bit(15)
+#define MOE_BKPT             0x1
+#define MOE_WATCH_ASYNC      0x2
+#define MOE_WATCH_SYNC       0xa
+#define FS_DEBUG             0x02
+
+typedef struct {
+   uint32_t valor;                       // BVR/WVR
+   uint32_t controle;                    // BCR/WCR (0 = livre)
+} hw_slot_t;
+
+static hw_slot_t bps[MAX_HW];
+static hw_slot_t wps[MAX_HW];
+static int num_bps, num_wps;
+
+#if CP14
+/*
+ * Os registradores são selecionados pelo campo CRm da instrução,
+ * por isso cada índice precisa de uma instrução própria.
+ */
+#define ESCREVE_CP14(OP2, N, V) \
+   case N: asm volatile ("mcr p14, 0, %0, c0, c" #N ", " #OP2 :: "r" (V)); break
+
+#define ESCREVE_TODOS(OP2, N, V)                                           \
+   switch(N) {                                                            \
+      ESCREVE_CP14(OP2, 0, V);  ESCREVE_CP14(OP2, 1, V);                  \
+      ESCREVE_CP14(OP2, 2, V);  ESCREVE_CP14(OP2, 3, V);                  \
+      ESCREVE_CP14(OP2, 4, V);  ESCREVE_CP14(OP2, 5, V);                  \
+      ESCREVE_CP14(OP2, 6, V);  ESCREVE_CP14(OP2, 7, V);                  \
+      ESCREVE_CP14(OP2, 8, V);  ESCREVE_CP14(OP2, 9, V);                  \
+      ESCREVE_CP14(OP2, 10, V); ESCREVE_CP14(OP2, 11, V);                 \
+      ESCREVE_CP14(OP2, 12, V); ESCREVE_CP14(OP2, 13, V);                 \
+      ESCREVE_CP14(OP2, 14, V); ESCREVE_CP14(OP2, 15, V);                 \
+   }
+
+static void escreve_bvr(int n, uint32_t v) { ESCREVE_TODOS(4, n, v) }
+static void escreve_bcr(int n, uint32_t v) { ESCREVE_TODOS(5, n, v) }
+static void escreve_wvr(int n, uint32_t v) { ESCREVE_TODOS(6, n, v) }
+static void escreve_wcr(int n, uint32_t v) { ESCREVE_TODOS(7, n, v) }
+
+static uint32_t le_dscr(void) {
+   uint32_t v;
+   asm volatile ("mrc p14, 0, %0, c0, c2, 2" : "=r" (v));   // DBGDSCRext
+   return v;
+}
+#endif
+
+/**
+ * Habilita o monitor debug-mode e descobre a quantidade de registradores.
+ * @return 0, ou -1 se a unidade de depuração não estiver disponível.
+ */
+int hwdbg_init(void) {
+   num_bps = num_wps = 0;
+#if CP14
+   uint32_t didr, dscr;
+   asm volatile ("mcr p14, 0, %0, c1, c0, 4" :: "r" (0));   // DBGOSLAR: destrava
+   asm volatile ("mcr p14, 0, %0, c1, c3, 4" :: "r" (0));   // DBGOSDLR
+   isb();
+   asm volatile ("mrc p14, 0, %0, c0, c0, 0" : "=r" (didr)); // DBGDIDR
+   dscr = le_dscr() | DSCR_MDBGEN;
+   asm volatile ("mcr p14, 0, %0, c0, c2, 2" :: "r" (dscr));
+   isb();
+   if((le_dscr() & DSCR_MDBGEN) == 0) return -1;
+
+   num_bps = ((didr >> 24) & 0x0f) + 1;
+   num_wps = ((didr >> 28) & 0x0f) + 1;
+   for(int i=0; i<num_bps; i++) {
+      bps[i].controle = 0;
+      escreve_bcr(i, 0);
+   }
+   for(int i=0; i<num_wps; i++) {
+      wps[i].controle = 0;
+      escreve_wcr(i, 0);
+   }
+   isb();
+   return 0;
+#else
+   return -1;
+#endif
+}
+
+/**
+ * Verifica se há registradores de breakpoint.
+ */
+int hwdbg_disponivel(void) {
+   return num_bps > 0;
+}
+
+/**
+ * Reserva um breakpoint de hardware.
+ * @param addr Endereço da instrução.
+ * @param kind Tamanho da instrução (2 = Thumb, 4 = ARM), como nos pacotes Z do gdb.
+ * @return 0, ou -1 se não houver registrador livre.
+ */
+int hwdbg_bkpt_add(uint32_t addr, uint32_t kind) {
+   uint32_t bas;
+   int livre = -1;
+   if(kind == 2) bas = (addr & 2) ? 0x0c : 0x03;
+   else if(((kind == 4) || (kind == 0)) && ((addr & 3) == 0)) bas = 0x0f;
+   else return -1;
+
+   for(int i=0; i<num_bps; i++) {
+      if(bps[i].controle == 0) {
+         if(livre < 0) livre = i;
+      } else if(bps[i].valor == (addr & ~3) && (bps[i].controle & BCR_BAS(bas))) {
+         return 0;                                          // redefinido
+      }
+   }
+   if(livre < 0) return -1;
+   bps[livre].valor = addr & ~3;
+   bps[livre].controle = CR_E | CR_PL_TODOS | BCR_BAS(bas);
+   return 0;
+}
+
+/**
+ * Libera o breakpoint de hardware de um endereço.
+ * @return 0, ou -1 se não houver breakpoint de hardware no endereço.
+ */
+int hwdbg_bkpt_remove(uint32_t addr) {
+   int n = hwdbg_bkpt_existe(addr);
+   if(n < 0) return -1;
+   bps[n].controle = 0;
+   return 0;
+}
+
+/**
+ * Procura o breakpoint de hardware de um endereço.
+ * @return Índice do registrador, ou -1.
+ */
+int hwdbg_bkpt_existe(uint32_t addr) {
+   uint32_t bas = (addr & 2) ? 0x0c : 0x03;
+   for(int i=0; i<num_bps; i++) {
+      if(bps[i].controle && (bps[i].valor == (addr & ~3))
+         && (bps[i].controle & BCR_BAS(bas))) return i;
+   }
+   return -1;
+}
+
+/**
+ * Calcula o WCR para uma área: até 4 bytes dentro de uma palavra usam os
+ * bits BAS; áreas maiores devem ter tamanho potência de 2 e estar alinhadas,
+ * e usam o campo MASK.
+ * @return WCR sem os bits LSC, ou 0 se a área não puder ser observada.
+ */
+static uint32_t wcr_area(uint32_t addr, uint32_t len) {
+   if(len == 0) return 0;
+   if((addr & 3) + len <= 4) {
+      uint32_t bas = ((1 << len) - 1) << (addr & 3);
+      return CR_E | CR_PL_TODOS | WCR_BAS(bas);
+   }
+   if((len & (len - 1)) || (addr & (len - 1))) return 0;
+   uint32_t mask = 0;
+   while((1u << mask) < len) mask++;
+   return CR_E | CR_PL_TODOS | WCR_BAS(0x0f) | WCR_MASK(mask);
+}
+
+static uint32_t lsc(int tipo) {
+   if(tipo == HWDBG_LEITURA) return WCR_LSC(1);
+   if(tipo == HWDBG_ESCRITA) return WCR_LSC(2);
+   return WCR_LSC(3);
+}
+
+/**
+ * Reserva um watchpoint.
+ * @param addr Endereço inicial da área observada.
+ * @param len Tamanho da área (1 a 4 bytes na mesma palavra, ou potência de 2 alinhada).
+ * @param tipo HWDBG_ESCRITA, HWDBG_LEITURA ou HWDBG_ACESSO.
+ * @return 0, ou -1 se a área for inválida ou não houver registrador livre.
+ */
+int hwdbg_watch_add(uint32_t addr, uint32_t len, int tipo) {
+   uint32_t wcr = wcr_area(addr, len);
+   if((wcr == 0) || (tipo < HWDBG_ESCRITA) || (tipo > HWDBG_ACESSO)) return -1;
+   wcr |= lsc(tipo);
+   uint32_t wvr = (len > 4) ? addr : (addr & ~3);
+   int livre = -1;
+   for(int i=0; i<num_wps; i++) {
+      if((wps[i].controle == wcr) && (wps[i].valor == wvr)) return 0;
+      if((wps[i].controle == 0) && (livre < 0)) livre = i;
+   }
+   if(livre < 0) return -1;
+   wps[livre].valor = wvr;
+   wps[livre].controle = wcr;
+   return 0;
+}
+
+/**
+ * Libera um watchpoint.
+ * @return 0, ou -1 se o watchpoint não existir.
+ */
+int hwdbg_watch_remove(uint32_t addr, uint32_t len, int tipo) {
+   uint32_t wcr = wcr_area(addr, len);
+   if(wcr == 0) return -1;
+   wcr |= lsc(tipo);
+   uint32_t wvr = (len > 4) ? addr : (addr & ~3);
+   for(int i=0; i<num_wps; i++) {
+      if((wps[i].controle == wcr) && (wps[i].valor == wvr)) {
+         wps[i].controle = 0;
+         return 0;
+      }
+   }
+   return -1;
+}
+
+/**
+ * Programa os registradores de depuração antes de retomar o programa do usuário.
+ */
+void hwdbg_enable(void) {
+#if CP14
+   for(int i=0; i<num_bps; i++) {
+      if(bps[i].controle == 0) continue;
+      escreve_bvr(i, bps[i].valor);
+      escreve_bcr(i, bps[i].controle);
+   }
+   for(int i=0; i<num_wps; i++) {
+      if(wps[i].controle == 0) continue;
+      escreve_wvr(i, wps[i].valor);
+      escreve_wcr(i, wps[i].controle);
+   }
+   isb();
+#endif
+}
+
+/**
+ * Desliga os breakpoints e watchpoints ao voltar para o PiCLIs.
+ */
+void hwdbg_disable(void) {
+#if CP14
+   for(int i=0; i<num_bps; i++) escreve_bcr(i, 0);
+   for(int i=0; i<num_wps; i++) escreve_wcr(i, 0);
+   isb();
+#endif
+}
+
+/**
+ * Identifica se um abort foi causado por uma exceção de depuração.
+ * @param abort_dados 1 para data abort, 0 para prefetch abort.
+ * @param addr Retorna o endereço observado (watchpoint), se conhecido.
+ * @return HWDBG_NENHUM, HWDBG_BKPT ou HWDBG_WATCH.
+ */
+int hwdbg_evento(int abort_dados, uint32_t *addr) {
+#if CP14
+   uint32_t fsr;
+   if(num_bps == 0) return HWDBG_NENHUM;
+   if(abort_dados) asm volatile ("mrc p15, 0, %0, c5, c0, 0" : "=r" (fsr));   // DFSR
+   else asm volatile ("mrc p15, 0, %0, c5, c0, 1" : "=r" (fsr));             // IFSR
+   if((fsr & 0x40f) != FS_DEBUG) return HWDBG_NENHUM;
+
+   uint32_t moe = DSCR_MOE(le_dscr());
+   if((moe == MOE_WATCH_SYNC) || (moe == MOE_WATCH_ASYNC)) {
+      /*
+       * O hardware não indica qual watchpoint disparou: com um único
+       * watchpoint ativo informa a área dele.
+       */
+      int n = -1;
+      for(int i=0; i<num_wps; i++) {
+         if(wps[i].controle == 0) continue;
+         n = (n < 0) ? i : MAX_HW;
+      }
+      *addr = ((n >= 0) && (n < MAX_HW)) ? wps[n].valor : 0;
+      return HWDBG_WATCH;
+   }
+   if(moe == MOE_BKPT) return HWDBG_BKPT;
+#endif
+   return HWDBG_NENHUM;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Tipos de watchpoint (mesma numeração dos pacotes Z2, Z3 e Z4 do gdb)
+ */
+#define HWDBG_ESCRITA        2
+#define HWDBG_LEITURA        3
+#define HWDBG_ACESSO         4
+
+/*
+ * Causa de uma parada por exceção de depuração
+ */
+#define HWDBG_NENHUM         0
+#define HWDBG_BKPT           1
+#define HWDBG_WATCH          2
+
+int hwdbg_init(void);
+int hwdbg_disponivel(void);
+int hwdbg_bkpt_add(uint32_t addr, uint32_t kind);
+int hwdbg_bkpt_remove(uint32_t addr);
+int hwdbg_bkpt_existe(uint32_t addr);
+int hwdbg_watch_add(uint32_t addr, uint32_t len, int tipo);
+int hwdbg_watch_remove(uint32_t addr, uint32_t len, int tipo);
+void hwdbg_enable(void);
+void hwdbg_disable(void);
+int hwdbg_evento(int abort_dados, uint32_t *addr);
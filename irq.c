@@ -0,0 +1,114 @@
+#include "bcm.h"
+#include "irq.h"
+
+#define FIQ_ENABLE           __bit(7)
+
+static irq_handler_t tratadores[IRQ_NUM_FONTES];
+static irq_handler_t tratador_fiq;
+
+/**
+ * Habilita ou desabilita uma fonte no controlador de interrupções.
+ */
+static void habilita(uint32_t fonte, int liga) {
+   uint32_t bit = __bit((fonte & 31));
+   if(fonte < 32) {
+      if(liga) IRQ_REG(enable_1) = bit;
+      else IRQ_REG(disable_1) = bit;
+   } else if(fonte < 64) {
+      if(liga) IRQ_REG(enable_2) = bit;
+      else IRQ_REG(disable_2) = bit;
+   } else {
+      if(liga) IRQ_REG(enable_basic) = bit;
+      else IRQ_REG(disable_basic) = bit;
+   }
+}
+
+/**
+ * Desabilita todas as fontes e a FIQ.
+ */
+void irq_init(void) {
+   IRQ_REG(fiq) = 0;
+   IRQ_REG(disable_1) = 0xffffffff;
+   IRQ_REG(disable_2) = 0xffffffff;
+   IRQ_REG(disable_basic) = 0xff;
+   for(int i=0; i<IRQ_NUM_FONTES; i++) tratadores[i] = 0;
+   tratador_fiq = 0;
+}
+
+/**
+ * Registra o tratador de uma fonte e a habilita.
+ * @param fonte Fonte (IRQ_...).
+ * @param h Tratador.
+ * @return 0 em caso de sucesso, -1 se a fonte for inválida.
+ */
+int irq_register(uint32_t fonte, irq_handler_t h) {
+   if((fonte >= IRQ_NUM_FONTES) || (h == 0)) return -1;
+   tratadores[fonte] = h;
+   habilita(fonte, 1);
+   return 0;
+}
+
+/**
+ * Desabilita uma fonte e remove o seu tratador.
+ * @param fonte Fonte (IRQ_...).
+ */
+void irq_unregister(uint32_t fonte) {
+   if(fonte >= IRQ_NUM_FONTES) return;
+   habilita(fonte, 0);
+   tratadores[fonte] = 0;
+}
+
+/**
+ * Encaminha uma fonte para a FIQ, que atende uma única fonte sem consultar
+ * os registradores de pendência e sem ser mascarada pelas seções críticas
+ * das IRQs (enable_irq). Substitui a fonte encaminhada anteriormente.
+ * @param fonte Fonte (IRQ_...), que deixa de gerar IRQ.
+ * @param h Tratador, executado no modo FIQ.
+ * @return 0 em caso de sucesso, -1 se a fonte for inválida.
+ */
+int irq_fiq(uint32_t fonte, irq_handler_t h) {
+   if((fonte >= IRQ_NUM_FONTES) || (h == 0)) return -1;
+   irq_fiq_stop();
+   irq_unregister(fonte);
+   tratador_fiq = h;
+   IRQ_REG(fiq) = FIQ_ENABLE | fonte;
+   enable_fiq(1);
+   return 0;
+}
+
+/**
+ * Desliga a FIQ.
+ */
+void irq_fiq_stop(void) {
+   IRQ_REG(fiq) = 0;
+   tratador_fiq = 0;
+}
+
+/**
+ * Processa as interrupções ativas, chamando o tratador de cada fonte
+ * pendente (chamada por boot.s no modo IRQ).
+ * @return 1 se algum tratador pediu a interrupção do programa do usuário.
+ */
+uint32_t trata_irq(void) {
+   uint32_t pend[3], brk = 0;
+   pend[0] = IRQ_REG(pending_1);
+   pend[1] = IRQ_REG(pending_2);
+   pend[2] = IRQ_REG(pending_basic) & 0xff;
+   for(int r=0; r<3; r++) {
+      while(pend[r]) {
+         uint32_t b = __builtin_ctz(pend[r]);
+         irq_handler_t h = tratadores[32 * r + b];
+         pend[r] &= pend[r] - 1;
+         if(h) brk |= h();
+      }
+   }
+   return brk;
+}
+
+/**
+ * Atende a FIQ (chamada por boot.s no modo FIQ).
+ */
+void trata_fiq(void) {
+   irq_handler_t h = tratador_fiq;
+   if(h) h();
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Fontes de interrupção, na numeração do registrador de FIQ: 0 a 63 são
+ * as interrupções dos periféricos (pending_1 e pending_2) e 64 a 71 as do
+ * ARM (bits 0 a 7 de pending_basic).
+ */
+#define IRQ_NUM_FONTES       72
+#define IRQ_SYSTIMER(N)      (N)          // canais de comparação 0 a 3
+#define IRQ_DMA(N)           (16 + (N))   // canais 0 a 12
+#define IRQ_AUX              29           // mini UART
+#define IRQ_GPIO(N)          (49 + (N))   // bancos 0 e 1 (3 = qualquer banco)
+#define IRQ_PL011            57
+#define IRQ_ARM_TIMER        64
+
+/*
+ * Tratador de uma fonte. Retorna 1 para interromper o programa do usuário
+ * (^C recebido pela uart), 0 nos demais casos. O retorno do tratador da
+ * FIQ é ignorado.
+ */
+typedef uint32_t (*irq_handler_t)(void);
+
+void irq_init(void);
+int irq_register(uint32_t fonte, irq_handler_t h);
+void irq_unregister(uint32_t fonte);
+int irq_fiq(uint32_t fonte, irq_handler_t h);
+void irq_fiq_stop(void);
+uint32_t trata_irq(void);
+void trata_fiq(void);
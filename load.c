@@ -0,0 +1,208 @@
+#include "uart.h"
+#include "timer.h"
+#include "hex.h"
+#include "checksum.h"
+#include "load.h"
+
+/*
+ * Os dados são retirados do buffer de recepção (preenchido pela interrupção
+ * da uart) em blocos de LOAD_BLOCO bytes e interpretados enquanto os
+ * seguintes chegam; os registros são gravados depois de conferido o checksum.
+ */
+#define CTRL_C               0x03
+#define LOAD_BLOCO           256
+#define TIMEOUT_LOAD         10000000     // us sem dados antes de desistir
+#define TIMEOUT_DESCARTE     200000       // silêncio que encerra o descarte após um erro
+
+#define REG_DADOS            0x00
+#define REG_FIM              0x01
+#define REG_SEGMENTO         0x02
+#define REG_INICIO_SEGMENTO  0x03
+#define REG_LINEAR           0x04
+#define REG_INICIO_LINEAR    0x05
+
+extern uint8_t piclis_fim[];
+
+static uint8_t bloco[LOAD_BLOCO];
+static uint8_t registro[5 + 255];          // tamanho, endereço, tipo, dados, checksum
+
+/**
+ * Descarta o que ainda chegar depois de um erro, até um intervalo de silêncio.
+ */
+static void descarta_resto(void) {
+   uint32_t prazo = timer_deadline(TIMEOUT_DESCARTE);
+   while(!timer_expired(prazo)) {
+      if(uart_try_read(bloco, LOAD_BLOCO)) prazo = timer_deadline(TIMEOUT_DESCARTE);
+   }
+}
+
+/**
+ * Verifica se uma área pode ser gravada (fora do vetor de interrupções e do PiCLIs).
+ */
+static int area_livre(uint32_t a, uint32_t s) {
+   return (a >= (uint32_t)piclis_fim) && (a + s >= a);
+}
+
+static void grava(load_info_t *info, uint32_t a, const uint8_t *d, uint32_t s) {
+   uint8_t *p = (uint8_t*)a;
+   for(uint32_t i=0; i<s; i++) p[i] = d[i];
+   info->crc = crc32(info->crc, d, s);
+   if(info->bytes == 0) {
+      info->inicio = a;
+      info->fim = a + s;
+   } else {
+      if(a < info->inicio) info->inicio = a;
+      if(a + s > info->fim) info->fim = a + s;
+   }
+   info->bytes += s;
+}
+
+static void inicia(load_info_t *info) {
+   info->bytes = 0;
+   info->registros = 0;
+   info->inicio = info->fim = 0;
+   info->crc = 0;
+   info->entrada = 0;
+   info->tem_entrada = 0;
+}
+
+/**
+ * Executa um registro completo (checksum já conferido).
+ * @param base Endereço base dos registros de dados (registros 02 e 04).
+ * @return LOAD_OK, erro, ou 1 no registro de fim.
+ */
+static int executa(load_info_t *info, uint32_t *base) {
+   uint32_t n = registro[0];
+   uint32_t a = (registro[1] << 8) | registro[2];
+   uint8_t *d = registro + 4;
+
+   switch(registro[3]) {
+      case REG_DADOS:
+         a += *base;
+         if(!area_livre(a, n)) return LOAD_ENDERECO;
+         grava(info, a, d, n);
+         return LOAD_OK;
+      case REG_FIM:
+         return 1;
+      case REG_SEGMENTO:
+         if(n != 2) return LOAD_FORMATO;
+         *base = ((d[0] << 8) | d[1]) << 4;
+         return LOAD_OK;
+      case REG_LINEAR:
+         if(n != 2) return LOAD_FORMATO;
+         *base = ((d[0] << 8) | d[1]) << 16;
+         return LOAD_OK;
+      case REG_INICIO_SEGMENTO:
+         if(n != 4) return LOAD_FORMATO;
+         info->entrada = (((d[0] << 8) | d[1]) << 4) + ((d[2] << 8) | d[3]);
+         info->tem_entrada = 1;
+         return LOAD_OK;
+      case REG_INICIO_LINEAR:
+         if(n != 4) return LOAD_FORMATO;
+         info->entrada = (d[0] << 24) | (d[1] << 16) | (d[2] << 8) | d[3];
+         info->tem_entrada = 1;
+         return LOAD_OK;
+   }
+   return LOAD_FORMATO;
+}
+
+/**
+ * Recebe registros Intel HEX até o registro de fim, gravando os dados na
+ * memória. Espaços e quebras de linha entre registros são ignorados.
+ * Após um erro, o restante da transmissão é descartado.
+ * @param info Recebe o resumo da carga.
+ * @return LOAD_OK ou o erro (LOAD_CHECKSUM, LOAD_FORMATO, ...).
+ */
+int load_hex(load_info_t *info) {
+   uint32_t base = 0, pos = 0, tam = 0, soma = 0;
+   int em_registro = 0, alto = -1, res = LOAD_OK;
+   uint32_t prazo = timer_deadline(TIMEOUT_LOAD);
+
+   inicia(info);
+   for(;;) {
+      uint32_t n = uart_try_read(bloco, LOAD_BLOCO);
+      if(n == 0) {
+         if(timer_expired(prazo)) return LOAD_TIMEOUT;
+         continue;
+      }
+      prazo = timer_deadline(TIMEOUT_LOAD);
+
+      for(uint32_t i=0; i<n; i++) {
+         char c = bloco[i];
+         if(c == CTRL_C) return LOAD_CANCELADO;
+         if(!em_registro) {
+            if(c == ':') {
+               em_registro = 1;
+               pos = soma = 0;
+               tam = 5;                         // atualizado com o campo de tamanho
+               alto = -1;
+            } else if((c != '\r') && (c != '\n') && (c != ' ') && (c != '\t')) {
+               res = LOAD_FORMATO;
+               break;
+            }
+            continue;
+         }
+
+         int v = hex_value(c);
+         if(v < 0) {
+            res = LOAD_FORMATO;
+            break;
+         }
+         if(alto < 0) {
+            alto = v;
+            continue;
+         }
+         registro[pos] = (alto << 4) | v;
+         soma += registro[pos];
+         alto = -1;
+         if(pos++ == 0) tam = registro[0] + 5;
+         if(pos < tam) continue;
+
+         em_registro = 0;
+         if(soma & 0xff) {
+            res = LOAD_CHECKSUM;
+            break;
+         }
+         res = executa(info, &base);
+         if(res < 0) break;
+         info->registros++;
+         if(res == 1) break;
+      }
+      if(res == 1) return LOAD_OK;
+      if(res != LOAD_OK) {
+         descarta_resto();
+         return res;
+      }
+   }
+}
+
+/**
+ * Recebe uma imagem binária diretamente na memória.
+ * @param info Recebe o resumo da carga.
+ * @param a Endereço de destino.
+ * @param s Tamanho da imagem.
+ * @return LOAD_OK ou o erro.
+ */
+int load_bin(load_info_t *info, uint8_t *a, uint32_t s) {
+   uint32_t i = 0;
+   uint32_t prazo = timer_deadline(TIMEOUT_LOAD);
+
+   inicia(info);
+   if(!area_livre((uint32_t)a, s)) return LOAD_ENDERECO;
+   while(i < s) {
+      uint32_t n = uart_try_read(a + i, s - i);
+      if(n == 0) {
+         if(timer_expired(prazo)) return LOAD_TIMEOUT;
+         continue;
+      }
+      i += n;
+      prazo = timer_deadline(TIMEOUT_LOAD);
+   }
+   info->registros = 1;
+   info->bytes = s;
+   info->inicio = (uint32_t)a;
+   info->fim = (uint32_t)a + s;
+   info->crc = crc32(0, a, s);
+   info->entrada = (uint32_t)a;
+   return LOAD_OK;
+}
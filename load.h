@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Carga de programas pela uart: registros Intel HEX (tipos 00 a 05) ou
+ * uma imagem binária de tamanho conhecido, gravados à medida que chegam.
+ */
+#define LOAD_OK              0
+#define LOAD_CHECKSUM        -1           // checksum de um registro
+#define LOAD_FORMATO         -2           // caractere ou registro inválido
+#define LOAD_ENDERECO        -3           // área sobre o PiCLIs
+#define LOAD_TIMEOUT         -4           // sem dados no prazo
+#define LOAD_CANCELADO       -5           // ^C
+
+typedef struct {
+   uint32_t bytes;                        // bytes gravados
+   uint32_t registros;                    // registros processados
+   uint32_t inicio, fim;                  // menor e maior (+ 1) endereço gravado
+   uint32_t crc;                          // crc32 dos dados na ordem de chegada
+   uint32_t entrada;                      // ponto de entrada
+   int tem_entrada;                       // registro 03 ou 05 recebido
+} load_info_t;
+
+int load_hex(load_info_t *info);
+int load_bin(load_info_t *info, uint8_t *a, uint32_t s);
@@ -0,0 +1,131 @@
+#include "lz.h"
+
+#define LITERAIS_MAX         128
+#define REPETICAO_MIN        4
+#define REPETICAO_MAX        (0x3fff + REPETICAO_MIN)
+#define COPIA_MIN            3
+#define COPIA_MAX            (0x0f + COPIA_MIN)
+
+/*
+ * Última posição (+ 1) de cada sequência de 3 bytes, pelo hash.
+ */
+#define HASH_BITS            8
+static uint16_t ultima[1 << HASH_BITS];
+
+static uint32_t hash3(const uint8_t *p) {
+   return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/**
+ * Copia os literais pendentes para a saída.
+ * @return Nova posição na saída, ou -1 se não couber.
+ */
+static int32_t literais(uint8_t *dst, int32_t o, uint32_t max, const uint8_t *src, uint32_t n) {
+   while(n) {
+      uint32_t k = (n > LITERAIS_MAX) ? LITERAIS_MAX : n;
+      if(o + 1 + k > max) return -1;
+      dst[o++] = k - 1;
+      for(uint32_t i=0; i<k; i++) dst[o++] = *src++;
+      n -= k;
+   }
+   return o;
+}
+
+/**
+ * Comprime um bloco.
+ * @param dst Saída.
+ * @param max Tamanho da saída.
+ * @param src Bloco a comprimir.
+ * @param n Tamanho do bloco (até LZ_MAX_BLOCO).
+ * @return Tamanho comprimido, ou 0 se não couber em max bytes.
+ */
+uint32_t lz_encode(uint8_t *dst, uint32_t max, const uint8_t *src, uint32_t n) {
+   uint32_t i = 0, lit = 0;
+   int32_t o = 0;
+
+   if((n == 0) || (n > LZ_MAX_BLOCO)) return 0;
+   for(int h=0; h<(1 << HASH_BITS); h++) ultima[h] = 0;
+
+   while(i < n) {
+      /*
+       * Repetição do mesmo byte (sequências de zeros, preenchimentos)
+       */
+      uint32_t r = 1;
+      while((i + r < n) && (r < REPETICAO_MAX) && (src[i + r] == src[i])) r++;
+      if(r >= REPETICAO_MIN) {
+         if((o = literais(dst, o, max, src + lit, i - lit)) < 0) return 0;
+         if(o + 3 > max) return 0;
+         dst[o++] = 0x80 | ((r - REPETICAO_MIN) >> 8);
+         dst[o++] = r - REPETICAO_MIN;
+         dst[o++] = src[i];
+         i += r;
+         lit = i;
+         continue;
+      }
+
+      /*
+       * Cópia de uma sequência anterior (palavras e estruturas repetidas)
+       */
+      if(i + COPIA_MIN <= n) {
+         uint32_t h = hash3(src + i);
+         uint32_t p = ultima[h];
+         ultima[h] = i + 1;
+         if(p && (i - (p - 1) <= LZ_JANELA)) {
+            p--;
+            uint32_t len = 0;
+            while((len < COPIA_MAX) && (i + len < n) && (src[p + len] == src[i + len])) len++;
+            if(len >= COPIA_MIN) {
+               uint32_t d = i - p - 1;
+               if((o = literais(dst, o, max, src + lit, i - lit)) < 0) return 0;
+               if(o + 2 > max) return 0;
+               dst[o++] = 0xc0 | ((len - COPIA_MIN) << 2) | (d >> 8);
+               dst[o++] = d;
+               i += len;
+               lit = i;
+               continue;
+            }
+         }
+      }
+      i++;
+   }
+   o = literais(dst, o, max, src + lit, n - lit);
+   return (o < 0) ? 0 : o;
+}
+
+/**
+ * Descomprime um bloco.
+ * @param dst Saída.
+ * @param max Tamanho da saída.
+ * @param src Bloco comprimido.
+ * @param n Tamanho do bloco comprimido.
+ * @return Tamanho descomprimido, ou -1 se o bloco for inválido.
+ */
+int32_t lz_decode(uint8_t *dst, uint32_t max, const uint8_t *src, uint32_t n) {
+   uint32_t i = 0, o = 0;
+
+   while(i < n) {
+      uint8_t t = src[i++];
+      if(t < 0x80) {                                // literais
+         uint32_t k = t + 1;
+         if((i + k > n) || (o + k > max)) return -1;
+         while(k--) dst[o++] = src[i++];
+      } else if(t < 0xc0) {                         // repetição
+         if(i + 2 > n) return -1;
+         uint32_t k = (((t & 0x3f) << 8) | src[i]) + REPETICAO_MIN;
+         uint8_t v = src[i + 1];
+         i += 2;
+         if(o + k > max) return -1;
+         while(k--) dst[o++] = v;
+      } else {                                      // cópia
+         if(i + 1 > n) return -1;
+         uint32_t k = ((t >> 2) & 0x0f) + COPIA_MIN;
+         uint32_t d = (((t & 3) << 8) | src[i++]) + 1;
+         if((d > o) || (o + k > max)) return -1;
+         while(k--) {
+            dst[o] = dst[o - d];
+            o++;
+         }
+      }
+   }
+   return o;
+}
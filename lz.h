@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Compressão de blocos de memória (sequências de bytes repetidos e
+ * referências a até LZ_JANELA bytes anteriores do mesmo bloco).
+ * Cada bloco é independente. Formato, por símbolo:
+ *   0xxxxxxx                 literais: os (x + 1) bytes seguintes
+ *   10nnnnnn nnnnnnnn v      repetição: (n + 4) vezes o byte v
+ *   11lllldd dddddddd        cópia: (l + 3) bytes a partir de (d + 1)
+ *                            bytes antes da posição atual
+ */
+#define LZ_JANELA            1024
+#define LZ_MAX_BLOCO         65535
+
+uint32_t lz_encode(uint8_t *dst, uint32_t max, const uint8_t *src, uint32_t n);
+int32_t lz_decode(uint8_t *dst, uint32_t max, const uint8_t *src, uint32_t n);
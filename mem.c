@@ -0,0 +1,226 @@
+#include "mem.h"
+
+/*
+ * Operações sobre blocos de memória. O trecho alinhado é transferido em
+ * rajadas de ldm/stm de 8 registradores (32 bytes, meia linha de cache),
+ * e apenas as pontas desalinhadas são tratadas byte a byte.
+ */
+#define RAJADA               32           // bytes por ldm/stm
+#define BLOCO_CMP            16           // bytes comparados por vez
+
+/**
+ * Grava n rajadas com a mesma palavra.
+ */
+static void preenche_rajadas(uint32_t *p, uint32_t v, uint32_t n) {
+#if HOST
+   while(n--) {
+      for(int i=0; i<RAJADA/4; i++) *p++ = v;
+   }
+#else
+   asm volatile (
+      "   mov r3, %2              \n\t"
+      "   mov r4, %2              \n\t"
+      "   mov r5, %2              \n\t"
+      "   mov r6, %2              \n\t"
+      "   mov r7, %2              \n\t"
+      "   mov r8, %2              \n\t"
+      "   mov r9, %2              \n\t"
+      "   mov r10, %2             \n\t"
+      "1: stmia %0!, {r3-r10}     \n\t"
+      "   subs %1, %1, #1         \n\t"
+      "   bne 1b                  \n\t"
+      : "+r" (p), "+r" (n)
+      : "r" (v)
+      : "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10", "cc", "memory");
+#endif
+}
+
+/**
+ * Copia n rajadas em ordem crescente de endereços.
+ */
+static void copia_rajadas(uint32_t *d, const uint32_t *s, uint32_t n) {
+#if HOST
+   while(n--) {
+      for(int i=0; i<RAJADA/4; i++) *d++ = *s++;
+   }
+#else
+   asm volatile (
+      "1: ldmia %1!, {r3-r10}     \n\t"
+      "   stmia %0!, {r3-r10}     \n\t"
+      "   subs %2, %2, #1         \n\t"
+      "   bne 1b                  \n\t"
+      : "+r" (d), "+r" (s), "+r" (n)
+      :
+      : "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10", "cc", "memory");
+#endif
+}
+
+/**
+ * Copia n rajadas em ordem decrescente; d e s apontam para o fim das áreas.
+ */
+static void copia_rajadas_desc(uint32_t *d, const uint32_t *s, uint32_t n) {
+#if HOST
+   while(n--) {
+      for(int i=0; i<RAJADA/4; i++) *--d = *--s;
+   }
+#else
+   asm volatile (
+      "1: ldmdb %1!, {r3-r10}     \n\t"
+      "   stmdb %0!, {r3-r10}     \n\t"
+      "   subs %2, %2, #1         \n\t"
+      "   bne 1b                  \n\t"
+      : "+r" (d), "+r" (s), "+r" (n)
+      :
+      : "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10", "cc", "memory");
+#endif
+}
+
+/**
+ * Avança sobre os blocos iguais das duas áreas.
+ * @return Blocos restantes a partir do primeiro diferente (0 se todos são iguais).
+ *         Os ponteiros ficam no bloco diferente.
+ */
+static uint32_t pula_iguais(const uint32_t **a, const uint32_t **b, uint32_t n) {
+   const uint32_t *pa = *a, *pb = *b;
+#if HOST
+   while(n) {
+      if((pa[0] != pb[0]) || (pa[1] != pb[1]) || (pa[2] != pb[2]) || (pa[3] != pb[3])) break;
+      pa += BLOCO_CMP/4;
+      pb += BLOCO_CMP/4;
+      n--;
+   }
+#else
+   asm volatile (
+      "1: ldmia %0, {r3-r6}       \n\t"
+      "   ldmia %1, {r7-r10}      \n\t"
+      "   cmp r3, r7              \n\t"
+      "   cmpeq r4, r8            \n\t"
+      "   cmpeq r5, r9            \n\t"
+      "   cmpeq r6, r10           \n\t"
+      "   bne 2f                  \n\t"
+      "   add %0, %0, #16         \n\t"
+      "   add %1, %1, #16         \n\t"
+      "   subs %2, %2, #1         \n\t"
+      "   bne 1b                  \n\t"
+      "2:                         \n\t"
+      : "+r" (pa), "+r" (pb), "+r" (n)
+      :
+      : "r3", "r4", "r5", "r6", "r7", "r8", "r9", "r10", "cc", "memory");
+#endif
+   *a = pa;
+   *b = pb;
+   return n;
+}
+
+/**
+ * Preenche uma área repetindo uma palavra.
+ * @param dst Endereço inicial (qualquer alinhamento).
+ * @param pattern Bytes do padrão na ordem da memória: o byte de dst + i é o
+ *                byte (i % 4) da palavra (little-endian).
+ * @param len Tamanho em bytes.
+ */
+void mem_fill(void *dst, uint32_t pattern, uint32_t len) {
+   uint8_t *d = (uint8_t*)dst;
+   uint32_t i = 0;
+
+   while((i < len) && ((uint32_t)(d + i) & 3)) {
+      d[i] = pattern >> (8 * (i & 3));
+      i++;
+   }
+   uint32_t rot = 8 * (i & 3);                // fase do padrão no trecho alinhado
+   uint32_t v = rot ? ((pattern >> rot) | (pattern << (32 - rot))) : pattern;
+   uint32_t n = (len - i) / RAJADA;
+   if(n) {
+      preenche_rajadas((uint32_t*)(d + i), v, n);
+      i += n * RAJADA;
+   }
+   for(; i<len; i++) d[i] = pattern >> (8 * (i & 3));
+}
+
+/**
+ * Copia uma área de memória (as áreas podem se sobrepor).
+ * @param dst Destino.
+ * @param src Origem.
+ * @param len Tamanho em bytes.
+ */
+void mem_copy(void *dst, const void *src, uint32_t len) {
+   uint8_t *d = (uint8_t*)dst;
+   const uint8_t *s = (const uint8_t*)src;
+   int rajadas = (((uint32_t)d ^ (uint32_t)s) & 3) == 0;
+
+   if((d == s) || (len == 0)) return;
+   if((d < s) || (d >= s + len)) {
+      uint32_t i = 0;
+      if(rajadas) {
+         while((i < len) && ((uint32_t)(d + i) & 3)) {
+            d[i] = s[i];
+            i++;
+         }
+         uint32_t n = (len - i) / RAJADA;
+         if(n) {
+            copia_rajadas((uint32_t*)(d + i), (const uint32_t*)(s + i), n);
+            i += n * RAJADA;
+         }
+      }
+      for(; i<len; i++) d[i] = s[i];
+      return;
+   }
+
+   /*
+    * Destino sobre o fim da origem: copia do fim para o início.
+    */
+   uint32_t i = len;
+   if(rajadas) {
+      while(i && ((uint32_t)(d + i) & 3)) {
+         i--;
+         d[i] = s[i];
+      }
+      uint32_t n = i / RAJADA;
+      if(n) {
+         copia_rajadas_desc((uint32_t*)(d + i), (const uint32_t*)(s + i), n);
+         i -= n * RAJADA;
+      }
+   }
+   while(i) {
+      i--;
+      d[i] = s[i];
+   }
+}
+
+/**
+ * Compara duas áreas de memória.
+ * @param a Primeira área.
+ * @param b Segunda área.
+ * @param len Tamanho em bytes.
+ * @param primeira Recebe a posição (a partir do início) do primeiro byte
+ *                 diferente, se houver.
+ * @return Quantidade de bytes diferentes.
+ */
+uint32_t mem_cmp(const void *a, const void *b, uint32_t len, uint32_t *primeira) {
+   const uint8_t *pa = (const uint8_t*)a, *pb = (const uint8_t*)b;
+   uint32_t difs = 0, i = 0;
+
+#define CONFERE(I)                                       \
+   if(pa[I] != pb[I]) {                                  \
+      if(difs++ == 0) *primeira = (I);                   \
+   }
+
+   if((((uint32_t)pa ^ (uint32_t)pb) & 3) == 0) {
+      while((i < len) && ((uint32_t)(pa + i) & 3)) {
+         CONFERE(i);
+         i++;
+      }
+      uint32_t n = (len - i) / BLOCO_CMP;
+      while(n) {
+         const uint32_t *wa = (const uint32_t*)(pa + i), *wb = (const uint32_t*)(pb + i);
+         uint32_t resto = pula_iguais(&wa, &wb, n);
+         i += (n - resto) * BLOCO_CMP;
+         if(resto == 0) break;
+         for(uint32_t k=0; k<BLOCO_CMP; k++, i++) CONFERE(i);
+         n = resto - 1;
+      }
+   }
+   for(; i<len; i++) CONFERE(i);
+#undef CONFERE
+   return difs;
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+
+void mem_fill(void *dst, uint32_t pattern, uint32_t len);
+void mem_copy(void *dst, const void *src, uint32_t len);
+uint32_t mem_cmp(const void *a, const void *b, uint32_t len, uint32_t *primeira);
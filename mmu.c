@@ -0,0 +1,159 @@
+#include "bcm.h"
+#include "mmu.h"
+
+#ifndef CACHE
+#define CACHE 1
+#endif
+
+/*
+ * Descritores de seção (1 MiB) da tabela de primeiro nível.
+ */
+#define SECAO                0x02
+#define SECAO_B              __bit(2)
+#define SECAO_C              __bit(3)
+#define SECAO_XN             __bit(4)
+#define SECAO_AP_RW          (3 << 10)
+#define SECAO_TEX(X)         ((X) << 12)
+#define SECAO_S              __bit(16)
+
+/*
+ * RAM: normal, write-back com write-allocate (compartilhável entre os núcleos).
+ * Periféricos: device, sem execução.
+ * No ARM1176 memória normal compartilhável não usa o cache, por isso o bit S
+ * é usado apenas no Cortex-A7.
+ */
+#if RPICPU == 2
+#define MEM_NORMAL           (SECAO | SECAO_AP_RW | SECAO_TEX(1) | SECAO_C | SECAO_B | SECAO_S)
+#define TTBR_ATRIB           0x4a         // tabela em memória cacheável, compartilhável
+#define LINHA_CACHE          64
+#else
+#define MEM_NORMAL           (SECAO | SECAO_AP_RW | SECAO_TEX(1) | SECAO_C | SECAO_B)
+#define TTBR_ATRIB           0x00
+#define LINHA_CACHE          32
+#endif
+#define MEM_DEVICE           (SECAO | SECAO_AP_RW | SECAO_B | SECAO_XN)
+
+/*
+ * Bits do registrador SCTLR
+ */
+#define SCTLR_M              __bit(0)     // MMU
+#define SCTLR_C              __bit(2)     // cache de dados
+#define SCTLR_Z              __bit(11)    // previsão de desvios
+#define SCTLR_I              __bit(12)    // cache de instruções
+#define SCTLR_XP             __bit(23)    // formato de descritores ARMv6
+
+static uint32_t tabela[4096] __attribute__((aligned(16384)));
+
+/**
+ * Monta a tabela de páginas com mapeamento identidade e habilita MMU e caches.
+ * Chamada por boot.s antes de main.
+ */
+void mmu_init(void) {
+   for(uint32_t i=0; i<4096; i++) {
+      uint32_t addr = i << 20;
+      tabela[i] = addr | ((addr < PERIPH_BASE) ? MEM_NORMAL : MEM_DEVICE);
+   }
+   mmu_enable();
+}
+
+/**
+ * Habilita MMU, caches e previsão de desvios no núcleo atual usando
+ * a tabela montada por mmu_init.
+ */
+void mmu_enable(void) {
+   uint32_t r;
+#if RPICPU == 2
+   asm volatile ("mrc p15, 0, %0, c1, c0, 1" : "=r" (r));
+   r |= __bit(6);                                          // SMP: coerência entre núcleos
+   asm volatile ("mcr p15, 0, %0, c1, c0, 1" :: "r" (r));
+#endif
+   asm volatile ("mcr p15, 0, %0, c8, c7, 0" :: "r" (0));  // invalida TLBs
+   asm volatile ("mcr p15, 0, %0, c2, c0, 2" :: "r" (0));  // TTBCR: só TTBR0
+   asm volatile ("mcr p15, 0, %0, c2, c0, 0" :: "r" ((uint32_t)tabela | TTBR_ATRIB));
+   asm volatile ("mcr p15, 0, %0, c3, c0, 0" :: "r" (0x55555555));  // domínios: cliente
+   dsb();
+   isb();
+
+   asm volatile ("mrc p15, 0, %0, c1, c0, 0" : "=r" (r));
+   r |= SCTLR_M | SCTLR_C | SCTLR_I | SCTLR_Z;
+#if RPICPU != 2
+   r |= SCTLR_XP;
+#endif
+   asm volatile ("mcr p15, 0, %0, c1, c0, 0" :: "r" (r));
+   isb();
+}
+
+/**
+ * Grava na memória as linhas modificadas do cache (antes de uma leitura
+ * por DMA).
+ * @param a Endereço inicial.
+ * @param n Tamanho em bytes.
+ */
+void cache_clean(const void *a, uint32_t n) {
+#if CACHE
+   uint32_t p = (uint32_t)a & ~(LINHA_CACHE - 1);
+   uint32_t fim = (uint32_t)a + n;
+   for(; p < fim; p += LINHA_CACHE) {
+      asm volatile ("mcr p15, 0, %0, c7, c10, 1" :: "r" (p));
+   }
+   dsb();
+#endif
+}
+
+/**
+ * Grava e descarta do cache as linhas de uma área de memória.
+ * @param a Endereço inicial.
+ * @param n Tamanho em bytes.
+ */
+void cache_flush(const void *a, uint32_t n) {
+#if CACHE
+   uint32_t p = (uint32_t)a & ~(LINHA_CACHE - 1);
+   uint32_t fim = (uint32_t)a + n;
+   for(; p < fim; p += LINHA_CACHE) {
+      asm volatile ("mcr p15, 0, %0, c7, c14, 1" :: "r" (p));
+   }
+   dsb();
+#endif
+}
+
+/**
+ * Descarta do cache as linhas de uma área de memória (após uma escrita por DMA).
+ * Linhas parcialmente ocupadas nas extremidades são gravadas antes.
+ * @param a Endereço inicial.
+ * @param n Tamanho em bytes.
+ */
+void cache_invalidate(void *a, uint32_t n) {
+#if CACHE
+   uint32_t p = (uint32_t)a;
+   uint32_t fim = p + n;
+   if(n == 0) return;
+   if(p & (LINHA_CACHE - 1)) {
+      cache_flush((void*)p, 1);
+      p = (p & ~(LINHA_CACHE - 1)) + LINHA_CACHE;
+   }
+   if(fim & (LINHA_CACHE - 1)) {
+      cache_flush((void*)fim, 1);
+      fim &= ~(LINHA_CACHE - 1);
+   }
+   for(; p < fim; p += LINHA_CACHE) {
+      asm volatile ("mcr p15, 0, %0, c7, c6, 1" :: "r" (p));
+   }
+   dsb();
+#endif
+}
+
+/**
+ * Torna visíveis para a busca de instruções os dados escritos em uma área
+ * (código carregado ou instruções de trap).
+ * @param a Endereço inicial.
+ * @param n Tamanho em bytes.
+ */
+void cache_sync_code(const void *a, uint32_t n) {
+#if CACHE
+   cache_clean(a, n);
+   asm volatile ("mcr p15, 0, %0, c7, c5, 0" :: "r" (0));  // invalida cache de instruções
+   asm volatile ("mcr p15, 0, %0, c7, c5, 6" :: "r" (0));  // invalida previsão de desvios
+   dsb();
+   isb();
+#endif
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Barreiras de memória
+ */
+#if HOST
+#define dsb()   __sync_synchronize()
+#define dmb()   __sync_synchronize()
+#define isb()   __sync_synchronize()
+#elif RPICPU == 2
+#define dsb()   asm volatile ("dsb" ::: "memory")
+#define dmb()   asm volatile ("dmb" ::: "memory")
+#define isb()   asm volatile ("isb" ::: "memory")
+#else
+#define dsb()   asm volatile ("mcr p15, 0, %0, c7, c10, 4" :: "r" (0) : "memory")
+#define dmb()   asm volatile ("mcr p15, 0, %0, c7, c10, 5" :: "r" (0) : "memory")
+#define isb()   asm volatile ("mcr p15, 0, %0, c7, c5, 4" :: "r" (0) : "memory")
+#endif
+
+void mmu_init(void);
+void mmu_enable(void);
+void cache_clean(const void *a, uint32_t n);
+void cache_invalidate(void *a, uint32_t n);
+void cache_flush(const void *a, uint32_t n);
+void cache_sync_code(const void *a, uint32_t n);
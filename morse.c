@@ -0,0 +1,193 @@
+#include "bcm.h"
+#include "gpio.h"
+#include "morse.h"
+#include "timer.h"
+#include "irq.h"
+
+/*
+ * Fila de caracteres a transmitir (tamanho potência de 2).
+ */
+#define FILA_SIZE            1024
+
+/*
+ * Canal de comparação do system timer usado pela reprodução
+ * (os canais 0 e 2 são usados pela GPU).
+ */
+#define TIMER_CANAL          1
+
+/*
+ * Alfabeto codificado: bits 7-5 = número de elementos,
+ * bits 4-0 = elementos, do primeiro (bit 0) ao último (1 = traço).
+ */
+static const uint8_t tabela_digitos[10] = {
+   0xbf, 0xbe, 0xbc, 0xb8, 0xb0, 0xa0, 0xa1, 0xa3, 0xa7, 0xaf,   // 0 a 9
+};
+static const uint8_t tabela_letras[26] = {
+   0x42, 0x81, 0x85, 0x61, 0x20, 0x84, 0x63, 0x80, 0x40, 0x8e, 0x65, 0x82, 0x43,   // A a M
+   0x41, 0x67, 0x86, 0x8b, 0x62, 0x60, 0x21, 0x64, 0x88, 0x66, 0x89, 0x8d, 0x83,   // N a Z
+};
+
+static uint8_t fila[FILA_SIZE];
+static volatile uint32_t fila_head, fila_tail;
+
+/*
+ * Estado da reprodução (alterado na interrupção do timer).
+ */
+static volatile uint8_t tocando;
+static uint8_t aceso;
+static uint8_t elementos;                 // elementos restantes no caractere atual
+static uint8_t codigo;                    // elementos restantes (bit 0 = próximo)
+static uint32_t alvo;                     // instante da próxima transição
+static uint32_t unidade_us;
+
+/**
+ * Codificação de um caractere.
+ * @param c Caractere alfanumérico.
+ * @return Código (ver tabelas acima) ou 0 se o caractere não tiver representação.
+ */
+uint8_t morse_code(char c) {
+   if((c >= '0') && (c <= '9')) return tabela_digitos[c - '0'];
+   if((c >= 'a') && (c <= 'z')) return tabela_letras[c - 'a'];
+   if((c >= 'A') && (c <= 'Z')) return tabela_letras[c - 'A'];
+   return 0;
+}
+
+/**
+ * Programa a próxima interrupção para dur microssegundos após a transição anterior.
+ */
+static void agenda(uint32_t dur) {
+   alvo += dur;
+   if(timer_expired(alvo - 10)) alvo = timer_deadline(10);
+   SYSTIMER_REG(c[TIMER_CANAL]) = alvo;
+}
+
+/**
+ * Inicializa a reprodução de código morse.
+ */
+void morse_init(void) {
+   fila_head = fila_tail = 0;
+   tocando = 0;
+   aceso = 0;
+   elementos = 0;
+   morse_set_wpm(MORSE_WPM_PADRAO);
+   SYSTIMER_REG(cs) = __bit(TIMER_CANAL);
+   irq_register(IRQ_SYSTIMER(TIMER_CANAL), morse_irq);
+}
+
+/**
+ * Define a velocidade de transmissão (unidade = 1200 ms / wpm).
+ * @param wpm Palavras por minuto.
+ */
+void morse_set_wpm(uint32_t wpm) {
+   if(wpm == 0) wpm = 1;
+   unidade_us = 1200000 / wpm;
+}
+
+/**
+ * Verifica se ainda há mensagens em reprodução.
+ */
+int morse_busy(void) {
+   return tocando;
+}
+
+/**
+ * Coloca uma mensagem na fila de reprodução e retorna imediatamente.
+ * Caracteres sem representação em morse são ignorados; mensagens
+ * consecutivas são separadas por um espaço entre palavras.
+ * @param msg Mensagem terminada em zero.
+ * @return 0 em caso de sucesso, -1 se a mensagem não couber na fila.
+ */
+int morse_send(const char *msg) {
+   uint32_t n = 0;
+   while(msg[n]) n++;
+   if(FILA_SIZE - (fila_head - fila_tail) < n + 1) return -1;
+
+   for(uint32_t i=0; i<n; i++) fila[(fila_head + i) & (FILA_SIZE-1)] = msg[i];
+   fila[(fila_head + n) & (FILA_SIZE-1)] = ' ';
+
+   uint32_t irq = (get_cpsr() & 0x80) == 0;
+   enable_irq(0);
+   fila_head += n + 1;
+   if(!tocando) {
+      tocando = 1;
+      alvo = timer_ticks();
+      agenda(10);
+   }
+   if(irq) enable_irq(1);
+   return 0;
+}
+
+/**
+ * Avança a reprodução: trata a interrupção do canal de comparação do timer.
+ * @return 0 (ver irq.h).
+ */
+uint32_t morse_irq(void) {
+   SYSTIMER_REG(cs) = __bit(TIMER_CANAL);
+   if(!tocando) return 0;
+
+   if(aceso) {
+      /*
+       * Fim de um ponto ou traço: espaço de 1 unidade entre elementos
+       * ou de 3 unidades entre caracteres.
+       */
+      gpio_put(MORSE_GPIO, 0);
+      aceso = 0;
+      agenda(elementos ? unidade_us : 3 * unidade_us);
+      return 0;
+   }
+
+   while(elementos == 0) {
+      if(fila_tail == fila_head) {
+         tocando = 0;
+         return 0;
+      }
+      char c = fila[fila_tail & (FILA_SIZE-1)];
+      fila_tail++;
+      if(c == ' ') {
+         agenda(4 * unidade_us);          // completa as 7 unidades entre palavras
+         return 0;
+      }
+      codigo = morse_code(c);
+      elementos = codigo >> 5;
+   }
+
+   gpio_put(MORSE_GPIO, 1);
+   aceso = 1;
+   agenda((codigo & 1) ? 3 * unidade_us : unidade_us);
+   codigo >>= 1;
+   elementos--;
+   return 0;
+}
+
+/**
+ * Converte uma mensagem em passos do gerador de formas de onda (wave.h),
+ * na velocidade atual. O último passo inclui o espaço entre palavras, de
+ * modo que a mensagem possa ser repetida.
+ * @param msg Mensagem terminada em zero.
+ * @param p Recebe os passos.
+ * @param max Tamanho de p.
+ * @return Quantidade de passos, ou -1 se não couberem em max.
+ */
+int morse_wave(const char *msg, wave_passo_t *p, uint32_t max) {
+   uint32_t n = 0;
+   for(; *msg; msg++) {
+      if(*msg == ' ') {
+         if(n) p[n - 1].us += 4 * unidade_us;
+         continue;
+      }
+      uint8_t c = morse_code(*msg);
+      for(int e=c>>5; e>0; e--, c>>=1) {
+         if(n + 2 > max) return -1;
+         p[n].mask = GPIO_BIT(MORSE_GPIO);
+         p[n].liga = 1;
+         p[n].us = (c & 1) ? 3 * unidade_us : unidade_us;
+         n++;
+         p[n].mask = GPIO_BIT(MORSE_GPIO);
+         p[n].liga = 0;
+         p[n].us = (e > 1) ? unidade_us : 3 * unidade_us;
+         n++;
+      }
+   }
+   if(n) p[n - 1].us += 4 * unidade_us;
+   return n;
+}
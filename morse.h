@@ -0,0 +1,14 @@
+#pragma once
+#include <stdint.h>
+#include "wave.h"
+
+#define MORSE_GPIO           47           // LED verde da placa
+#define MORSE_WPM_PADRAO     12
+
+void morse_init(void);
+int morse_send(const char *msg);
+void morse_set_wpm(uint32_t wpm);
+int morse_busy(void);
+uint8_t morse_code(char c);
+uint32_t morse_irq(void);
+int morse_wave(const char *msg, wave_passo_t *p, uint32_t max);
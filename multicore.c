@@ -0,0 +1,199 @@
+#include "bcm.h"
+#include "multicore.h"
+#include "mmu.h"
+#include "timer.h"
+
+#ifndef CACHE
+#define CACHE 1
+#endif
+
+/*
+ * Os núcleos secundários só são usados no BCM2836/7 com a MMU habilitada:
+ * ldrex/strex e a coerência entre os caches exigem memória normal
+ * compartilhável. Nos demais casos as tarefas executam no núcleo 0.
+ */
+#if (RPICPU == 2) && CACHE
+#define MULTICORE            1
+#define sev()                asm volatile ("sev" ::: "memory")
+#define wfe()                asm volatile ("wfe" ::: "memory")
+#else
+#define MULTICORE            0
+#endif
+
+#define TAM_MIN_BLOCO        4096         // bytes
+#define TIMEOUT_ONLINE       10000        // us para os núcleos secundários responderem
+
+static mc_job_t * volatile ativa;                     // tarefa visível aos núcleos secundários
+static volatile uint32_t em_uso[MC_MAX_NUCLEOS];      // núcleo acessando a tarefa ativa
+static volatile uint32_t online[MC_MAX_NUCLEOS];
+static volatile uint32_t executados[MC_MAX_NUCLEOS];  // blocos da última tarefa, por núcleo
+static int nucleos = 1;
+
+/**
+ * Retira e executa o próximo bloco de uma tarefa.
+ * Blocos de uma tarefa cancelada são retirados sem executar a função.
+ * @return 0 se não havia mais blocos.
+ */
+static int executa_bloco(mc_job_t *j, uint32_t nucleo) {
+   uint32_t i = __atomic_fetch_add(&j->proximo, 1, __ATOMIC_ACQ_REL);
+   if(i >= j->nblocos) return 0;
+
+   if(!j->cancelada) {
+      uint32_t tam = (i == j->nblocos - 1) ? j->tam - i * j->bloco : j->bloco;
+      j->func(j->ctx, i, j->inicio + i * j->bloco, tam);
+      executados[nucleo]++;
+   }
+   if(__atomic_add_fetch(&j->concluidos, 1, __ATOMIC_ACQ_REL) == j->nblocos) {
+      j->t_fim = timer_ticks();
+   }
+   return 1;
+}
+
+/**
+ * Deixa de publicar a tarefa ativa e espera que nenhum núcleo secundário
+ * ainda a esteja acessando.
+ */
+static void retira(void) {
+   ativa = 0;
+#if MULTICORE
+   dmb();
+   for(int n=1; n<MC_MAX_NUCLEOS; n++) {
+      while(em_uso[n]) ;
+   }
+#endif
+}
+
+#if MULTICORE
+/**
+ * Laço dos núcleos secundários, chamado por boot.s.
+ * Executa blocos da tarefa ativa; sem trabalho, dorme até o próximo evento.
+ * @param nucleo Índice do núcleo (1 a 3).
+ */
+void mc_secundario(uint32_t nucleo) {
+   online[nucleo] = 1;
+   dmb();
+
+   for(;;) {
+      int trabalhou = 0;
+      em_uso[nucleo] = 1;
+      dmb();                                 // em_uso visível antes de ler ativa
+      mc_job_t *j = ativa;
+      if(j) trabalhou = executa_bloco(j, nucleo);
+      dmb();
+      em_uso[nucleo] = 0;
+      if(!trabalhou) wfe();
+   }
+}
+#endif
+
+/**
+ * Libera os núcleos secundários pelo mailbox 3 de cada um.
+ * Deve ser chamada depois que a MMU do núcleo 0 estiver habilitada.
+ * @return Quantidade de núcleos disponíveis (incluindo o núcleo 0).
+ */
+int mc_init(void) {
+#if MULTICORE
+   extern void secundario(void);
+   for(int n=1; n<MC_MAX_NUCLEOS; n++) {
+      LOCAL_MBOX_SET(n, 3) = (uint32_t)secundario;
+   }
+   dsb();
+   sev();
+
+   uint32_t prazo = timer_deadline(TIMEOUT_ONLINE);
+   do {
+      nucleos = 1;
+      for(int n=1; n<MC_MAX_NUCLEOS; n++) nucleos += online[n];
+   } while((nucleos < MC_MAX_NUCLEOS) && !timer_expired(prazo));
+#endif
+   return nucleos;
+}
+
+/**
+ * Quantidade de núcleos que executam tarefas.
+ */
+int mc_nucleos(void) {
+   return nucleos;
+}
+
+/**
+ * Inicia uma tarefa: a área é dividida em até MC_MAX_BLOCOS blocos que os
+ * núcleos secundários executam em segundo plano. Sem núcleos secundários
+ * a tarefa é executada por completo antes de retornar.
+ * @param j Tarefa (deve permanecer válida até a conclusão).
+ * @param f Função executada em cada bloco.
+ * @param ctx Contexto passado à função.
+ * @param inicio Endereço inicial da área.
+ * @param tam Tamanho da área em bytes.
+ * @param alinhamento Tamanho dos blocos será múltiplo deste valor.
+ * @return 0 em caso de sucesso, -1 se outra tarefa estiver em execução.
+ */
+int mc_start(mc_job_t *j, mc_func_t f, void *ctx, uint32_t inicio, uint32_t tam, uint32_t alinhamento) {
+   mc_job_t *atual = ativa;
+   if(atual && !mc_done(atual)) return -1;
+   retira();
+
+   if(alinhamento == 0) alinhamento = 1;
+   uint32_t bloco = tam / MC_MAX_BLOCOS + 1;
+   if(bloco < TAM_MIN_BLOCO) bloco = TAM_MIN_BLOCO;
+   bloco = ((bloco + alinhamento - 1) / alinhamento) * alinhamento;
+
+   j->func = f;
+   j->ctx = ctx;
+   j->inicio = inicio;
+   j->tam = tam;
+   j->bloco = bloco;
+   j->nblocos = tam ? (tam - 1) / bloco + 1 : 0;
+   j->proximo = 0;
+   j->concluidos = 0;
+   j->cancelada = 0;
+   j->t_inicio = j->t_fim = timer_ticks();
+   for(int n=0; n<MC_MAX_NUCLEOS; n++) executados[n] = 0;
+
+   if(nucleos == 1) {
+      while(executa_bloco(j, 0)) ;
+      return 0;
+   }
+
+#if MULTICORE
+   dmb();                                    // tarefa completa antes de publicar
+   ativa = j;
+   dsb();
+   sev();
+#endif
+   return 0;
+}
+
+/**
+ * Verifica se todos os blocos de uma tarefa foram executados.
+ */
+int mc_done(mc_job_t *j) {
+   return j->concluidos == j->nblocos;
+}
+
+/**
+ * Aguarda a conclusão de uma tarefa. O núcleo 0 também executa blocos
+ * enquanto espera.
+ */
+void mc_wait(mc_job_t *j) {
+   while(executa_bloco(j, 0)) ;
+   while(!mc_done(j)) ;
+   if(ativa == j) retira();
+}
+
+/**
+ * Cancela uma tarefa: os blocos restantes são descartados.
+ * Os blocos em execução terminam normalmente.
+ */
+void mc_cancel(mc_job_t *j) {
+   j->cancelada = 1;
+   dmb();
+}
+
+/**
+ * Quantidade de blocos da última tarefa executados por um núcleo.
+ */
+uint32_t mc_blocos(uint32_t nucleo) {
+   if(nucleo >= MC_MAX_NUCLEOS) return 0;
+   return executados[nucleo];
+}
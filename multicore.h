@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+
+#define MC_MAX_NUCLEOS       4
+#define MC_MAX_BLOCOS        256
+
+/*
+ * Função executada sobre um bloco da área de uma tarefa.
+ * @param ctx Contexto da tarefa.
+ * @param bloco Índice do bloco (0 a nblocos - 1).
+ * @param inicio Endereço inicial do bloco.
+ * @param tam Tamanho do bloco em bytes.
+ */
+typedef void (*mc_func_t)(void *ctx, uint32_t bloco, uint32_t inicio, uint32_t tam);
+
+/*
+ * Tarefa dividida em blocos. Os núcleos retiram blocos da tarefa ativa
+ * até que todos tenham sido executados.
+ */
+typedef struct {
+   mc_func_t func;
+   void *ctx;
+   uint32_t inicio;
+   uint32_t tam;
+   uint32_t bloco;
+   uint32_t nblocos;
+   volatile uint32_t proximo;       // próximo bloco a executar
+   volatile uint32_t concluidos;    // blocos executados
+   volatile uint32_t cancelada;
+   uint32_t t_inicio;
+   uint32_t t_fim;
+} mc_job_t;
+
+int mc_init(void);
+int mc_nucleos(void);
+int mc_start(mc_job_t *j, mc_func_t f, void *ctx, uint32_t inicio, uint32_t tam, uint32_t alinhamento);
+int mc_done(mc_job_t *j);
+void mc_wait(mc_job_t *j);
+void mc_cancel(mc_job_t *j);
+uint32_t mc_blocos(uint32_t nucleo);
@@ -0,0 +1,269 @@
+#include "nextpc.h"
+
+/*
+ * Cálculo do endereço da próxima instrução a executar, decodificando a
+ * instrução atual do programa do usuário (ARM ou Thumb/Thumb-2) com os
+ * registradores salvos. Instruções que não alteram o fluxo seguem para a
+ * instrução seguinte, inclusive exceções (swi, instrução inválida).
+ */
+#define REG_PC               15
+#define REG_CPSR             41
+
+#define CPSR_N               (1u << 31)
+#define CPSR_Z               (1u << 30)
+#define CPSR_C               (1u << 29)
+#define CPSR_V               (1u << 28)
+#define CPSR_T               (1u << 5)
+
+#define LE32(X)              (*((volatile uint32_t*)(X)))
+#define LE16(X)              (*((volatile uint16_t*)(X)))
+#define LE8(X)               (*((volatile uint8_t*)(X)))
+
+/**
+ * Avalia um código de condição contra as flags do cpsr.
+ */
+static int condicao(uint32_t cond, uint32_t cpsr) {
+   int n = (cpsr & CPSR_N) != 0;
+   int z = (cpsr & CPSR_Z) != 0;
+   int c = (cpsr & CPSR_C) != 0;
+   int v = (cpsr & CPSR_V) != 0;
+   int res;
+   switch(cond >> 1) {
+      case 0: res = z; break;
+      case 1: res = c; break;
+      case 2: res = n; break;
+      case 3: res = v; break;
+      case 4: res = c && !z; break;
+      case 5: res = (n == v); break;
+      case 6: res = !z && (n == v); break;
+      default: return 1;                     // al
+   }
+   return (cond & 1) ? !res : res;
+}
+
+static uint32_t popcount(uint32_t v) {
+   uint32_t n = 0;
+   while(v) {
+      v &= v - 1;
+      n++;
+   }
+   return n;
+}
+
+static int32_t estende(uint32_t v, int bits) {
+   return (int32_t)(v << (32 - bits)) >> (32 - bits);
+}
+
+/**
+ * Segundo operando de uma instrução de processamento de dados ARM.
+ */
+static uint32_t operando(uint32_t inst, const uint32_t *regs, uint32_t pc, int *carry) {
+   uint32_t v, desl, tipo;
+   if(inst & (1 << 25)) {                     // imediato rotacionado
+      desl = ((inst >> 8) & 0xf) * 2;
+      v = inst & 0xff;
+      return desl ? (v >> desl) | (v << (32 - desl)) : v;
+   }
+   v = ((inst & 0xf) == REG_PC) ? pc + 8 : regs[inst & 0xf];
+   if(inst & (1 << 4)) {                      // deslocamento por registrador
+      if((inst & 0xf) == REG_PC) v += 4;
+      desl = regs[(inst >> 8) & 0xf] & 0xff;
+      if(desl == 0) return v;
+   } else {
+      desl = (inst >> 7) & 0x1f;
+   }
+   tipo = (inst >> 5) & 3;
+   switch(tipo) {
+      case 0:                                 // lsl
+         return (desl >= 32) ? 0 : v << desl;
+      case 1:                                 // lsr
+         if((desl == 0) && !(inst & (1 << 4))) desl = 32;
+         return (desl >= 32) ? 0 : v >> desl;
+      case 2:                                 // asr
+         if((desl == 0) && !(inst & (1 << 4))) desl = 32;
+         return (desl >= 32) ? (uint32_t)((int32_t)v >> 31) : (uint32_t)((int32_t)v >> desl);
+      default:                                // ror / rrx
+         if((desl == 0) && !(inst & (1 << 4))) return (v >> 1) | ((uint32_t)*carry << 31);
+         desl &= 31;
+         return desl ? (v >> desl) | (v << (32 - desl)) : v;
+   }
+}
+
+/**
+ * Próxima instrução a partir de uma instrução ARM.
+ */
+static uint32_t next_arm(const uint32_t *regs, uint32_t pc) {
+   uint32_t inst = LE32(pc);
+   uint32_t cpsr = regs[REG_CPSR];
+   uint32_t cond = inst >> 28;
+   uint32_t rn = (inst >> 16) & 0xf;
+   uint32_t base, end, v;
+   int carry = (cpsr & CPSR_C) != 0;
+
+   if(cond == 0xf) {                          // instruções incondicionais
+      if((inst & 0x0e000000) == 0x0a000000)   // blx imediato
+         return (pc + 8 + (estende(inst & 0xffffff, 24) << 2) + ((inst >> 23) & 2)) | 1;
+      return pc + 4;
+   }
+   if(!condicao(cond, cpsr)) return pc + 4;
+
+   base = (rn == REG_PC) ? pc + 8 : regs[rn];
+
+   if((inst & 0x0ffffff0) == 0x012fff10       // bx
+      || (inst & 0x0ffffff0) == 0x012fff30)   // blx registrador
+      return regs[inst & 0xf];
+
+   if((inst & 0x0e000000) == 0x0a000000)      // b, bl
+      return pc + 8 + (estende(inst & 0xffffff, 24) << 2);
+
+   if(((inst & 0x0e108000) == 0x08108000)) {  // ldm com pc na lista
+      uint32_t n = popcount(inst & 0xffff);
+      if(inst & (1 << 23)) end = base + 4 * n - ((inst & (1 << 24)) ? 0 : 4);
+      else end = (inst & (1 << 24)) ? base - 4 : base;
+      return LE32(end);
+   }
+
+   if(((inst & 0x0c50f000) == 0x0410f000)     // ldr pc
+      && !((inst & (1 << 25)) && (inst & (1 << 4)))) {
+      uint32_t desl;
+      if(inst & (1 << 25)) desl = operando(inst & ~(1 << 25) & ~(1 << 4), regs, pc, &carry);
+      else desl = inst & 0xfff;
+      end = (inst & (1 << 23)) ? base + desl : base - desl;
+      return LE32((inst & (1 << 24)) ? end : base);
+   }
+
+   if(((inst & 0x0c00f000) == 0x0000f000)) {  // processamento de dados com rd = pc
+      uint32_t op = (inst >> 21) & 0xf;
+      if((op >= 8) && (op <= 11)) return pc + 4;                  // teste ou msr/misc
+      if(!(inst & (1 << 25)) && (inst & 0x90) == 0x90) return pc + 4; // multiplicação, ldrh...
+      if(!(inst & (1 << 25)) && (inst & (1 << 4)) && (rn == REG_PC)) base += 4;
+      v = operando(inst, regs, pc, &carry);
+      switch(op) {
+         case 0x0: return base & v;
+         case 0x1: return base ^ v;
+         case 0x2: return base - v;
+         case 0x3: return v - base;
+         case 0x4: return base + v;
+         case 0x5: return base + v + ((cpsr & CPSR_C) != 0);
+         case 0x6: return base - v - ((cpsr & CPSR_C) == 0);
+         case 0x7: return v - base - ((cpsr & CPSR_C) == 0);
+         case 0xc: return base | v;
+         case 0xd: return v;
+         case 0xe: return base & ~v;
+         default:  return ~v;
+      }
+   }
+   return pc + 4;
+}
+
+/**
+ * Condição da instrução atual dentro de um bloco it (ou al fora dele).
+ */
+static uint32_t condicao_it(uint32_t cpsr) {
+   uint32_t it = ((cpsr >> 25) & 3) | ((cpsr >> 8) & 0xfc);
+   if((it & 0xf) == 0) return 0xe;
+   return it >> 4;
+}
+
+/**
+ * Próxima instrução a partir de uma instrução Thumb (16 ou 32 bits).
+ * O resultado já inclui o bit de estado.
+ */
+static uint32_t next_thumb(const uint32_t *regs, uint32_t pc) {
+   uint32_t cpsr = regs[REG_CPSR];
+   uint32_t h1 = LE16(pc), h2;
+   uint32_t tam = ((h1 >> 11) >= 0x1d) ? 4 : 2;
+   uint32_t seq = (pc + tam) | 1;
+   uint32_t lepc = pc + 4;                    // valor lido de pc
+   uint32_t rn, base, end;
+
+   if(!condicao(condicao_it(cpsr), cpsr)) return seq;
+
+   if(tam == 2) {
+      if((h1 & 0xf000) == 0xd000 && (h1 & 0x0e00) != 0x0e00) {    // b<c>
+         if(!condicao((h1 >> 8) & 0xf, cpsr)) return seq;
+         return (lepc + (estende(h1 & 0xff, 8) << 1)) | 1;
+      }
+      if((h1 & 0xf800) == 0xe000)                                 // b
+         return (lepc + (estende(h1 & 0x7ff, 11) << 1)) | 1;
+      if((h1 & 0xff00) == 0x4700) {                               // bx, blx
+         rn = (h1 >> 3) & 0xf;
+         return (rn == REG_PC) ? lepc : regs[rn];
+      }
+      if((h1 & 0xff87) == 0x4487) {                               // add pc, rm
+         rn = (h1 >> 3) & 0xf;
+         return (lepc + ((rn == REG_PC) ? lepc : regs[rn])) | 1;
+      }
+      if((h1 & 0xff87) == 0x4687) {                               // mov pc, rm
+         rn = (h1 >> 3) & 0xf;
+         return ((rn == REG_PC) ? lepc : regs[rn]) | 1;
+      }
+      if((h1 & 0xff00) == 0xbd00)                                 // pop {..., pc}
+         return LE32(regs[13] + 4 * popcount(h1 & 0xff));
+      if((h1 & 0xf500) == 0xb100) {                               // cbz, cbnz
+         uint32_t zero = (regs[h1 & 7] == 0);
+         if(zero == ((h1 >> 11) & 1)) return seq;
+         return (lepc + ((h1 >> 3) & 0x40) + ((h1 >> 2) & 0x3e)) | 1;
+      }
+      return seq;
+   }
+
+   h2 = LE16(pc + 2);
+   rn = h1 & 0xf;
+   base = (rn == REG_PC) ? lepc : regs[rn];
+
+   if((h1 & 0xf800) == 0xf000 && (h2 & 0x8000)) {               // desvios e controle
+      uint32_t s = (h1 >> 10) & 1, j1 = (h2 >> 13) & 1, j2 = (h2 >> 11) & 1;
+      int32_t imm;
+      if((h2 & 0x5000) == 0) {                                    // b<c>.w
+         if((h1 & 0x0380) == 0x0380) return seq;                  // msr, mrs, hints...
+         if(!condicao((h1 >> 6) & 0xf, cpsr)) return seq;
+         imm = estende((s << 20) | (j2 << 19) | (j1 << 18) | ((h1 & 0x3f) << 12) | ((h2 & 0x7ff) << 1), 21);
+         return (lepc + imm) | 1;
+      }
+      imm = estende((s << 24) | ((!(j1 ^ s)) << 23) | ((!(j2 ^ s)) << 22)
+                    | ((h1 & 0x3ff) << 12) | ((h2 & 0x7ff) << 1), 25);
+      if((h2 & 0x5000) == 0x4000)                                 // blx (para ARM)
+         return ((lepc & ~3) + imm) & ~3;
+      return (lepc + imm) | 1;                                    // b.w, bl
+   }
+
+   if((h1 & 0xffd0) == 0xe890 && (h2 & 0x8000)) {                 // ldmia com pc
+      return LE32(base + 4 * (popcount(h2) - 1));
+   }
+   if((h1 & 0xffd0) == 0xe910 && (h2 & 0x8000)) {                 // ldmdb com pc
+      return LE32(base - 4);
+   }
+
+   if((h1 & 0xfff0) == 0xe8d0 && (h2 & 0xffe0) == 0xf000) {       // tbb, tbh
+      uint32_t rm = regs[h2 & 0xf];
+      uint32_t desl = (h2 & 0x10) ? LE16(base + 2 * rm) : LE8(base + rm);
+      return (lepc + 2 * desl) | 1;
+   }
+
+   if((h1 & 0xff70) == 0xf850 && (h2 & 0xf000) == 0xf000) {       // ldr pc
+      if(rn == REG_PC) {                                          // literal
+         end = lepc & ~3;
+         return LE32((h1 & 0x80) ? end + (h2 & 0xfff) : end - (h2 & 0xfff));
+      }
+      if(h1 & 0x80) return LE32(base + (h2 & 0xfff));             // imm12
+      if(h2 & 0x800) {                                            // imm8 com p, u, w
+         end = (h2 & 0x200) ? base + (h2 & 0xff) : base - (h2 & 0xff);
+         return LE32((h2 & 0x400) ? end : base);
+      }
+      if((h2 & 0x0fc0) == 0)                                      // registrador
+         return LE32(base + (regs[h2 & 0xf] << ((h2 >> 4) & 3)));
+   }
+   return seq;
+}
+
+/**
+ * Calcula o endereço da próxima instrução do programa do usuário.
+ * @param regs Registradores do usuário (pc em 15, cpsr em 41).
+ * @return Endereço; bit 0 em 1 se a próxima instrução for Thumb.
+ */
+uint32_t next_pc(const uint32_t *regs) {
+   uint32_t pc = regs[REG_PC];
+   if(regs[REG_CPSR] & CPSR_T) return next_thumb(regs, pc & ~1);
+   return next_arm(regs, pc & ~3);
+}
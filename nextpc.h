@@ -0,0 +1,8 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Endereços com o bit 0 em 1 indicam que a instrução é executada no
+ * estado Thumb.
+ */
+uint32_t next_pc(const uint32_t *regs);
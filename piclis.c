@@ -1,8 +1,27 @@
+#include "bcm.h"
 #include "uart.h"
 #include "gpio.h"
+#include "dma.h"
+#include "xfer.h"
+#include "cmd.h"
+#include "morse.h"
+#include "timer.h"
+#include "mmu.h"
+#include "search.h"
+#include "checksum.h"
+#include "hex.h"
+#include "multicore.h"
+#include "hwdebug.h"
+#include "bkpt.h"
+#include "agent.h"
+#include "nextpc.h"
+#include "mem.h"
+#include "load.h"
+#include "capture.h"
+#include "wave.h"
+#include "irq.h"
 #include <stdbool.h>
 #include <stdint.h>
-void delay(unsigned);
 
 /*
  * Sinais reconhecidos pelo PiCLIs
@@ -20,16 +39,24 @@ void delay(unsigned);
 #define SIG_STOP           0x11
 
 /*
- * Instrução usada como trap (breakpoint)
+ * Símbolos declarados pelo linker
  */
-#define TRAP_INST          0xefaaaaaa
-
-#define MEMORY(X)          *((uint32_t*)(X))
+extern uint8_t *stack_svr, *load_addr;
 
+#if HOST
 /*
- * Símbolos declarados pelo linker
+ * Build nativo: o processo começa em host/main.c, que chama main_piclis
+ * e simula a volta ao programa do usuário. Os símbolos do linker são
+ * definidos no Makefile, mas não são constantes de 32 bits no compilador.
  */
-extern uint8_t *stack_svr, *load_addr;
+#define main               main_piclis
+#define VOLTA_USUARIO()    switch_back()
+#define END_LINKER(X)      0
+void switch_back(void);
+#else
+#define VOLTA_USUARIO()    asm volatile ("b switch_back")
+#define END_LINKER(X)      ((uint32_t)&(X))
+#endif
 
 /*
  * Valor dos registradores do usuário.
@@ -37,9 +64,9 @@ extern uint8_t *stack_svr, *load_addr;
 #define NUM_REGS           42
 uint32_t user_regs[NUM_REGS] = {
    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // r0-r12
-   (uint32_t)&stack_svr,                      // sp
+   END_LINKER(stack_svr),                     // sp
    0,                                         // lr
-   (uint32_t)&load_addr,                      // pc
+   END_LINKER(load_addr),                     // pc
    0, 0, 0, 0, 0, 0, 0, 0,                    // f0-f7 
    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  //
    0,                                         // fps
@@ -47,6 +74,12 @@ uint32_t user_regs[NUM_REGS] = {
 };
 uint8_t user_status = SIG_TRAP;
 
+/*
+ * Diferente de zero enquanto o programa do usuário está em execução
+ * (atualizado por switch_back e goto_piclis em boot.s).
+ */
+uint32_t user_running = 0;
+
 #define PC                 (user_regs[15])
 #define CPSR               (user_regs[41])
 
@@ -59,562 +92,31 @@ uint8_t user_status = SIG_TRAP;
 // 41    --- cpsr
 
 /*
- * Breakpoints.
+ * Causa da última parada pela unidade de depuração (HWDBG_...) e endereço
+ * observado, no caso de watchpoint.
  */
-#define MAX_BKPTS          16
-typedef struct bkpt_s {
-   uint32_t addr;
-   uint32_t cont;
-} bkpt_t;
-bkpt_t bkpts[MAX_BKPTS] = { 0 };
+static int parada_hw = HWDBG_NENHUM;
+static uint32_t parada_watch;
 
 /*
- * Funções para manipulação de caracteres hexadecimais.
+ * Diferente de zero enquanto o PiCLIs executa uma instrução para sair de
+ * um breakpoint ou watchpoint antes de continuar (comando c).
  */
-char hex_to_char(uint8_t n) {
-   if(n < 10) return '0' + n;
-   if(n < 16) return 'a' + n - 10;
-   return '0';
-}
+static int passo_interno = 0;
+static uint32_t parada_pc;
 
-int char_to_hex(char c) {
-   if((c >= '0') && (c <= '9')) return c - '0';
-   if((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
-   if((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
-   return 0;
-}
+/*
+ * Passos ainda a executar pelo comando $pSTEP antes de avisar o depurador.
+ */
+static uint32_t passos_restantes = 0;
 
-/**
- * Recebe um caractere (byte hexadecimal) e faz o LED verde (GPIO 47) piscá-lo em código morse.
- * @param c Valor a codificar (8 bits).
+/*
+ * Área de preparação para conversões hexadecimais em bloco: os dados
+ * são convertidos pela tabela do módulo hex e trafegam pela uart em
+ * uma única chamada, em vez de caractere por caractere.
  */
-void char_to_morse(char c) {
-   if (((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z'))) {
-      gpio_put(47, 1);
-      switch (c) {
-      case 'a':
-      case 'A':
-         delay(1000000); // Ponto (1 unidade)
-         gpio_toggle(47);
-         delay(1000000); // Espaço entre partes do mesmo caractere (1 unidade)
-         gpio_toggle(47);
-         delay(3000000); // Traço (3 unidades)
-         break;
-      case 'b':
-      case 'B':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case 'c':
-      case 'C':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case 'd':
-      case 'D':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case 'e':
-      case 'E':
-         delay(1000000); // Ponto
-         break;
-      case 'f':
-      case 'F':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case 'g':
-      case 'G':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case 'h':
-      case 'H':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case 'i':
-      case 'I':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case 'j':
-      case 'J':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         break;
-      case 'k':
-      case 'K':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         break;
-      case 'l':
-      case 'L':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case 'm':
-      case 'M':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         break;
-      case 'n':
-      case 'N':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case 'o':
-      case 'O':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         break;
-      case 'p':
-      case 'P':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case 'q':
-      case 'Q':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         break;
-      case 'r':
-      case 'R':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case 's':
-      case 'S':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case 't':
-      case 'T':
-         delay(3000000); // Traço
-         break;
-      case 'u':
-      case 'U':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         break;
-      case 'v':
-      case 'V':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         break;
-      case 'w':
-      case 'W':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         break;
-      case 'x':
-      case 'X':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         break;
-      case 'y':
-      case 'Y':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         break;
-      case 'z':
-      case 'Z':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case '1':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         break;
-      case '2':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         break;
-      case '3':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         break;
-      case '4':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         break;
-      case '5':
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case '6':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case '7':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case '8':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case '9':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(1000000); // Ponto
-         break;
-      case '0':
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         gpio_toggle(47);
-         delay(1000000); // Espaço
-         gpio_toggle(47);
-         delay(3000000); // Traço
-         break;
-      default:
-         break;
-      }
-   }
-}
+#define HEX_BLOCO          512
+static char hex_buf[HEX_BLOCO];
 
 /**
  * Envia um byte em hexadecimal pela uart.
@@ -622,12 +124,36 @@ void char_to_morse(char c) {
  * @return Checksum dos caracteres enviados.
  */
 uint8_t sendbyte(uint8_t v) {
-   uint8_t chk = 0, c;
-   c = hex_to_char(v >> 4);
-   uart_putc(c);  chk += c;
-   c = hex_to_char(v & 0x0f);
-   uart_putc(c);  chk += c;
-   return chk;
+   char c[2];
+   hex_encode(c, &v, 1);
+   uart_write((uint8_t*)c, 2);
+   return c[0] + c[1];
+}
+
+/**
+ * Envia um inteiro de 32 bits em hexadecimal (8 caracteres) pela uart.
+ * @param v Valor a enviar.
+ */
+void sendword(uint32_t v) {
+   uint8_t b[4] = { v >> 24, v >> 16, v >> 8, v };
+   char c[8];
+   hex_encode(c, b, 4);
+   uart_write((uint8_t*)c, 8);
+}
+
+/**
+ * Envia um inteiro de 32 bits em decimal pela uart.
+ * @param v Valor a enviar.
+ */
+void senddec(uint32_t v) {
+   char buf[11];
+   int i = 10;
+   buf[i] = 0;
+   do {
+      buf[--i] = '0' + (v % 10);
+      v /= 10;
+   } while(v);
+   uart_puts(buf + i);
 }
 
 /**
@@ -641,48 +167,31 @@ uint8_t readbyte(void) {
 
 /**
  * Envia uma mensagem completa contendo os dados de uma área de memória.
+ * As linhas são quebradas sempre que a quantidade de bytes restantes for
+ * múltipla de 15.
  * @param a Endereço da área de memória.
  * @param s Quantidade de bytes a enviar.
  */
 void sendbytes(uint8_t *a, uint32_t s) {
-   uint8_t chk = 0;
+   uint32_t n = 0;
+   uint32_t linha = s % 15;
+   if(linha == 0) linha = 15;
 
    while(s) {
-      chk += sendbyte(*a);
-      a++;
-      s--;
-      if (s % 15 == 0) uart_puts("\r\n");
-   }
-   // uart_putc('#');
-   // sendbyte(chk);
-}
-
-/**
- * Compara bytes de uma área da memória com uma palavra de dados fornecida
- * @param search_word Palavra de dados
- * @param a Endereço da área de memória.
- * @param s Tamanho da área de memória.
- * @return Número de ocorrências da palavra de dados na região da memória.
- */
-uint8_t compbytes(uint32_t search_word, uint8_t *a, uint32_t s) {
-   uint8_t times = 0;
-   unsigned char buffer[4];
-
-   while (s) {
-      uint32_t variable;
-      buffer[0] = ((*a << 3)| (*(a+1) << 2)| (*(a+2) << 1)| (*(a+3)));
-      buffer[1] = ((*(a+4) << 3)| (*(a+5) << 2)| (*(a+6) << 1)| (*(a+7)));
-      buffer[2] = ((*(a+8) << 3)| (*(a+9) << 2)| (*(a+10) << 1)| (*(a+11)));
-      buffer[3] = ((*(a+12) << 3)| (*(a+13) << 2)| (*(a+14) << 1)| (*(a+15)));
-      variable = ((buffer[0] << 24)| (buffer[1] << 16) | (buffer[2] << 8) | buffer[3]);
-      if (variable == search_word) {
-         times++;
+      if(linha > s) linha = s;
+      hex_encode(hex_buf + n, a, linha);
+      n += 2 * linha;
+      a += linha;
+      s -= linha;
+      hex_buf[n++] = '\r';
+      hex_buf[n++] = '\n';
+      if(n > HEX_BLOCO - 32) {
+         uart_write((uint8_t*)hex_buf, n);
+         n = 0;
       }
-      a++;
-      s--;
+      linha = 15;
    }
-   
-   return times;
+   uart_write((uint8_t*)hex_buf, n);
 }
 
 /**
@@ -692,8 +201,17 @@ uint8_t compbytes(uint32_t search_word, uint8_t *a, uint32_t s) {
  */
 void readbytes(uint8_t *a, uint32_t s) {
    while(s) {
-      *a++ = readbyte();
-      s--;
+      uint32_t n = (s > HEX_BLOCO / 2) ? HEX_BLOCO / 2 : s;
+      uart_read((uint8_t*)hex_buf, 2 * n);
+      for(uint32_t i = 0; i < n; ) {
+         i += hex_decode(a + i, hex_buf + 2 * i, n - i);
+         if(i < n) {                         // caractere inválido vale 0
+            a[i] = (char_to_hex(hex_buf[2 * i]) << 4) | char_to_hex(hex_buf[2 * i + 1]);
+            i++;
+         }
+      }
+      a += n;
+      s -= n;
    }
 }
 
@@ -725,470 +243,1368 @@ uint32_t endian_change(uint32_t v) {
    return res;
 }
 
+/*
+ * Tratadores dos comandos.
+ * Recebem os argumentos já convertidos conforme a tabela de comandos.
+ */
+
 /**
- * Recebe e descarta caracteres pela uart até a recepção do 
- * caractere especificado.
- * @param t Caractere a receber.
+ * Pisca uma mensagem formada por caracteres alfanuméricos em código morse pelo LED verde da placa.
+ * A mensagem entra na fila de reprodução e o comando retorna imediatamente.
+ * Formato do comando: $pMORSE <mensagem>
  */
-void skip(char t) {
-   for(;;) {
-      uint8_t c = uart_getc();
-      if(c == t) return;
-   }
+static int trata_morse(cmd_args_t *args) {
+   if(morse_send(args->str[0]) < 0) return CMD_ERRO;
+   uart_puts("+");
+   return CMD_PRONTO;
 }
 
 /**
- * Aguarda a conclusão de uma mensagem e envia um ack ('+').
+ * Altera a velocidade do código morse.
+ * Formato do comando: $pWPM <palavras por minuto>
  */
-void ack(void) {
-   skip('#');
-   // uart_getc();                     // ignora checksum
-   // uart_getc();
-   uart_putc('+');                  // responde com um acknowledge
+static int trata_wpm(cmd_args_t *args) {
+   int32_t wpm = args->v[0];
+   if((wpm < 1) || (wpm > 100)) return CMD_ERRO;
+   morse_set_wpm(wpm);
+   return CMD_ENVIA_OK;
 }
 
 /**
- * Acrescenta um novo breakpoint na lista.
- * @param addr Endereço da memória para o breakpoint.
- * @return false se não houver espaço para um novo breakpoint.
+ * Lista o endereço de uma ocorrência encontrada pela busca.
  */
-bool bkpt_add(uint32_t addr) {
-   int j = 0;
-   if(addr == 0) return false;
-   for(int i=1; i<MAX_BKPTS; i++) {
-      if(bkpts[i].addr == addr) return true;           // breakpoint redefinido
-      if(bkpts[i].addr == 0) j = i;                    // posição vaga
+static void lista_ocorrencia(uint32_t addr, void *ctx) {
+   sendword(addr);
+   uart_puts("\r\n");
+}
+
+/**
+ * Compila o padrão de busca dos comandos $pSCH e $pPSCH.
+ * O padrão e a máscara são sequências de bytes em hexadecimal, na ordem em que
+ * aparecem na memória (até 64 bytes); bits em 0 na máscara são ignorados.
+ * @return 0 em caso de sucesso, -1 se o padrão for inválido.
+ */
+static int compila_busca(search_t *busca, cmd_args_t *args) {
+   uint8_t padrao[SEARCH_MAX_PADRAO], mascara[SEARCH_MAX_PADRAO];
+   uint32_t len = 0, align = 1;
+
+   while(args->str[0][len]) len++;
+   if((len & 1) || (len > 2 * SEARCH_MAX_PADRAO)) return -1;
+   len /= 2;
+   if(hex_decode(padrao, args->str[0], len) != len) return -1;
+   if(args->argc > 3) {
+      uint32_t n = 0;
+      while(args->str[3][n]) n++;
+      if(n != 2 * len) return -1;
+      if(hex_decode(mascara, args->str[3], len) != len) return -1;
    }
+   if(args->argc > 4) align = args->v[4];
+   return search_compile(busca, padrao, (args->argc > 3) ? mascara : 0, len, align);
+}
+
+/**
+ * Procura um padrão de bytes na memória, listando os endereços das ocorrências.
+ * Formato do comando: $pSCH <padrão> <endereço> <tamanho> [máscara] [alinhamento]
+ */
+static int trata_search(cmd_args_t *args) {
+   static search_t busca;
+   if(compila_busca(&busca, args) < 0) return CMD_ERRO;
+
+   uint32_t times_search = search_run(&busca, args->v[1], args->v[2], lista_ocorrencia, 0);
 
-   if(j == 0) return false;                            // nenhuma posição vaga
-   bkpts[j].addr = addr;
-   return true;
+   uart_puts("A palavra ");
+   uart_puts(args->str[0]);
+   uart_puts(" aparece ");
+   senddec(times_search);
+   uart_puts(" vezes na area procurada.");
+   return CMD_PRONTO;
 }
 
 /**
- * Remove um breakpoint da lista.
- * @param addr Endereço de memória do breakpoint.
- * @return false se o breakpoint não foi encontrado.
+ * Compara o nome de um algoritmo.
  */
-bool bkpt_remove(uint32_t addr) {
-   for(int i=1; i<MAX_BKPTS; i++) {
-      if(bkpts[i].addr == addr) {
-         bkpts[i].addr = 0;
-         return true;
-      }
+static bool mesmo_nome(const char *a, const char *b) {
+   while(*a && (*a == *b)) {
+      a++;
+      b++;
    }
-   return false;
+   return *a == *b;
+}
+
+/**
+ * Calcula o checksum de uma área de memória.
+ * Algoritmos: crc32 (padrão), adler32 ou xxh32.
+ * Formato do comando: $pCHK <endereço> <tamanho> [algoritmo]
+ */
+static int trata_checksum(cmd_args_t *args) {
+   const uint8_t *a = (const uint8_t*)args->v[0];
+   uint32_t s = args->v[1], res;
+   const char *algo = (args->argc > 2) ? args->str[2] : "crc32";
+
+   uint32_t t0 = timer_ticks();
+   if(mesmo_nome(algo, "crc32")) res = crc32(0, a, s);
+   else if(mesmo_nome(algo, "adler32")) res = adler32(1, a, s);
+   else if(mesmo_nome(algo, "xxh32")) res = xxh32(a, s, 0);
+   else return CMD_ERRO;
+   uint32_t us = timer_ticks() - t0;
+
+   uart_puts((char*)algo);
+   uart_puts(" = ");
+   sendword(res);
+   uart_puts(" (");
+   senddec(s);
+   uart_puts(" bytes em ");
+   senddec(us);
+   uart_puts(" us)");
+   return CMD_PRONTO;
+}
+
+/**
+ * Informa o tempo gasto e a vazão de uma operação sobre a memória.
+ */
+static void informa_vazao(char *nome, uint32_t s, uint32_t us) {
+   if(us == 0) us = 1;
+   uart_puts(nome);
+   uart_puts(": ");
+   senddec(s);
+   uart_puts(" bytes em ");
+   senddec(us);
+   uart_puts(" us (");
+   senddec((uint32_t)(((uint64_t)s * 1000000 / us) >> 10));
+   uart_puts(" KiB/s)");
 }
 
 /**
- * Limpa a memória de instruções trap.
+ * Copia uma área de memória usando o controlador de DMA e informa a vazão
+ * obtida. O destino não pode começar sobre a origem.
+ * Formato do comando: $pDMA <destino> <origem> <tamanho>
  */
-void bkpt_restore_contents(void) {
-   for(int i=0; i<MAX_BKPTS; i++) {
-      uint32_t addr = bkpts[i].addr;
-      if(addr == 0) continue;
-      MEMORY(addr) = bkpts[i].cont;
+static int trata_dma(cmd_args_t *args) {
+   uint32_t dst = args->v[0], src = args->v[1], s = args->v[2];
+   int ch = dma_alloc();
+   if(ch < 0) return CMD_ERRO;
+
+   uint32_t t0 = timer_ticks();
+   int res = dma_copy(ch, (void*)dst, (void*)src, s);
+   if(res == 0) res = dma_wait(ch);
+   uint32_t us = timer_ticks() - t0;
+   dma_free(ch);
+   if(res < 0) return CMD_ERRO;
+   cache_sync_code((void*)dst, s);
+
+   informa_vazao("DMA", s, us);
+   return CMD_PRONTO;
+}
+
+/**
+ * Verifica um argumento opcional formado por uma palavra fixa (ex.: "dma").
+ * @return 1 se presente, 0 se ausente, -1 se o argumento for outra palavra.
+ */
+static int opcao(cmd_args_t *args, int i, const char *nome) {
+   if(args->argc <= i) return 0;
+   return mesmo_nome(args->str[i], nome) ? 1 : -1;
+}
+
+/**
+ * Preenche uma área de memória com um padrão de 1, 2 ou 4 bytes, dado em
+ * hexadecimal na ordem em que deve aparecer na memória. Com "dma", usa o
+ * controlador de DMA (área alinhada em palavras).
+ * Formato do comando: $pFILL <endereço> <tamanho> <padrão> [dma]
+ */
+static int trata_fill(cmd_args_t *args) {
+   uint32_t dst = args->v[0], s = args->v[1], len = 0;
+   uint8_t p[4];
+   int dma = opcao(args, 3, "dma");
+
+   while(args->str[2][len]) len++;
+   if((len != 2) && (len != 4) && (len != 8)) return CMD_ERRO;
+   len /= 2;
+   if(hex_decode(p, args->str[2], len) != len) return CMD_ERRO;
+   for(uint32_t i=len; i<4; i++) p[i] = p[i - len];
+   uint32_t pattern = p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+   if((dma < 0) || (dma && ((dst | s) & 3))) return CMD_ERRO;
+
+   uint32_t t0 = timer_ticks();
+   if(dma) {
+      int ch = dma_alloc();
+      if(ch < 0) return CMD_ERRO;
+      int res = dma_fill(ch, (void*)dst, pattern, s);
+      if(res == 0) res = dma_wait(ch);
+      dma_free(ch);
+      if(res < 0) return CMD_ERRO;
+   } else {
+      mem_fill((void*)dst, pattern, s);
    }
+   cache_sync_code((void*)dst, s);
+   informa_vazao("FILL", s, timer_ticks() - t0);
+   return CMD_PRONTO;
 }
 
 /**
- * Coloca traps na memória nas posições dos breakpoints ativos.
+ * Copia uma área de memória (as áreas podem se sobrepor). Com "dma", usa o
+ * controlador de DMA, que não aceita destino sobre o fim da origem.
+ * Formato do comando: $pCOPY <destino> <origem> <tamanho> [dma]
  */
-void bkpt_activate(void) {
-   for(int i=0; i<MAX_BKPTS; i++) {
-      uint32_t addr = bkpts[i].addr;
-      if(addr == 0) continue;
-      bkpts[i].cont = MEMORY(addr);
-      MEMORY(addr) = TRAP_INST;
+static int trata_copy(cmd_args_t *args) {
+   uint32_t dst = args->v[0], src = args->v[1], s = args->v[2];
+   int dma = opcao(args, 3, "dma");
+   if(dma < 0) return CMD_ERRO;
+
+   uint32_t t0 = timer_ticks();
+   if(dma) {
+      int ch = dma_alloc();
+      if(ch < 0) return CMD_ERRO;
+      int res = dma_copy(ch, (void*)dst, (void*)src, s);
+      if(res == 0) res = dma_wait(ch);
+      dma_free(ch);
+      if(res < 0) return CMD_ERRO;
+   } else {
+      mem_copy((void*)dst, (void*)src, s);
    }
+   cache_sync_code((void*)dst, s);
+   informa_vazao("COPY", s, timer_ticks() - t0);
+   return CMD_PRONTO;
 }
 
 /**
- * Ponto de entrada do loop de processamento de mensagens do stub.
+ * Compara duas áreas de memória e informa a quantidade de bytes diferentes
+ * e o endereço (na primeira área) do primeiro deles.
+ * Formato do comando: $pCMP <endereço a> <endereço b> <tamanho>
  */
-void piclis_main(int sig) {
-   static uint32_t a, s;
-   static uint8_t chk;
-   static uint8_t c;
+static int trata_cmp(cmd_args_t *args) {
+   uint32_t a = args->v[0], b = args->v[1], s = args->v[2], primeira = 0;
+
+   uint32_t t0 = timer_ticks();
+   uint32_t difs = mem_cmp((void*)a, (void*)b, s, &primeira);
+   uint32_t us = timer_ticks() - t0;
+
+   if(difs == 0) {
+      uart_puts("Areas iguais");
+   } else {
+      senddec(difs);
+      uart_puts(" bytes diferentes, o primeiro em ");
+      sendword(a + primeira);
+   }
+   uart_puts(" (");
+   senddec(s);
+   uart_puts(" bytes em ");
+   senddec(us);
+   uart_puts(" us)");
+   return CMD_PRONTO;
+}
 
-   /*
-    * Limpa brakepoints da memória
-    */
-   uart_break_disable();
-   bkpt_restore_contents();
-   bkpts[0].addr = 0;
+/**
+ * Converte uma máscara de GPIOs (até 16 dígitos hexadecimais).
+ * @return 0 em caso de sucesso, -1 em erro de formato ou GPIO inexistente.
+ */
+static int le_mascara(const char *s, uint64_t *mask) {
+   uint64_t v = 0;
+   int n = 0, d;
+   while((d = hex_value(s[n])) >= 0) {
+      if(n == 16) return -1;
+      v = (v << 4) | d;
+      n++;
+   }
+   if((n == 0) || s[n] || (v & ~GPIO_MASK_TODOS)) return -1;
+   *mask = v;
+   return 0;
+}
 
-   /*
-    * Envia status ao depurador.
-    */
-   user_status = sig;
-   // uart_puts("$S");
-   // chk = 'S' + sendbyte(user_status);
-   // uart_putc('#');
-   // sendbyte(chk);
+/*
+ * Funções e resistores aceitos pelo $pGPIO.
+ */
+static const struct {
+   const char *nome;
+   int valor;
+} funcoes_gpio[] = {
+   { "in", GPIO_FUNC_INPUT }, { "out", GPIO_FUNC_OUTPUT },
+   { "alt0", GPIO_FUNC_ALT0 }, { "alt1", GPIO_FUNC_ALT1 }, { "alt2", GPIO_FUNC_ALT2 },
+   { "alt3", GPIO_FUNC_ALT3 }, { "alt4", GPIO_FUNC_ALT4 }, { "alt5", GPIO_FUNC_ALT5 },
+}, pulls_gpio[] = {
+   { "none", GPIO_PULL_NONE }, { "up", GPIO_PULL_UP }, { "down", GPIO_PULL_DOWN },
+};
+#define GPIO_CONSOLE       (GPIO_BIT(14) | GPIO_BIT(15))
 
-   /*
-    * Espera uma mensagem.
-    */
-retry:
-   uart_puts("\r\n> ");
+/**
+ * Operações sobre conjuntos de GPIOs, dados por uma máscara hexadecimal
+ * (bit n = GPIO n). Sem argumentos, informa o nível dos 54 GPIOs.
+ * Os GPIOs do console (14 e 15) não podem ter a função ou os resistores
+ * alterados.
+ * Formato do comando: $pGPIO [set|clr|tog <máscara>]
+ *                     $pGPIO [put <máscara> <valor>]
+ *                     $pGPIO [fn <máscara> in|out|alt0..alt5]
+ *                     $pGPIO [pull <máscara> none|up|down]
+ */
+static int trata_gpio(cmd_args_t *args) {
+   uint64_t mask, valor;
+   int i;
+
+   if(args->argc == 0) {
+      valor = gpio_read_mask();
+      uart_puts("GPIO: ");
+      sendword(valor >> 32);
+      sendword(valor);
+      return CMD_PRONTO;
+   }
+   if((args->argc < 2) || (le_mascara(args->str[1], &mask) < 0)) return CMD_ERRO;
+
+   if(args->argc == 2) {
+      if(mesmo_nome(args->str[0], "set")) gpio_set_mask(mask);
+      else if(mesmo_nome(args->str[0], "clr")) gpio_clr_mask(mask);
+      else if(mesmo_nome(args->str[0], "tog")) gpio_toggle_mask(mask);
+      else return CMD_ERRO;
+      return CMD_ENVIA_OK;
+   }
 
-   /*
-    * Identifica a mensagem
-    */
-   c = uart_getc();
-   switch(c) {
-      case '?':
-            goto trata_status;
-      case '$':
-         c = uart_getc();
-         if (c == 'p') {
-            c = uart_getc();
-            if (c == 'B') {
-               c = uart_getc();
-               if (c == 'I') {
-                  c = uart_getc();
-                  if (c == 'N') goto trata_dectobin;
-               }
-               break;
-            }
-            if (c == 'C') {
-               c = uart_getc();
-               if (c == 'H') {
-                  c = uart_getc();
-                  if (c == 'K') goto trata_checksum;
-               }
-               break;
-            }
-            if (c == 'S') {
-               c = uart_getc();
-               if (c == 'C') {
-                  c = uart_getc();
-                  if (c == 'H') goto trata_search;
-               }
-               break;
-            }
-            if (c == 'E') {
-               c = uart_getc();
-               if(c == 'C') {
-                  c = uart_getc();
-                  if(c == 'H') {
-                     c = uart_getc();
-                     if(c == 'O') goto trata_echo;
-                  }
-                  break;
-               }
-               break;
-            }
-            if (c == 'M') {
-               c = uart_getc();
-               if (c == 'O') {
-                  c = uart_getc();
-                  if (c == 'R') {
-                     c = uart_getc();
-                     if (c == 'S') {
-                        c = uart_getc();
-                        if (c == 'E') goto trata_morse;
-                     }
-                     break;
-                  }
-                  break;
-               }
-               break;
-            }
-            break;
+   if(mesmo_nome(args->str[0], "put")) {
+      if(le_mascara(args->str[2], &valor) < 0) return CMD_ERRO;
+      gpio_write_mask(mask, valor);
+      return CMD_ENVIA_OK;
+   }
+   if(mask & GPIO_CONSOLE) return CMD_ERRO;
+   if(mesmo_nome(args->str[0], "fn")) {
+      for(i=0; i<sizeof(funcoes_gpio) / sizeof(funcoes_gpio[0]); i++) {
+         if(mesmo_nome(args->str[2], funcoes_gpio[i].nome)) {
+            gpio_init_mask(mask, funcoes_gpio[i].valor);
+            return CMD_ENVIA_OK;
          }
-      case 'g':
-         goto trata_g;
-      case 'G':
-         goto trata_G;
-      case 'P':
-         goto trata_P;
-      case 'm':
-         goto trata_m;
-      case 'M':
-         goto trata_M;
-      case 'c':
-         ack();
-         goto executa;
-      case 's':
-         goto trata_s;
-      case 'Z':
-         c = uart_getc();
-         if(c == '0') goto trata_Z0;
-         break;
-      case 'z':
-         c = uart_getc();
-         if(c == '0') goto trata_z0;
-         break;
-      case 'D':
-      case 'k':
-         ack();
-         goto envia_ok;
-      case '\r':
-         goto retry;
+      }
+   } else if(mesmo_nome(args->str[0], "pull")) {
+      for(i=0; i<sizeof(pulls_gpio) / sizeof(pulls_gpio[0]); i++) {
+         if(mesmo_nome(args->str[2], pulls_gpio[i].nome)) {
+            gpio_set_pulls_mask(mask, pulls_gpio[i].valor);
+            return CMD_ENVIA_OK;
+         }
+      }
    }
-   for (;;) { // Se algum comando for escrito errado
-      if (c == '\r') goto retry;
-      c = uart_getc();
+   return CMD_ERRO;
+}
+
+/*
+ * Lote de eventos enviado pelo $pCAP read: cabeçalho e eventos, na ordem
+ * da memória (little-endian).
+ */
+#define CAP_LOTE           1024
+static struct {
+   uint32_t n;                            // eventos no lote
+   uint32_t perdidos;                     // eventos descartados com a fila cheia
+   capture_evento_t ev[CAP_LOTE];
+} lote_cap;
+
+/**
+ * Captura de bordas dos GPIOs 0 a 31 (analisador lógico). "start" arma a
+ * detecção nos GPIOs da máscara (padrão: as duas bordas), "stop" a encerra
+ * e "read" envia e retira da fila até CAP_LOTE eventos em quadros binários
+ * (ver xfer.h): n e perdidos (32 bits cada) seguidos de n capture_evento_t.
+ * Sem argumentos, informa o estado da captura.
+ * Formato do comando: $pCAP [start <máscara> [rise|fall|both]]
+ *                     $pCAP [stop|read]
+ */
+static int trata_cap(cmd_args_t *args) {
+   uint64_t mask;
+   int bordas = CAPTURE_SUBIDA | CAPTURE_DESCIDA;
+
+   if(args->argc == 0) {
+      uart_puts("CAP: ");
+      sendword(capture_mask());
+      uart_puts(", ");
+      senddec(capture_pendentes());
+      uart_puts(" eventos, ");
+      senddec(capture_perdidos());
+      uart_puts(" perdidos");
+      return CMD_PRONTO;
    }
 
-   /*
-    * Comando não reconhecido
-    */
-envia_nulo:
-   uart_puts("$#00");
-   goto retry;
+   if(mesmo_nome(args->str[0], "start")) {
+      if((args->argc < 2) || (le_mascara(args->str[1], &mask) < 0)) return CMD_ERRO;
+      if((mask >> 32) || (mask & GPIO_CONSOLE)) return CMD_ERRO;
+      if(args->argc == 3) {
+         if(mesmo_nome(args->str[2], "rise")) bordas = CAPTURE_SUBIDA;
+         else if(mesmo_nome(args->str[2], "fall")) bordas = CAPTURE_DESCIDA;
+         else if(!mesmo_nome(args->str[2], "both")) return CMD_ERRO;
+      }
+      capture_start(mask, bordas);
+      return CMD_ENVIA_OK;
+   }
+   if(args->argc > 1) return CMD_ERRO;
+   if(mesmo_nome(args->str[0], "stop")) {
+      capture_stop();
+      return CMD_ENVIA_OK;
+   }
+   if(mesmo_nome(args->str[0], "read")) {
+      lote_cap.perdidos = capture_perdidos();
+      lote_cap.n = capture_copia(lote_cap.ev, CAP_LOTE);
+      if(xfer_send((uint8_t*)&lote_cap, 8 + lote_cap.n * sizeof(capture_evento_t)) < 0) return CMD_ERRO;
+      capture_descarta(lote_cap.n);
+      return CMD_PRONTO;
+   }
+   return CMD_ERRO;
+}
 
-envia_ok:
-   uart_puts("$OK#9a");
-   goto retry;
+/*
+ * Passos do $pWAVE.
+ */
+static wave_passo_t passos_wave[WAVE_MAX_PASSOS];
 
-envia_erro:
-   uart_puts("$E01#a5");
-   goto retry;
+/**
+ * Converte os passos do $pWAVE: "+<máscara>/<us>" liga e "-<máscara>/<us>"
+ * desliga os GPIOs da máscara (hexadecimal) e espera us microssegundos
+ * (decimal), separados por espaços.
+ * @return Quantidade de passos, ou -1 em erro de formato.
+ */
+static int le_passos(const char *s) {
+   int n = 0, d;
+   for(;;) {
+      while(*s == ' ') s++;
+      if(*s == 0) return n;
+      if(((*s != '+') && (*s != '-')) || (n == WAVE_MAX_PASSOS)) return -1;
+      wave_passo_t *p = &passos_wave[n++];
+      p->liga = (*s++ == '+');
+      p->mask = 0;
+      p->us = 0;
+      for(int i=0; (d = hex_value(*s)) >= 0; i++, s++) {
+         if(i == 16) return -1;
+         p->mask = (p->mask << 4) | d;
+      }
+      if((p->mask == 0) || (p->mask & ~GPIO_MASK_TODOS) || (*s++ != '/')) return -1;
+      if((*s < '0') || (*s > '9')) return -1;
+      while((*s >= '0') && (*s <= '9')) p->us = p->us * 10 + (*s++ - '0');
+      if((*s != ' ') && (*s != 0)) return -1;
+   }
+}
 
-executa:
-   bkpt_activate();
-   uart_break_enable();
-   asm volatile ("b switch_back");
-   goto retry;
+/**
+ * Reproduz uma forma de onda nos GPIOs por DMA, sem uso da CPU: "play"
+ * executa os passos uma vez e "loop" os repete até "stop". "morse" repete
+ * a mensagem no LED, na velocidade do $pWPM. Sem argumentos, informa o
+ * estado do gerador.
+ * Formato do comando: $pWAVE [play|loop <passos>]
+ *                     $pWAVE [morse <mensagem>]
+ *                     $pWAVE [stop]
+ */
+static int trata_wave(cmd_args_t *args) {
+   int n, repete = 1;
+
+   if(args->argc == 0) {
+      if(wave_ativa()) {
+         uart_puts("WAVE: ativa, periodo ");
+         senddec(wave_periodo());
+         uart_puts(" us");
+      } else uart_puts("WAVE: parada");
+      return CMD_PRONTO;
+   }
 
-trata_morse:
-   /*
-   * Pisca uma palavra formada por caracteres alfanuméricos em código morse pelo LED verde da placa. 
-   * A palavra pode ter até 99 caracteres.
-   * Formato do comando: $pMORSE <palavra>
-   */
-   skip(' ');
-   char palavra[100];
-   int letra = 0;
-   uint8_t caractere = uart_getc();
-   char caractere_char = (char) caractere;
-   while (caractere_char != '\r' && letra < 99) {
-      palavra[letra] = caractere_char;
-      letra++;
-      caractere = uart_getc();
-      caractere_char = (char) caractere;
+   if(mesmo_nome(args->str[0], "stop")) {
+      if(args->argc > 1) return CMD_ERRO;
+      wave_stop();
+      return CMD_ENVIA_OK;
    }
-   uart_puts("+");
+   if(args->argc < 2) return CMD_ERRO;
+   if(mesmo_nome(args->str[0], "morse")) {
+      n = morse_wave(args->str[1], passos_wave, WAVE_MAX_PASSOS);
+   } else {
+      repete = mesmo_nome(args->str[0], "loop");
+      if(!repete && !mesmo_nome(args->str[0], "play")) return CMD_ERRO;
+      n = le_passos(args->str[1]);
+   }
+   if((n <= 0) || (wave_play(passos_wave, n, repete) < 0)) return CMD_ERRO;
+   return CMD_ENVIA_OK;
+}
 
-   for (int i = 0; i < letra; i++) {
-      char_to_morse(palavra[i]);
-      uart_putc(palavra[i]);
-      gpio_put(47, 0); // Desliga
-      delay(3000000); // Espaço entre caracteres (3 unidades)
+/**
+ * Troca a velocidade da uart. A placa anuncia "BAUD <velocidade>" na
+ * velocidade atual e passa a usar a nova; o computador deve então enviar
+ * "BAUD" na nova velocidade em até 2 s, e a placa confirma com "OK".
+ * Sem resposta, a velocidade anterior é restaurada.
+ * Sem argumento, informa a velocidade atual.
+ * Formato do comando: $pBAUD [velocidade]
+ */
+#define TIMEOUT_BAUD       2000000
+static int trata_baud(cmd_args_t *args) {
+   static const char confirma[] = "BAUD";
+   uint32_t anterior = uart_get_baud();
+   uint32_t baud = args->v[0];
+
+   if(args->argc == 0) {
+      senddec(anterior);
+      return CMD_PRONTO;
    }
-   goto retry;
+   if(!uart_baud_valid(baud)) return CMD_ERRO;
 
-trata_search:
-   /*
-   * Conta o número de ocorrências de uma palavra de dados na memória (até 4 caracteres)
-   */
-   skip(' ');
-   uint8_t first = char_to_hex(uart_getc());
-   uint8_t second = char_to_hex(uart_getc());
-   uint8_t third = char_to_hex(uart_getc());
-   uint32_t search_word = (first << 12) | (second << 8) | (third << 4) | char_to_hex(uart_getc());     // palavra de dados
-   skip(' ');
-   uint32_t start_address_search = readword(' ');                   // endereço inicial
-   uint32_t search_size = readword('\r');                   // tamanho da área de dados
-
-   uint8_t times_search = compbytes(search_word, (uint8_t *) start_address_search, search_size);
+   uart_puts("BAUD ");
+   senddec(baud);
+   uart_puts("\r\n");
+   uart_set_baud(baud);
+   uart_discard();
+
+   uint32_t prazo = timer_deadline(TIMEOUT_BAUD);
+   uint32_t k = 0;
+   while(!timer_expired(prazo)) {
+      int c = uart_try_getc();
+      if(c < 0) continue;
+      if(c == confirma[k]) k++;
+      else k = (c == confirma[0]) ? 1 : 0;
+      if(confirma[k] == 0) {
+         uart_puts("OK");
+         return CMD_PRONTO;
+      }
+   }
 
-   uart_puts("A palavra ");
-   uart_puts(search_word);
-   uart_puts(" aparece ");
-   uart_putc(hex_to_char(times_search));
-   uart_puts(" vezes na area procurada.");
-   goto retry;
+   uart_set_baud(anterior);
+   uart_discard();
+   uart_puts("Sem resposta; velocidade mantida em ");
+   senddec(anterior);
+   return CMD_PRONTO;
+}
 
-trata_checksum:
-   /*
-   * Faz o checksum de uma área de memória.
-   */
-  sendbytes((uint8_t*) 400, 32);
-  goto retry;
+/**
+ * Configura os níveis de disparo das FIFOs de recepção e transmissão
+ * (0 = 1/8, 1 = 1/4, 2 = 1/2, 3 = 3/4, 4 = 7/8 das 16 posições).
+ * Formato do comando: $pFIFO <nível rx> <nível tx>
+ */
+static int trata_fifo(cmd_args_t *args) {
+   if(uart_set_fifo(args->v[0], args->v[1]) < 0) return CMD_ERRO;
+   return CMD_ENVIA_OK;
+}
 
-trata_echo:
-   /*
-   * Envia uma mensagem para a placa, e retorna ela pela UART, para garantir seu funcionamento.
-   * A mensagem pode ter até 99 caracteres.
-   * Formato do comando $pECHO <palavra>
-   */
-   skip(' ');
-   char palavra_echo[100];
-   int letra_echo = 0;
-   uint8_t caractere_echo = uart_getc();
-   char caractere_char_echo = (char) caractere_echo;
-   while (caractere_char_echo != '\r' && letra_echo < 99) {
-      palavra_echo[letra_echo] = caractere_echo;
-      letra_echo++;
-      caractere_echo = uart_getc();
-      caractere_char_echo = (char) caractere_echo;
-   }
+/**
+ * Envia uma mensagem para a placa, e retorna ela pela UART, para garantir seu funcionamento.
+ * A mensagem pode ter até 99 caracteres.
+ * Formato do comando $pECHO <palavra>
+ */
+static int trata_echo(cmd_args_t *args) {
+   char *palavra_echo = args->str[0];
    uart_puts("+");
 
-   for (int j = 0; j < letra_echo; j++) {
+   for (int j = 0; (j < 99) && palavra_echo[j]; j++) {
       uart_putc(palavra_echo[j]);
    }
    uart_puts("\r\n");
-   goto retry;
+   return CMD_PRONTO;
+}
 
-trata_dectobin:
-   /*
-   * Converte um número fornecido de decimal para binário, tratando casos negativos com complemento de dois, e envia-o serialmente.
-   * O limite do valor decimal é de 2147483647
-   * Formato do comando $pBIN <número decimal>
-   */
-        skip(' ');
-
-        int numero_decimal = 0;
-        int is_negative = 0;
-        uint8_t char_decimal = uart_getc();
-
-        if (char_decimal == '-') {
-            is_negative = 1;
-            char_decimal = uart_getc();
-        }
-
-        while (char_decimal != '\r') {
-            int algarismo_decimal = char_to_hex((char)char_decimal);
-            numero_decimal = numero_decimal * 10 + algarismo_decimal;
-            char_decimal = uart_getc();
-        }
-
-        if (is_negative) {
-            numero_decimal = -numero_decimal;
-        }
-
-        uart_puts(">");
-
-        uint32_t numero_binario = (uint32_t)numero_decimal;
-        int algarismos_binarios = 32;
-        char bin_str[33];
-        bin_str[32] = '\0';
-
-        for (int i = 31; i >= 0; i--) {
-            bin_str[i] = (numero_binario & 1) ? '1' : '0';
-            numero_binario >>= 1;
-        }
-
-        uart_puts(bin_str);
-        if(is_negative){
-        	uart_puts(" (Complemento de Dois)");
-        }
-        uart_puts("\r\n");
-        
-   goto retry;
-
-trata_g:
-   /*
-    * Envia todos os registradores.
-    */
-   ack();
+/**
+ * Converte um número fornecido de decimal para binário, tratando casos negativos com complemento de dois, e envia-o serialmente.
+ * O limite do valor decimal é de 2147483647
+ * Formato do comando $pBIN <número decimal>
+ */
+static int trata_dectobin(cmd_args_t *args) {
+   int numero_decimal = (int)args->v[0];
+
+   uart_puts(">");
+
+   uint32_t numero_binario = (uint32_t)numero_decimal;
+   char bin_str[33];
+   bin_str[32] = '\0';
+
+   for (int i = 31; i >= 0; i--) {
+      bin_str[i] = (numero_binario & 1) ? '1' : '0';
+      numero_binario >>= 1;
+   }
+
+   uart_puts(bin_str);
+   if(numero_decimal < 0){
+      uart_puts(" (Complemento de Dois)");
+   }
+   uart_puts("\r\n");
+   return CMD_PRONTO;
+}
+
+/**
+ * Envia todos os registradores.
+ */
+static int trata_g(cmd_args_t *args) {
    sendbytes((uint8_t*)user_regs, sizeof(user_regs));
-   goto retry;
+   return CMD_PRONTO;
+}
 
-trata_G:
-   /*
-    * Altera todos os registradores.
-    */
-   readbytes((uint8_t*)user_regs, sizeof(user_regs));
-   ack();
-   goto envia_ok;
+/**
+ * Altera todos os registradores.
+ * Formato do comando: G<registradores em hexadecimal>
+ */
+static int trata_G(cmd_args_t *args) {
+   hex_decode((uint8_t*)user_regs, args->str[0], sizeof(user_regs));
+   return CMD_ENVIA_OK;
+}
 
-trata_P:
-   /*
-    * Altera um dos registradores.
-    */
-   a = readword('=');                   // índice do registrador
-   s = readword('#');
-   uart_getc();
-   uart_getc();
-   uart_putc('+');
-   if(a <= NUM_REGS) {
-      user_regs[a] = endian_change(s);
+/**
+ * Altera um dos registradores.
+ * Formato do comando: P<índice>=<valor>
+ */
+static int trata_P(cmd_args_t *args) {
+   uint32_t a = args->v[0];                   // índice do registrador
+   if(a < NUM_REGS) {
+      user_regs[a] = endian_change(args->v[1]);
    }
-   goto envia_ok;
+   return CMD_ENVIA_OK;
+}
 
-trata_m:
-   /*
-    * Lê memória.
-    */
-   skip(' ');
-   a = readword(' ');                   // endereço inicial
-   s = readword('\r');                   // tamanho
+/**
+ * Lê memória.
+ * Formato do comando: m <endereço inicial> <tamanho>
+ */
+static int trata_m(cmd_args_t *args) {
+   sendbytes((uint8_t*)args->v[0], args->v[1]);
+   return CMD_PRONTO;
+}
 
-   sendbytes((uint8_t*)a, s);
-   goto retry;
+/**
+ * Escreve memória.
+ * Formato do comando: M <endereço inicial> <tamanho>, seguido pelos dados
+ * em hexadecimal.
+ */
+static int trata_M(cmd_args_t *args) {
+   readbytes((uint8_t*)args->v[0], args->v[1]);
+   cache_sync_code((void*)args->v[0], args->v[1]);
+   return CMD_PRONTO;
+}
 
-trata_M:
-   /*
-    * Escreve memória.
-    */
-   skip(' ');
-   a = readword(' ');                   // endereço inicial
-   s = readword('\r');                   // tamanho
+/**
+ * Lê memória em modo binário (quadros com escape, CRC e janela de confirmações).
+ * Formato do comando: x <endereço> <tamanho>
+ */
+static int trata_x(cmd_args_t *args) {
+   if(xfer_send((uint8_t*)args->v[0], args->v[1]) < 0) return CMD_ERRO;
+   return CMD_PRONTO;
+}
 
-   readbytes((uint8_t*)a, s);
-   goto retry;
+/**
+ * Escreve memória em modo binário.
+ * Formato do comando: X <endereço> <tamanho>, seguido pelos quadros.
+ */
+static int trata_X(cmd_args_t *args) {
+   if(xfer_recv((uint8_t*)args->v[0], args->v[1]) < 0) return CMD_ERRO;
+   cache_sync_code((void*)args->v[0], args->v[1]);
+   return CMD_ENVIA_OK;
+}
 
-trata_status:
-   /*
-    * Envia o último sinal.
-    */
-   ack();
-   uart_puts("$S");
-   chk = 'S' + sendbyte(user_status);
+/**
+ * Lê memória em modo binário com compressão: os mesmos quadros do comando x,
+ * com cada bloco comprimido (ver xfer.h e lz.h). Ao final informa o tamanho
+ * transmitido em relação à área (o comando m transmite 200%).
+ * Formato do comando: $pMZ <endereço> <tamanho>
+ */
+static int trata_mz(cmd_args_t *args) {
+   uint32_t s = args->v[1], enviados;
+   if(s == 0) return CMD_ERRO;
+   if(xfer_send_lz((uint8_t*)args->v[0], s, &enviados) < 0) return CMD_ERRO;
+
+   uint32_t pm = (uint32_t)((uint64_t)enviados * 1000 / s);
+   uart_puts("MZ: ");
+   senddec(s);
+   uart_puts(" bytes em ");
+   senddec(enviados);
+   uart_puts(" (");
+   senddec(pm / 10);
+   uart_putc('.');
+   senddec(pm % 10);
+   uart_puts("%)");
+   return CMD_PRONTO;
+}
+
+/**
+ * Conclui uma carga: informa o resultado e, se pedido, executa o programa
+ * a partir do ponto de entrada (registro de início ou primeiro endereço).
+ */
+static int fim_carga(int res, load_info_t *info, uint32_t us, int executa, int hex) {
+   static char *erros[] = { "", "checksum incorreto", "formato invalido",
+                            "area sobre o PiCLIs", "tempo esgotado", "cancelada" };
+
+   if(info->bytes) cache_sync_code((void*)info->inicio, info->fim - info->inicio);
+   if(res != LOAD_OK) {
+      uart_puts("LOAD: ");
+      uart_puts(erros[-res]);
+      if(hex && (res != LOAD_TIMEOUT) && (res != LOAD_CANCELADO)) {
+         uart_puts(" no registro ");
+         senddec(info->registros + 1);
+      }
+      return CMD_PRONTO;
+   }
+   informa_vazao("LOAD", info->bytes, us);
+   uart_puts(", ");
+   senddec(info->registros);
+   uart_puts(" registros, ");
+   sendword(info->inicio);
+   uart_puts(" a ");
+   sendword(info->fim);
+   uart_puts(", crc32 = ");
+   sendword(info->crc);
+   if(!executa) return CMD_PRONTO;
+
+   if(info->tem_entrada) PC = info->entrada;
+   else if(info->bytes) PC = info->inicio;
+   else return CMD_ERRO;
+   uart_puts("\r\n");
+   return CMD_EXECUTA;
+}
+
+/**
+ * Carrega registros Intel HEX enviados em seguida ao comando, conferindo o
+ * checksum de cada registro, até o registro de fim. Com "go", executa o
+ * programa carregado.
+ * Formato do comando: $pLOAD [go]
+ */
+static int trata_load(cmd_args_t *args) {
+   load_info_t info;
+   int go = opcao(args, 0, "go");
+   if(go < 0) return CMD_ERRO;
+
+   uint32_t t0 = timer_ticks();
+   int res = load_hex(&info);
+   return fim_carga(res, &info, timer_ticks() - t0, go, 1);
+}
+
+/**
+ * Carrega uma imagem binária de tamanho conhecido, enviada em seguida ao
+ * comando. Com "go", executa a partir do endereço de destino.
+ * Formato do comando: $pLOADB <endereço> <tamanho> [go]
+ */
+static int trata_loadb(cmd_args_t *args) {
+   load_info_t info;
+   int go = opcao(args, 2, "go");
+   if(go < 0) return CMD_ERRO;
+
+   uint32_t t0 = timer_ticks();
+   int res = load_bin(&info, (uint8_t*)args->v[0], args->v[1]);
+   return fim_carga(res, &info, timer_ticks() - t0, go, 0);
+}
+
+/**
+ * Envia o último sinal.
+ */
+static int trata_status(cmd_args_t *args) {
+   uint8_t chk;
+   if((parada_hw == HWDBG_WATCH) && parada_watch) {
+      uart_puts("$T");
+      chk = 'T' + sendbyte(user_status);
+      uart_puts("watch:");
+      chk += 'w' + 'a' + 't' + 'c' + 'h' + ':';
+      for(int i=24; i>=0; i-=8) chk += sendbyte(parada_watch >> i);
+      uart_putc(';');
+      chk += ';';
+   } else {
+      uart_puts("$S");
+      chk = 'S' + sendbyte(user_status);
+   }
    uart_putc('#');
    sendbyte(chk);
-   goto retry;
+   return CMD_PRONTO;
+}
+
+/**
+ * Continua a execução, opcionalmente a partir de outro endereço.
+ * Formato do comando: c [endereço]
+ */
+static int trata_c(cmd_args_t *args) {
+   if(args->argc > 0) PC = args->v[0];
+   return CMD_EXECUTA;
+}
+
+/**
+ * Executa a próxima instrução.
+ * Introduz um trap na instrução que será executada em seguida, calculada
+ * a partir da instrução atual (desvios, bx, ldm/ldr com pc, Thumb).
+ */
+static int trata_s(cmd_args_t *args) {
+   if(args->argc > 0) PC = args->v[0];
+   bkpt_set_step(next_pc(user_regs));
+   return CMD_EXECUTA;
+}
+
+/**
+ * Executa várias instruções passo a passo sem consultar o depurador entre
+ * elas; para antes ao chegar a um breakpoint ativo.
+ * Formato do comando: $pSTEP <quantidade>
+ */
+static int trata_pstep(cmd_args_t *args) {
+   if(args->v[0] == 0) return CMD_ERRO;
+   passos_restantes = args->v[0] - 1;
+   bkpt_set_step(next_pc(user_regs));
+   return CMD_EXECUTA;
+}
+
+/**
+ * Inclui um breakpoint. Usa a unidade de depuração quando houver registrador
+ * livre, senão uma instrução de trap.
+ * Formato do comando: Z0,<endereço>,<tamanho> ou Z1,<endereço>,<tamanho>
+ */
+static int trata_Z0(cmd_args_t *args) {
+   uint32_t kind = (args->argc > 1) ? args->v[1] : 4;
+   if(bkpt_add(args->v[0], kind)) return CMD_ENVIA_OK;
+   return CMD_ERRO;
+}
+
+/**
+ * Remove um breakpoint.
+ * Formato do comando: z0,<endereço>,<tamanho> ou z1,<endereço>,<tamanho>
+ */
+static int trata_z0(cmd_args_t *args) {
+   bkpt_remove(args->v[0]);
+   return CMD_ENVIA_OK;
+}
+
+/**
+ * Lista os breakpoints: endereço, implementação (hw ou sw), ativo,
+ * paradas e paradas a ignorar.
+ * Formato do comando: $pBKLIST
+ */
+static int trata_bklist(cmd_args_t *args) {
+   uint32_t i = 0;
+   bkpt_t *b;
+   while((b = bkpt_next(&i))) {
+      sendword(b->addr);
+      uart_puts(b->hw ? " hw " : " sw ");
+      uart_puts(b->ativo ? "ativo " : "inativo ");
+      senddec(b->hits);
+      uart_putc(' ');
+      senddec(b->ignorar);
+      if(b->cond) uart_puts(" cond");
+      uart_puts("\r\n");
+   }
+   senddec(bkpt_count());
+   uart_puts(" breakpoints");
+   return CMD_PRONTO;
+}
+
+/**
+ * Define quantas paradas de um breakpoint serão ignoradas: o PiCLIs conta
+ * a parada e continua a execução sem consultar o depurador.
+ * Formato do comando: $pBKIGN <endereço> <paradas>
+ */
+static int trata_bkign(cmd_args_t *args) {
+   bkpt_t *b = bkpt_find(args->v[0]);
+   if(b == 0) return CMD_ERRO;
+   b->ignorar = args->v[1];
+   return CMD_ENVIA_OK;
+}
+
+/**
+ * Ativa (1) ou desativa (0) um breakpoint, mantendo suas contagens.
+ * Formato do comando: $pBKEN <endereço> <0 ou 1>
+ */
+static int trata_bken(cmd_args_t *args) {
+   bkpt_t *b = bkpt_find(args->v[0]);
+   if(b == 0) return CMD_ERRO;
+   bkpt_enable(b, args->v[1]);
+   return CMD_ENVIA_OK;
+}
+
+/**
+ * Associa a um breakpoint um programa de condição/ação (bytecode descrito em
+ * agent.h), avaliado pelo PiCLIs a cada parada: o depurador só é consultado
+ * quando o programa decidir parar. Sem o bytecode, remove o programa.
+ * Formato do comando: $pBKCOND <endereço> [bytecode em hexadecimal]
+ */
+static int trata_bkcond(cmd_args_t *args) {
+   uint8_t codigo[AGENT_MAX_CODIGO];
+   uint32_t len = 0;
+   int prog = 0;
+   bkpt_t *b = bkpt_find(args->v[0]);
+   if(b == 0) return CMD_ERRO;
+   if(args->argc > 1) {
+      while(args->str[1][len]) len++;
+      if((len & 1) || (len > 2 * AGENT_MAX_CODIGO)) return CMD_ERRO;
+      len /= 2;
+      if(hex_decode(codigo, args->str[1], len) != len) return CMD_ERRO;
+      prog = agent_store(codigo, len);
+      if(prog < 0) return CMD_ERRO;
+   }
+   agent_free(b->cond);
+   b->cond = prog;
+   return CMD_ENVIA_OK;
+}
+
+/**
+ * Lista os registros de trace gravados pelos programas dos breakpoints:
+ * pc, instante (us) e dados em hexadecimal; "c" descarta os registros.
+ * Formato do comando: $pTRACE [c]
+ */
+static int trata_trace(cmd_args_t *args) {
+   static uint8_t dados[AGENT_TRACE_MAX];
+   uint32_t pc, tempo, len, n = 0;
+   if(args->argc > 0) {
+      if((args->str[0][0] != 'c') || args->str[0][1]) return CMD_ERRO;
+      agent_trace_clear();
+      return CMD_ENVIA_OK;
+   }
+   while(agent_trace_next(&pc, &tempo, dados, &len)) {
+      sendword(pc);
+      uart_putc(' ');
+      senddec(tempo);
+      if(len) {
+         uart_putc(' ');
+         hex_encode(hex_buf, dados, len);
+         uart_write((uint8_t*)hex_buf, 2 * len);
+      }
+      uart_puts("\r\n");
+      n++;
+   }
+   senddec(n);
+   uart_puts(" registros, ");
+   senddec(agent_trace_lost());
+   uart_puts(" perdidos");
+   return CMD_PRONTO;
+}
+
+/**
+ * Inclui ou remove um watchpoint de escrita (2), leitura (3) ou acesso (4).
+ */
+static int watchpoint(cmd_args_t *args, int tipo, int inclui) {
+   uint32_t len = (args->argc > 1) ? args->v[1] : 4;
+   int res;
+   if(inclui) res = hwdbg_watch_add(args->v[0], len, tipo);
+   else res = hwdbg_watch_remove(args->v[0], len, tipo);
+   return (res < 0) ? CMD_ERRO : CMD_ENVIA_OK;
+}
+
+/*
+ * Formato dos comandos: Z2,<endereço>,<tamanho> (escrita), Z3 (leitura),
+ * Z4 (acesso) e z2, z3, z4 para remover.
+ */
+static int trata_Z2(cmd_args_t *args) { return watchpoint(args, HWDBG_ESCRITA, 1); }
+static int trata_Z3(cmd_args_t *args) { return watchpoint(args, HWDBG_LEITURA, 1); }
+static int trata_Z4(cmd_args_t *args) { return watchpoint(args, HWDBG_ACESSO, 1); }
+static int trata_z2(cmd_args_t *args) { return watchpoint(args, HWDBG_ESCRITA, 0); }
+static int trata_z3(cmd_args_t *args) { return watchpoint(args, HWDBG_LEITURA, 0); }
+static int trata_z4(cmd_args_t *args) { return watchpoint(args, HWDBG_ACESSO, 0); }
+
+/**
+ * Desconecta (D) ou encerra (k) a sessão do depurador.
+ */
+static int trata_D(cmd_args_t *args) {
+   return CMD_ENVIA_OK;
+}
+
+/*
+ * Tarefas em segundo plano: a área é dividida em blocos executados pelos
+ * núcleos secundários, e o núcleo 0 continua atendendo a linha de comandos.
+ * Os resultados parciais de cada bloco são combinados por $pJOB.
+ */
+#define TAREFA_NENHUMA     0
+#define TAREFA_BUSCA       1
+#define TAREFA_CRC32       2
+#define TAREFA_ADLER32     3
+#define TAREFA_MEMTEST     4
+
+static struct {
+   mc_job_t job;
+   int tipo;
+   search_t busca;
+   uint32_t res[MC_MAX_BLOCOS];      // ocorrências, checksum ou erros do bloco
+   uint32_t addr[MC_MAX_BLOCOS];     // primeira ocorrência ou primeiro erro (0 = nenhum)
+} tarefa;
+
+/**
+ * Verifica se uma nova tarefa pode ser iniciada.
+ */
+static bool tarefa_livre(void) {
+   return (tarefa.tipo == TAREFA_NENHUMA) || mc_done(&tarefa.job);
+}
+
+static void marca_ocorrencia(uint32_t addr, void *ctx) {
+   uint32_t *primeira = ctx;
+   if(*primeira == 0) *primeira = addr;
+}
+
+/**
+ * Busca em um bloco. Ocorrências que começam no bloco e terminam no
+ * seguinte também são contadas.
+ */
+static void busca_bloco(void *ctx, uint32_t bloco, uint32_t inicio, uint32_t tam) {
+   uint32_t resta = tarefa.job.tam - (inicio - tarefa.job.inicio);
+   uint32_t n = tam + tarefa.busca.len - 1;
+   if(n > resta) n = resta;
+   tarefa.addr[bloco] = 0;
+   tarefa.res[bloco] = search_run(&tarefa.busca, inicio, n, marca_ocorrencia, &tarefa.addr[bloco]);
+}
+
+static void checksum_bloco(void *ctx, uint32_t bloco, uint32_t inicio, uint32_t tam) {
+   if(tarefa.tipo == TAREFA_CRC32) tarefa.res[bloco] = crc32(0, (void*)inicio, tam);
+   else tarefa.res[bloco] = adler32(1, (void*)inicio, tam);
+}
+
+/**
+ * Teste de memória: escreve em cada palavra o próprio endereço (e depois o
+ * complemento) e confere. O cache é descarregado entre a escrita e a leitura
+ * para que a conferência seja feita na RAM.
+ */
+static void memtest_bloco(void *ctx, uint32_t bloco, uint32_t inicio, uint32_t tam) {
+   volatile uint32_t *p = (uint32_t*)inicio;
+   uint32_t n = tam / 4, erros = 0, primeiro = 0;
+
+   for(uint32_t inv = 0; ; inv = 0xffffffff) {
+      for(uint32_t i=0; i<n; i++) p[i] = (uint32_t)&p[i] ^ inv;
+      cache_flush((void*)inicio, tam);
+      for(uint32_t i=0; i<n; i++) {
+         if(p[i] != ((uint32_t)&p[i] ^ inv)) {
+            if(erros == 0) primeiro = (uint32_t)&p[i];
+            erros++;
+         }
+      }
+      if(inv) break;
+   }
+   tarefa.res[bloco] = erros;
+   tarefa.addr[bloco] = primeiro;
+}
+
+/**
+ * Inicia uma tarefa em segundo plano e informa quantos núcleos a executam.
+ */
+static int inicia_tarefa(int tipo, mc_func_t f, uint32_t inicio, uint32_t tam, uint32_t alinhamento) {
+   tarefa.tipo = tipo;
+   if(mc_start(&tarefa.job, f, 0, inicio, tam, alinhamento) < 0) return CMD_ERRO;
+   uart_puts("Tarefa iniciada: ");
+   senddec(tarefa.job.nblocos);
+   uart_puts(" blocos, ");
+   senddec(mc_nucleos());
+   uart_puts(" nucleos. Use $pJOB para acompanhar.");
+   return CMD_PRONTO;
+}
+
+/**
+ * Conta as ocorrências de um padrão usando os núcleos secundários.
+ * Formato do comando: $pPSCH <padrão> <endereço> <tamanho> [máscara] [alinhamento]
+ */
+static int trata_psearch(cmd_args_t *args) {
+   if(!tarefa_livre()) return CMD_ERRO;
+   if(compila_busca(&tarefa.busca, args) < 0) return CMD_ERRO;
+   return inicia_tarefa(TAREFA_BUSCA, busca_bloco, args->v[1], args->v[2], tarefa.busca.align);
+}
+
+/**
+ * Calcula o checksum de uma área usando os núcleos secundários.
+ * Algoritmos: crc32 (padrão) ou adler32 (os que podem ser combinados por blocos).
+ * Formato do comando: $pPCHK <endereço> <tamanho> [algoritmo]
+ */
+static int trata_pchecksum(cmd_args_t *args) {
+   int tipo = TAREFA_CRC32;
+   if(!tarefa_livre()) return CMD_ERRO;
+   if(args->argc > 2) {
+      if(mesmo_nome(args->str[2], "adler32")) tipo = TAREFA_ADLER32;
+      else if(!mesmo_nome(args->str[2], "crc32")) return CMD_ERRO;
+   }
+   return inicia_tarefa(tipo, checksum_bloco, args->v[0], args->v[1], 1);
+}
+
+/**
+ * Teste de memória (destrutivo) usando os núcleos secundários.
+ * A área deve estar alinhada em palavras, fora do PiCLIs e dos periféricos.
+ * Formato do comando: $pMT <endereço> <tamanho>
+ */
+static int trata_memtest(cmd_args_t *args) {
+   extern uint8_t piclis_fim[];
+   uint32_t inicio = args->v[0], tam = args->v[1];
+   if(!tarefa_livre()) return CMD_ERRO;
+   if((inicio | tam) & 3) return CMD_ERRO;
+   if((inicio < (uint32_t)piclis_fim) || (inicio >= PERIPH_BASE)) return CMD_ERRO;
+   if(tam > PERIPH_BASE - inicio) return CMD_ERRO;
+   return inicia_tarefa(TAREFA_MEMTEST, memtest_bloco, inicio, tam, 4);
+}
+
+/**
+ * Mostra o andamento ou o resultado da tarefa em segundo plano.
+ * Formato do comando: $pJOB [stop]
+ */
+static int trata_job(cmd_args_t *args) {
+   mc_job_t *j = &tarefa.job;
+   if(tarefa.tipo == TAREFA_NENHUMA) {
+      uart_puts("Nenhuma tarefa.");
+      return CMD_PRONTO;
+   }
+   if(args->argc > 0) {
+      if(!mesmo_nome(args->str[0], "stop")) return CMD_ERRO;
+      if(!mc_done(j)) mc_cancel(j);
+      return CMD_ENVIA_OK;
+   }
+   if(!mc_done(j)) {
+      uart_puts("Executando: ");
+      senddec(j->concluidos);
+      uart_putc('/');
+      senddec(j->nblocos);
+      uart_puts(" blocos");
+      return CMD_PRONTO;
+   }
+   if(j->cancelada) {
+      uart_puts("Tarefa cancelada.");
+      return CMD_PRONTO;
+   }
+
+   uint32_t total = 0, primeiro = 0;
+   if(tarefa.tipo == TAREFA_ADLER32) total = 1;
+   for(uint32_t i=0; i<j->nblocos; i++) {
+      uint32_t tam = (i == j->nblocos - 1) ? j->tam - i * j->bloco : j->bloco;
+      switch(tarefa.tipo) {
+         case TAREFA_CRC32:
+            total = crc32_combine(total, tarefa.res[i], tam);
+            break;
+         case TAREFA_ADLER32:
+            total = adler32_combine(total, tarefa.res[i], tam);
+            break;
+         default:
+            total += tarefa.res[i];
+            if(primeiro == 0) primeiro = tarefa.addr[i];
+            break;
+      }
+   }
+
+   switch(tarefa.tipo) {
+      case TAREFA_BUSCA:
+         senddec(total);
+         uart_puts(" ocorrencias");
+         if(total) {
+            uart_puts(", primeira em ");
+            sendword(primeiro);
+         }
+         break;
+      case TAREFA_CRC32:
+         uart_puts("crc32 = ");
+         sendword(total);
+         break;
+      case TAREFA_ADLER32:
+         uart_puts("adler32 = ");
+         sendword(total);
+         break;
+      case TAREFA_MEMTEST:
+         senddec(total);
+         uart_puts(" erros");
+         if(total) {
+            uart_puts(", primeiro em ");
+            sendword(primeiro);
+         }
+         break;
+   }
+   uart_puts(" (");
+   senddec(j->tam);
+   uart_puts(" bytes em ");
+   senddec(j->t_fim - j->t_inicio);
+   uart_puts(" us; blocos por nucleo:");
+   for(int n=0; n<MC_MAX_NUCLEOS; n++) {
+      uart_putc(' ');
+      senddec(mc_blocos(n));
+   }
+   uart_puts(")");
+   return CMD_PRONTO;
+}
+
+/*
+ * Tabela de comandos: nome, tratador e especificação dos argumentos (ver cmd.h).
+ */
+static const cmd_t comandos[] = {
+   { "?",        trata_status,     ""       },
+   { "g",        trata_g,          ""       },
+   { "G",        trata_G,          "s"      },
+   { "P",        trata_P,          "xx"     },
+   { "m",        trata_m,          "xx"     },
+   { "M",        trata_M,          "xx"     },
+   { "x",        trata_x,          "xx"     },
+   { "X",        trata_X,          "xx"     },
+   { "$pMZ",     trata_mz,         "xx"     },
+   { "$pLOAD",   trata_load,       "[w"     },
+   { "$pLOADB",  trata_loadb,      "xx[w"   },
+   { "c",        trata_c,          "[x"     },
+   { "s",        trata_s,          "[x"     },
+   { "$pSTEP",   trata_pstep,      "d"      },
+   { "Z0",       trata_Z0,         "x[x"    },
+   { "z0",       trata_z0,         "x[x"    },
+   { "Z1",       trata_Z0,         "x[x"    },
+   { "z1",       trata_z0,         "x[x"    },
+   { "Z2",       trata_Z2,         "xx"     },
+   { "z2",       trata_z2,         "xx"     },
+   { "Z3",       trata_Z3,         "xx"     },
+   { "z3",       trata_z3,         "xx"     },
+   { "Z4",       trata_Z4,         "xx"     },
+   { "z4",       trata_z4,         "xx"     },
+   { "D",        trata_D,          ""       },
+   { "k",        trata_D,          ""       },
+   { "$pBIN",    trata_dectobin,   "d"      },
+   { "$pCHK",    trata_checksum,   "xx[w"   },
+   { "$pSCH",    trata_search,     "wxx[wx" },
+   { "$pPSCH",   trata_psearch,    "wxx[wx" },
+   { "$pPCHK",   trata_pchecksum,  "xx[w"   },
+   { "$pMT",     trata_memtest,    "xx"     },
+   { "$pJOB",    trata_job,        "[w"     },
+   { "$pECHO",   trata_echo,       "s"      },
+   { "$pMORSE",  trata_morse,      "s"      },
+   { "$pWPM",    trata_wpm,        "d"      },
+   { "$pGPIO",   trata_gpio,       "[www"   },
+   { "$pCAP",    trata_cap,        "[www"   },
+   { "$pWAVE",   trata_wave,       "[ws"    },
+   { "$pDMA",    trata_dma,        "xxx"    },
+   { "$pFILL",   trata_fill,       "xxw[w"  },
+   { "$pCOPY",   trata_copy,       "xxx[w"  },
+   { "$pCMP",    trata_cmp,        "xxx"    },
+   { "$pBKLIST", trata_bklist,     ""       },
+   { "$pBKIGN",  trata_bkign,      "xd"     },
+   { "$pBKEN",   trata_bken,       "xd"     },
+   { "$pBKCOND", trata_bkcond,     "x[w"    },
+   { "$pTRACE",  trata_trace,      "[w"     },
+   { "$pBAUD",   trata_baud,       "[d"     },
+   { "$pFIFO",   trata_fifo,       "dd"     },
+};
+#define NUM_COMANDOS       (sizeof(comandos) / sizeof(comandos[0]))
+
+/**
+ * Retoma a execução do programa do usuário (não retorna).
+ * Se o programa parou em um breakpoint ou watchpoint, a instrução atual é
+ * executada antes sem o trap e com a unidade de depuração desligada; sem um
+ * passo pedido pelo depurador, a execução continua automaticamente depois dela.
+ */
+static void retoma(void) {
+   uint32_t exceto = 0;
+   bkpt_t *b = bkpt_find(PC);
+
+   enable_irq(0);                 // reabilitadas pelo CPSR do usuário
+   if((b && b->ativo) || ((parada_hw == HWDBG_WATCH) && (PC == parada_pc))) {
+      exceto = PC;
+      if(bkpt_step() == 0) {
+         bkpt_set_step(next_pc(user_regs));
+         passo_interno = 1;
+      }
+   }
+   bkpt_activate(exceto);
+   uart_break_enable();
+   VOLTA_USUARIO();
+}
+
+/**
+ * Volta ao programa do usuário sem mexer nos traps (não retorna).
+ */
+static void continua(void) {
+   enable_irq(0);
+   uart_break_enable();
+   VOLTA_USUARIO();
+}
+
+/**
+ * Paradas resolvidas sem o depurador, com os traps ainda na memória:
+ * fim do passo interno, passos intermediários do $pSTEP, breakpoints cujo
+ * programa decide continuar e paradas a ignorar. Retorna apenas se o depurador precisar ser avisado.
+ */
+static void parada_rapida(void) {
+   bkpt_t *b = bkpt_find(PC);
+   if(b && !b->ativo) b = 0;
+   if(passo_interno) {
+      if(PC != bkpt_step()) return;
+      passo_interno = 0;
+      bkpt_skip_done();
+      if(b == 0) continua();
+   }
+   if(passos_restantes && (b == 0) && (PC == bkpt_step())) {
+      passos_restantes--;
+      bkpt_skip_done();
+      bkpt_skip(user_regs);
+      continua();
+   }
+   if(b == 0) return;
+   b->hits++;
+   if(PC == bkpt_step()) return;             // passo pedido pelo depurador
+   int para = 1;
+   if(b->cond) para = (agent_run(b->cond, user_regs, b->hits) == AGENT_PARA);
+   if(para && b->ignorar) {                  // só conta paradas com a condição verdadeira
+      b->ignorar--;
+      para = 0;
+   }
+   if(para) return;
+   bkpt_skip(user_regs);
+   passo_interno = 1;
+   continua();
+}
+
+/**
+ * Ponto de entrada do loop de processamento de mensagens do stub.
+ */
+void piclis_main(int sig) {
+   static char linha[CMD_LINHA];
+   int pacote, res;
+
+   uart_break_disable();
+   enable_irq(1);
 
-trata_s:
    /*
-    * Executa a próxima instrução.
-    * Introduz um trap na instrução seguinte.
-    * (não funciona se for um salto...)
+    * Paradas pela unidade de depuração chegam como prefetch abort
+    * (breakpoint) ou data abort (watchpoint).
     */
-   ack();
-   bkpts[0].addr = PC + 4;
-   goto executa;
+   parada_hw = HWDBG_NENHUM;
+   if((sig == SIG_ABRT) || (sig == SIG_SEGV)) {
+      parada_hw = hwdbg_evento(sig == SIG_SEGV, &parada_watch);
+      if(parada_hw != HWDBG_NENHUM) sig = SIG_TRAP;
+   }
+   parada_pc = PC;
+   if((sig == SIG_TRAP) && (parada_hw != HWDBG_WATCH)) parada_rapida();
 
-trata_Z0:
    /*
-    * Inclui um breakpoint de software.
+    * Limpa brakepoints da memória
     */
-   uart_getc();        // ','
-   a = readword(',');
-   ack();
-   if(bkpt_add(a)) goto envia_ok;
-   goto envia_erro;
+   bkpt_restore_contents();
+   passo_interno = 0;
+   passos_restantes = 0;
+   bkpt_set_step(0);
 
-trata_z0:
    /*
-    * Remove um breakpoint de software.
+    * Envia status ao depurador.
     */
-   uart_getc();        // ','
-   a = readword(',');
-   ack();
-   bkpt_remove(a);
-   goto envia_ok;
+   user_status = sig;
+
+   for(;;) {
+      /*
+       * Espera uma mensagem.
+       */
+      uart_puts("\r\n> ");
+      res = cmd_readline(linha, sizeof(linha), &pacote);
+      if(pacote) uart_putc('+');            // responde com um acknowledge
+      if(res == 0) continue;
+
+      /*
+       * Identifica e executa a mensagem.
+       */
+      if(res < 0) res = CMD_ERRO;
+      else res = cmd_exec(linha);
+
+      switch(res) {
+         case CMD_ENVIA_OK:
+            uart_puts("$OK#9a");
+            break;
+         case CMD_ERRO:
+            uart_puts("$E01#a5");
+            break;
+         case CMD_NULO:
+            uart_puts("$#00");
+            break;
+         case CMD_EXECUTA:
+            retoma();
+            break;
+      }
+   }
 }
 
 /**
  * Inicialização em C.
  */
 void main(void) {
+   irq_init();
+   timer_init();
+   dma_init();
    uart_init();
-   gpio_init(47, 1);
-
-   delay(100);
+   hex_init();
+   cmd_init(comandos, NUM_COMANDOS);
+   checksum_init();
+   gpio_init(MORSE_GPIO, 1);
+   morse_init();
+   mc_init();
+   hwdbg_init();
+   bkpt_init();
+
+   delay_us(100);
    uart_puts("PiCLIs - Raspberry Pi CLI!\r\n");
    uart_puts("Por Henrique Murakami, Italo Lui e Rafael Tamasi\r\n");
+#if HOST
+   user_regs[13] = (uint32_t)(uintptr_t)&stack_svr;
+   PC = (uint32_t)(uintptr_t)&load_addr;
+#else
    asm volatile (
       "mov r0, #0x05 \n\t"
       "b piclis_main \n\t"
    );
+#endif
 }
 
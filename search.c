@@ -0,0 +1,122 @@
+#include "search.h"
+
+/**
+ * Prepara um padrão para busca.
+ * @param s Padrão compilado.
+ * @param padrao Bytes do padrão.
+ * @param mascara Máscara por byte (bits em 1 são comparados), ou 0 para comparar tudo.
+ * @param len Tamanho do padrão (1 a SEARCH_MAX_PADRAO).
+ * @param align Alinhamento exigido das ocorrências (potência de 2, 0 ou 1 = qualquer).
+ * @return 0 em caso de sucesso, -1 se os parâmetros forem inválidos.
+ */
+int search_compile(search_t *s, const uint8_t *padrao, const uint8_t *mascara,
+                   uint32_t len, uint32_t align) {
+   if((len == 0) || (len > SEARCH_MAX_PADRAO)) return -1;
+   if(align == 0) align = 1;
+   if(align & (align - 1)) return -1;
+
+   s->len = len;
+   s->align = align;
+   s->exato = 1;
+   for(uint32_t j=0; j<len; j++) {
+      s->mascara[j] = mascara ? mascara[j] : 0xff;
+      s->padrao[j] = padrao[j] & s->mascara[j];
+      if(s->mascara[j] != 0xff) s->exato = 0;
+   }
+
+   /*
+    * Tabela de saltos: para cada byte, a distância da sua ocorrência mais à
+    * direita no padrão (exceto a última posição) até o fim do padrão.
+    * Posições com máscara aceitam vários bytes.
+    */
+   for(int c=0; c<256; c++) s->salto[c] = len;
+   for(uint32_t j=0; j+1<len; j++) {
+      uint8_t d = len - 1 - j;
+      if(s->mascara[j] == 0xff) {
+         s->salto[s->padrao[j]] = d;
+         continue;
+      }
+      for(int c=0; c<256; c++) {
+         if((c & s->mascara[j]) == s->padrao[j]) s->salto[c] = d;
+      }
+   }
+   return 0;
+}
+
+/**
+ * Compara o padrão completo em uma posição.
+ */
+static int confere(const search_t *s, const uint8_t *p) {
+   for(uint32_t j=0; j<s->len; j++) {
+      if((p[j] & s->mascara[j]) != s->padrao[j]) return 0;
+   }
+   return 1;
+}
+
+/**
+ * Busca de uma palavra de 32 bits alinhada, quatro palavras por iteração.
+ */
+static uint32_t busca_palavra(const search_t *s, uint32_t inicio, uint32_t tam,
+                              search_cb_t cb, void *ctx) {
+   uint32_t primeiro = (inicio + 3) & ~3;
+   uint32_t w = s->padrao[0] | (s->padrao[1] << 8) | (s->padrao[2] << 16)
+              | (s->padrao[3] << 24);
+   uint32_t i = 0, n = 0, k;
+
+   if(primeiro - inicio >= tam) return 0;
+   const uint32_t *p = (const uint32_t*)primeiro;
+   uint32_t total = (tam - (primeiro - inicio)) / 4;
+
+   for(; i + 4 <= total; i += 4) {
+      if((p[i] == w) | (p[i+1] == w) | (p[i+2] == w) | (p[i+3] == w)) {
+         for(k=i; k<i+4; k++) {
+            if(p[k] != w) continue;
+            n++;
+            if(cb) cb((uint32_t)&p[k], ctx);
+         }
+      }
+   }
+   for(; i < total; i++) {
+      if(p[i] != w) continue;
+      n++;
+      if(cb) cb((uint32_t)&p[i], ctx);
+   }
+   return n;
+}
+
+/**
+ * Procura todas as ocorrências de um padrão em uma área de memória.
+ * @param s Padrão compilado por search_compile.
+ * @param inicio Endereço inicial da área.
+ * @param tam Tamanho da área em bytes.
+ * @param cb Função chamada para cada ocorrência (pode ser 0).
+ * @param ctx Argumento repassado a cb.
+ * @return Número de ocorrências.
+ */
+uint32_t search_run(const search_t *s, uint32_t inicio, uint32_t tam,
+                    search_cb_t cb, void *ctx) {
+   uint32_t ult = s->len - 1;
+   uint32_t pos, limite, n = 0;
+
+   if(tam == 0) return 0;
+   if(tam - 1 > 0xffffffff - inicio) tam = 0xffffffff - inicio + 1;  // até o fim do espaço de endereços
+   if(tam < s->len) return 0;
+   if(s->exato && (s->len == 4) && (s->align == 4)) {
+      return busca_palavra(s, inicio, tam, cb, ctx);
+   }
+
+   pos = inicio;
+   limite = inicio + (tam - s->len);        // última posição possível
+   for(;;) {
+      const uint8_t *p = (const uint8_t*)pos;
+      uint8_t c = p[ult];
+      if(((c & s->mascara[ult]) == s->padrao[ult]) && ((pos & (s->align - 1)) == 0)
+         && confere(s, p)) {
+         n++;
+         if(cb) cb(pos, ctx);
+      }
+      if(limite - pos < s->salto[c]) break;
+      pos += s->salto[c];
+   }
+   return n;
+}
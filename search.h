@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+
+#define SEARCH_MAX_PADRAO    64
+
+/*
+ * Padrão compilado para busca (Horspool com máscara por byte).
+ */
+typedef struct {
+   uint8_t padrao[SEARCH_MAX_PADRAO];
+   uint8_t mascara[SEARCH_MAX_PADRAO];
+   uint8_t salto[256];
+   uint32_t len;
+   uint32_t align;
+   int exato;                             // nenhum bit mascarado
+} search_t;
+
+/*
+ * Chamada para cada ocorrência encontrada.
+ */
+typedef void (*search_cb_t)(uint32_t addr, void *ctx);
+
+int search_compile(search_t *s, const uint8_t *padrao, const uint8_t *mascara,
+                   uint32_t len, uint32_t align);
+uint32_t search_run(const search_t *s, uint32_t inicio, uint32_t tam,
+                    search_cb_t cb, void *ctx);
@@ -0,0 +1,104 @@
+#include "bcm.h"
+#include "timer.h"
+
+/*
+ * O system timer conta microssegundos independentemente do clock do
+ * processador. O contador livre do ARM timer conta ciclos do clock APB,
+ * que depende da configuração de clock: sua frequência é medida em
+ * timer_init contra o system timer.
+ */
+#define CALIBRA_US           1000
+
+static uint32_t ciclos_us;                // 0 se o contador do ARM timer não estiver disponível
+
+/**
+ * Habilita o contador livre do ARM timer e mede sua frequência.
+ */
+void timer_init(void) {
+   uint32_t c0, t0;
+
+   TIMER_REG(control) = __bit(9);         // contador livre, sem divisor
+   t0 = SYSTIMER_REG(clo);
+   while(SYSTIMER_REG(clo) == t0) ;       // alinha com a borda do system timer
+   t0++;
+   c0 = TIMER_REG(counter);
+   while(SYSTIMER_REG(clo) - t0 < CALIBRA_US) ;
+   ciclos_us = (TIMER_REG(counter) - c0) / CALIBRA_US;
+}
+
+/**
+ * Frequência calibrada do contador livre do ARM timer.
+ * @return Ciclos por microssegundo, ou 0 se indisponível.
+ */
+uint32_t timer_cycles_per_us(void) {
+   return ciclos_us;
+}
+
+/**
+ * Instante atual em microssegundos (64 bits, monotônico).
+ */
+uint64_t timer_now(void) {
+   uint32_t hi, lo;
+   do {
+      hi = SYSTIMER_REG(chi);
+      lo = SYSTIMER_REG(clo);
+   } while(hi != SYSTIMER_REG(chi));
+   return ((uint64_t)hi << 32) | lo;
+}
+
+/**
+ * Parte baixa do instante atual, em microssegundos.
+ * Adequada para medir intervalos de até 71 minutos.
+ */
+uint32_t timer_ticks(void) {
+   return SYSTIMER_REG(clo);
+}
+
+/**
+ * Calcula um prazo a partir do instante atual.
+ * @param us Intervalo em microssegundos (até 2^31).
+ * @return Prazo para uso em timer_expired.
+ */
+uint32_t timer_deadline(uint32_t us) {
+   return SYSTIMER_REG(clo) + us;
+}
+
+/**
+ * Verifica se um prazo já passou.
+ * @param deadline Prazo obtido com timer_deadline.
+ */
+int timer_expired(uint32_t deadline) {
+   return (int32_t)(SYSTIMER_REG(clo) - deadline) >= 0;
+}
+
+/**
+ * Aguarda pelo menos o número de microssegundos indicado.
+ * @param us Tempo de espera.
+ */
+void delay_us(uint32_t us) {
+   uint32_t t0 = SYSTIMER_REG(clo);
+   while(SYSTIMER_REG(clo) - t0 <= us) ;  // a primeira contagem pode ser parcial
+}
+
+/**
+ * Aguarda pelo menos o número de milissegundos indicado.
+ * @param ms Tempo de espera.
+ */
+void delay_ms(uint32_t ms) {
+   while(ms--) delay_us(1000);
+}
+
+/**
+ * Aguarda pelo menos o número de nanossegundos indicado, com resolução
+ * de um ciclo do contador do ARM timer (ou de 1 us, se indisponível).
+ * @param ns Tempo de espera.
+ */
+void delay_ns(uint32_t ns) {
+   if(ciclos_us == 0) {
+      delay_us((ns + 999) / 1000);
+      return;
+   }
+   uint32_t c0 = TIMER_REG(counter);
+   uint32_t n = ((uint64_t)ns * ciclos_us + 999) / 1000;
+   while(TIMER_REG(counter) - c0 < n) ;
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+
+void timer_init(void);
+uint64_t timer_now(void);
+uint32_t timer_ticks(void);
+uint32_t timer_deadline(uint32_t us);
+int timer_expired(uint32_t deadline);
+void delay_ns(uint32_t ns);
+void delay_us(uint32_t us);
+void delay_ms(uint32_t ms);
+uint32_t timer_cycles_per_us(void);
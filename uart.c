@@ -1,38 +1,380 @@
-
 #include "bcm.h"
+#include "uart.h"
+#include "timer.h"
+#include "dma.h"
+#include "mmu.h"
+#include "irq.h"
 
 #define CTRL_C             0x03
 
+/*
+ * PL011 = 1: PL011 nos GPIOs 14/15 (ALT0), clock de referência fixo
+ * (init_uart_clock em config.txt), FIFOs de 16 posições e transmissão por DMA.
+ * PL011 = 0: mini UART (ALT5), clock derivado do núcleo da VPU.
+ */
+#ifndef PL011
+#define PL011 1
+#endif
+
+#if PL011
+#define UART_CLOCK         48000000
+#else
+#define UART_CLOCK         250000000
+#endif
+#define BAUD_PADRAO        115200
+#define ERRO_MAX_BAUD      3          // % de erro aceito na velocidade obtida
+
+/*
+ * Bits dos registradores do PL011
+ */
+#define FR_BUSY            __bit(3)
+#define FR_RXFE            __bit(4)
+#define FR_TXFF            __bit(5)
+#define FR_TXFE            __bit(7)
+#define LCRH_FEN           __bit(4)
+#define LCRH_WLEN8         (3 << 5)
+#define CR_UARTEN          __bit(0)
+#define CR_TXE             __bit(8)
+#define CR_RXE             __bit(9)
+#define INT_RX             __bit(4)
+#define INT_TX             __bit(5)
+#define INT_RT             __bit(6)
+#define INT_ERROS          (0x0f << 7)  // framing, paridade, break, overrun
+#define DMACR_TXDMAE       __bit(1)
+#define DREQ_UART_TX       12
+
+/*
+ * Transmissões contíguas a partir deste tamanho usam DMA (PL011).
+ */
+#define DMA_MIN            64
+
+/*
+ * Buffers circulares de transmissão e recepção.
+ * Os tamanhos devem ser potências de 2. Os índices crescem livremente
+ * e são reduzidos ao tamanho do buffer apenas no acesso.
+ */
+#define TX_BUF_SIZE        16384
+#define RX_BUF_SIZE        4096
+
+static uint8_t tx_buf[TX_BUF_SIZE];
+static uint8_t rx_buf[RX_BUF_SIZE];
+static volatile uint32_t tx_head, tx_tail;
+static volatile uint32_t rx_head, rx_tail;
+static volatile uint8_t break_ativo;
+static uint32_t baud_atual;
+
+#if PL011
+static int tx_dma = -1;                     // canal de DMA da transmissão
+static volatile uint32_t tx_dma_len;        // bytes em transmissão por DMA
+#endif
+
+/**
+ * Verifica se as interrupções estão desabilitadas no processador.
+ */
+static int irq_mascarada(void) {
+   return (get_cpsr() & 0x80) != 0;
+}
+
+#if PL011
+/**
+ * Conclui a transmissão por DMA, se tiver terminado.
+ * @return 1 se ainda houver transmissão por DMA em andamento.
+ */
+static int tx_dma_ativo(void) {
+   if(tx_dma_len == 0) return 0;
+   if(dma_busy(tx_dma)) return 1;
+   DMA_REG(tx_dma, cs) = DMA_CS_END | DMA_CS_INT;
+   tx_tail += tx_dma_len;
+   tx_dma_len = 0;
+   set_bit(PL011_REG(imsc), 5);             // volta a usar a interrupção da FIFO
+   return 0;
+}
+
+/**
+ * Transmite por DMA o trecho contíguo do buffer a partir de tx_tail.
+ * A FIFO pede dados (DREQ) sempre que fica abaixo do nível de disparo.
+ */
+static void tx_dma_inicia(uint32_t n) {
+   dma_cb_t *cb = dma_cbs(tx_dma);
+   uint8_t *src = &tx_buf[tx_tail & (TX_BUF_SIZE-1)];
+   cache_clean(src, n);
+   cb->ti = DMA_TI_SRC_INC | DMA_TI_DEST_DREQ | DMA_TI_PERMAP(DREQ_UART_TX)
+          | DMA_TI_WAIT_RESP | DMA_TI_INTEN;
+   cb->saddr = BUS_ADDR(src);
+   cb->daddr = PERIPH_BUS_ADDR(&PL011_REG(dr));
+   cb->length = n;
+   cb->stride = 0;
+   cb->nextcb = 0;
+   tx_dma_len = n;
+   clr_bit(PL011_REG(imsc), 5);             // evita interrupções a cada DREQ
+   dma_start(tx_dma, cb);
+}
+#endif
+
+/**
+ * Move bytes do buffer de transmissão para a FIFO da uart.
+ * Desabilita a interrupção de transmissão quando o buffer esvazia.
+ */
+static void uart_tx_drain(void) {
+#if PL011
+   if(tx_dma_ativo()) return;
+   uint32_t n = tx_head - tx_tail;
+   uint32_t contiguo = TX_BUF_SIZE - (tx_tail & (TX_BUF_SIZE-1));
+   if(n > contiguo) n = contiguo;
+   if((tx_dma >= 0) && (n >= DMA_MIN)) {
+      tx_dma_inicia(n);
+      return;
+   }
+   while((tx_tail != tx_head) && !(PL011_REG(fr) & FR_TXFF)) {
+      PL011_REG(dr) = tx_buf[tx_tail & (TX_BUF_SIZE-1)];
+      tx_tail++;
+   }
+   if(tx_tail == tx_head) PL011_REG(icr) = INT_TX;
+#else
+   while((tx_tail != tx_head) && (MU_REG(lsr) & 0x20)) {
+      MU_REG(io) = tx_buf[tx_tail & (TX_BUF_SIZE-1)];
+      tx_tail++;
+   }
+   if(tx_tail == tx_head) clr_bit(MU_REG(ier), 1);
+#endif
+}
+
+/**
+ * Inicia a transmissão de dados recém-colocados no buffer.
+ * A interrupção de transmissão do PL011 só ocorre quando a FIFO passa pelo
+ * nível de disparo, por isso a FIFO é alimentada aqui; a da mini UART
+ * basta ser habilitada.
+ */
+static void uart_tx_start(void) {
+#if PL011
+   uint32_t mascarada = irq_mascarada();
+   enable_irq(0);
+   uart_tx_drain();
+   if(!mascarada) enable_irq(1);
+#else
+   set_bit(MU_REG(ier), 1);   // interrupção de transmissão
+#endif
+}
+
+static int rx_vazia(void) {
+#if PL011
+   return (PL011_REG(fr) & FR_RXFE) != 0;
+#else
+   return (MU_REG(lsr) & 0x01) == 0;
+#endif
+}
+
+/**
+ * Move bytes da FIFO da uart para o buffer de recepção.
+ * @return 1 se ^C foi recebido com o break habilitado.
+ */
+static uint32_t uart_rx_fill(void) {
+   uint32_t brk = 0;
+   while(!rx_vazia()) {
+#if PL011
+      uint8_t c = PL011_REG(dr);
+#else
+      uint8_t c = MU_REG(io);
+#endif
+      if(break_ativo && (c == CTRL_C)) {
+         brk = 1;
+         continue;
+      }
+      if(rx_head - rx_tail < RX_BUF_SIZE) {    // descarta se o buffer estiver cheio
+         rx_buf[rx_head & (RX_BUF_SIZE-1)] = c;
+         rx_head++;
+      }
+   }
+   return brk;
+}
+
+/**
+ * Calcula o divisor para uma velocidade.
+ * PL011: divisor em 1/64 (IBRD.FBRD) de UART_CLOCK / 16.
+ * Mini UART: UART_CLOCK / (8 * (divisor + 1)).
+ * @return Divisor, ou 0 se a velocidade não puder ser obtida com erro aceitável.
+ */
+static uint32_t divisor(uint32_t baud) {
+   uint32_t div, real;
+   if(baud == 0) return 0;
+#if PL011
+   div = (4 * UART_CLOCK + baud / 2) / baud;
+   if((div < 64) || (div >= (65536 << 6))) return 0;
+   real = 4 * UART_CLOCK / div;
+#else
+   div = (UART_CLOCK / 8 + baud / 2) / baud;
+   if((div < 1) || (div > 65536)) return 0;
+   real = UART_CLOCK / 8 / div;
+#endif
+   uint32_t erro = (real > baud) ? real - baud : baud - real;
+   if(erro > baud / 100 * ERRO_MAX_BAUD) return 0;
+   return div;
+}
+
+/**
+ * Programa a velocidade no periférico, que deve estar desabilitado.
+ */
+static void programa_baud(uint32_t div) {
+#if PL011
+   PL011_REG(ibrd) = div >> 6;
+   PL011_REG(fbrd) = div & 0x3f;
+   PL011_REG(lcrh) = LCRH_WLEN8 | LCRH_FEN;   // 8 bits; a escrita efetiva o divisor
+#else
+   MU_REG(baud) = div - 1;
+#endif
+}
+
 /**
  * Inicia a uart para comunicar 8 bits em 115200 bps
  */
 void uart_init(void) {
    uint32_t sel = GPIO_REG(gpfsel[1]);
+#if PL011
+   sel = (sel & (~(7<<12))) | (4<<12);
+   sel = (sel & (~(7<<15))) | (4<<15);
+#else
    sel = (sel & (~(7<<12))) | (2<<12);
    sel = (sel & (~(7<<15))) | (2<<15);
+#endif
    GPIO_REG(gpfsel[1]) = sel;
 
    GPIO_REG(gppud) = 0;
-   delay(150);
+   delay_us(1);
    GPIO_REG(gppudclk[0]) = (1 << 14) | (1 << 15);
-   delay(150);
+   delay_us(1);
    GPIO_REG(gppudclk[0]) = 0;
 
+   tx_head = tx_tail = 0;
+   rx_head = rx_tail = 0;
+   break_ativo = 0;
+   baud_atual = BAUD_PADRAO;
+
+#if PL011
+   PL011_REG(cr) = 0;
+   PL011_REG(imsc) = 0;
+   PL011_REG(icr) = 0x7ff;
+   PL011_REG(lcrh) = 0;                       // descarta as FIFOs
+   programa_baud(divisor(BAUD_PADRAO));
+   uart_set_fifo(UART_FIFO_1_2, UART_FIFO_1_2);
+   tx_dma = dma_alloc();
+   tx_dma_len = 0;
+   if(tx_dma >= 0) {
+      PL011_REG(dmacr) = DMACR_TXDMAE;
+      irq_register(IRQ_DMA(tx_dma), uart_irq);
+   }
+   PL011_REG(cr) = CR_UARTEN | CR_TXE | CR_RXE;
+   PL011_REG(imsc) = INT_RX | INT_RT | INT_TX;
+   irq_register(IRQ_PL011, uart_irq);
+#else
    AUX_REG(enables) = 1;
    MU_REG(cntl) = 0;
    MU_REG(ier) = 0;
    MU_REG(lcr) = 3;           // 8 bits
    MU_REG(mcr) = 0;
-   MU_REG(baud) = 270;        // para 115200 bps em 250 MHz
+   MU_REG(iir) = 0xc6;        // limpa as FIFOs
+   programa_baud(divisor(BAUD_PADRAO));   // 270 para 115200 bps em 250 MHz
    MU_REG(cntl) = 3;          // habilita TX e RX
+
+   MU_REG(ier) = 1;           // interrupção de recepção
+   irq_register(IRQ_AUX, uart_irq);
+#endif
+}
+
+/**
+ * Configura os níveis de disparo das FIFOs do PL011 (UART_FIFO_...).
+ * O nível de transmissão também controla os pedidos de DMA.
+ * @return 0, ou -1 se os níveis forem inválidos ou a uart for a mini UART.
+ */
+int uart_set_fifo(uint32_t rx, uint32_t tx) {
+#if PL011
+   if((rx > UART_FIFO_7_8) || (tx > UART_FIFO_7_8)) return -1;
+   PL011_REG(ifls) = (rx << 3) | tx;
+   return 0;
+#else
+   return -1;
+#endif
+}
+
+/**
+ * Verifica se uma velocidade pode ser obtida com erro aceitável.
+ */
+int uart_baud_valid(uint32_t baud) {
+   return divisor(baud) != 0;
 }
 
 /**
- * Envia um caractere pela uart
+ * Troca a velocidade da uart depois de transmitir o conteúdo do buffer.
+ * Os dados ainda não lidos na FIFO de recepção são descartados.
+ * @return 0, ou -1 se a velocidade não puder ser obtida.
+ */
+int uart_set_baud(uint32_t baud) {
+   uint32_t div = divisor(baud);
+   if(div == 0) return -1;
+   uart_flush();
+#if PL011
+   PL011_REG(cr) = 0;
+   PL011_REG(lcrh) = 0;                       // descarta as FIFOs
+   programa_baud(div);
+   PL011_REG(cr) = CR_UARTEN | CR_TXE | CR_RXE;
+#else
+   MU_REG(cntl) = 0;
+   programa_baud(div);
+   MU_REG(iir) = 0xc6;
+   MU_REG(cntl) = 3;
+#endif
+   baud_atual = baud;
+   return 0;
+}
+
+/**
+ * Velocidade atual da uart.
+ */
+uint32_t uart_get_baud(void) {
+   return baud_atual;
+}
+
+/**
+ * Descarta os dados recebidos e ainda não lidos.
+ */
+void uart_discard(void) {
+   uint32_t mascarada = irq_mascarada();
+   enable_irq(0);
+   uart_rx_fill();
+   rx_tail = rx_head;
+   if(!mascarada) enable_irq(1);
+}
+
+/**
+ * Canal de DMA usado na transmissão (-1 se não houver).
+ */
+int uart_dma_channel(void) {
+#if PL011
+   return tx_dma;
+#else
+   return -1;
+#endif
+}
+
+/**
+ * Coloca um caractere no buffer de transmissão sem bloquear.
+ * @return 0 se o buffer estiver cheio.
+ */
+int uart_try_putc(uint8_t c) {
+   if(tx_head - tx_tail >= TX_BUF_SIZE) return 0;
+   tx_buf[tx_head & (TX_BUF_SIZE-1)] = c;
+   tx_head++;
+   uart_tx_start();
+   return 1;
+}
+
+/**
+ * Envia um caractere pela uart.
+ * Bloqueia somente se o buffer de transmissão estiver cheio.
  */
 void uart_putc(uint8_t c) {
-   while((MU_REG(lsr) & 0x20) == 0) ;
-   MU_REG(io) = c;
+   while(!uart_try_putc(c)) {
+      if(irq_mascarada()) uart_tx_drain();
+   }
 }
 
 /**
@@ -45,50 +387,139 @@ void uart_puts(char *s) {
    }
 }
 
+/**
+ * Coloca um bloco no buffer de transmissão sem bloquear.
+ * @return Quantidade de bytes aceitos.
+ */
+uint32_t uart_try_write(const uint8_t *b, uint32_t n) {
+   uint32_t livre = TX_BUF_SIZE - (tx_head - tx_tail);
+   if(n > livre) n = livre;
+   for(uint32_t i=0; i<n; i++) {
+      tx_buf[(tx_head + i) & (TX_BUF_SIZE-1)] = b[i];
+   }
+   tx_head += n;
+   if(n) uart_tx_start();
+   return n;
+}
+
+/**
+ * Envia um bloco de bytes pela uart.
+ */
+void uart_write(const uint8_t *b, uint32_t n) {
+   while(n) {
+      uint32_t k = uart_try_write(b, n);
+      b += k;
+      n -= k;
+      if(n && irq_mascarada()) uart_tx_drain();
+   }
+}
+
+/**
+ * Recebe um caractere sem bloquear.
+ * @return Caractere recebido ou -1 se não houver dados.
+ */
+int uart_try_getc(void) {
+   uint8_t c;
+   if(irq_mascarada()) uart_rx_fill();
+   if(rx_tail == rx_head) return -1;
+   c = rx_buf[rx_tail & (RX_BUF_SIZE-1)];
+   rx_tail++;
+   return c;
+}
+
+/**
+ * Retira do buffer de recepção os bytes já disponíveis, sem esperar.
+ * @param b Destino.
+ * @param n Quantidade máxima de bytes.
+ * @return Quantidade de bytes copiados.
+ */
+uint32_t uart_try_read(uint8_t *b, uint32_t n) {
+   if(irq_mascarada()) uart_rx_fill();
+   uint32_t disp = rx_head - rx_tail;
+   if(n > disp) n = disp;
+   for(uint32_t i=0; i<n; i++) {
+      b[i] = rx_buf[(rx_tail + i) & (RX_BUF_SIZE-1)];
+   }
+   rx_tail += n;
+   return n;
+}
+
+/**
+ * Recebe exatamente n bytes pela uart.
+ */
+void uart_read(uint8_t *b, uint32_t n) {
+   while(n) {
+      uint32_t k = uart_try_read(b, n);
+      b += k;
+      n -= k;
+   }
+}
+
 /**
  * Recebe um caractere pela uart
  */
 uint8_t uart_getc(void) {
-   while((MU_REG(lsr) & 0x01) == 0) ;
-   return MU_REG(io);
+   int c;
+   while((c = uart_try_getc()) < 0) ;
+   return c;
 }
 
 /**
- * Habilita interrupção da uart (para identificar ^C).
+ * Quantidade de bytes aguardando leitura no buffer de recepção.
  */
-void uart_break_enable(void) {
-   set_bit(MU_REG(ier), 0);
-   IRQ_REG(enable_1) = __bit(29);
-   enable_irq(1);
+uint32_t uart_rx_available(void) {
+   if(irq_mascarada()) uart_rx_fill();
+   return rx_head - rx_tail;
 }
 
 /**
- * Desabilita interrupção da uart.
+ * Espaço livre no buffer de transmissão.
  */
-void uart_break_disable(void) {
-   clr_bit(MU_REG(ier), 0);
-   IRQ_REG(disable_1) = __bit(29);
-   enable_irq(0);
+uint32_t uart_tx_free(void) {
+   return TX_BUF_SIZE - (tx_head - tx_tail);
 }
 
 /**
- * Processa interrupção da UART se ativo.
- * Verifica se o caractere ^C (break) foi recebido.
+ * Aguarda a transmissão de todo o buffer e o esvaziamento do transmissor.
  */
-uint32_t trata_irq(void) {
-   static uint8_t c = 0;
-   static int r;
-   r = IRQ_REG(pending_1);
-   if(bit_is_set(r, 29)) {                   // interrupção do periférico AUX
-      r = AUX_REG(irq);
-      if(bit_is_set(r, 0)) {                 // interrupção da UART
-         r = (MU_REG(iir) >> 1) & 0x03;     
-         if(r == 2) {                        // interrupção de recepção
-            c = MU_REG(io);                  // lê o byte recebido
-         }
-      }
+void uart_flush(void) {
+   while(tx_tail != tx_head) {
+      if(irq_mascarada()) uart_tx_drain();
    }
-   if(c == CTRL_C) return 1;
-   return 0;
+#if PL011
+   while(PL011_REG(fr) & FR_BUSY) ;
+#else
+   while((MU_REG(lsr) & 0x40) == 0) ;
+#endif
+}
+
+/**
+ * Habilita a identificação de ^C (break) na recepção.
+ */
+void uart_break_enable(void) {
+   break_ativo = 1;
 }
 
+/**
+ * Desabilita a identificação de ^C.
+ */
+void uart_break_disable(void) {
+   break_ativo = 0;
+}
+
+/**
+ * Processa a interrupção da uart: preenche o buffer de recepção
+ * e alimenta a FIFO de transmissão.
+ * @return 1 se o caractere ^C (break) foi recebido com o break habilitado.
+ */
+uint32_t uart_irq(void) {
+   uint32_t brk;
+#if PL011
+   PL011_REG(icr) = INT_ERROS;
+#else
+   if(bit_not_set(AUX_REG(irq), 0)) return 0;
+#endif
+   brk = uart_rx_fill();
+   uart_tx_drain();
+   return brk;
+}
@@ -1,11 +1,37 @@
-
 #pragma once
 #include <stdint.h>
 
+/*
+ * Níveis de disparo das FIFOs do PL011 (fração das 16 posições)
+ */
+#define UART_FIFO_1_8        0
+#define UART_FIFO_1_4        1
+#define UART_FIFO_1_2        2
+#define UART_FIFO_3_4        3
+#define UART_FIFO_7_8        4
+
 void uart_init(void);
 void uart_putc(uint8_t c);
 void uart_puts(char *s);
+void uart_write(const uint8_t *b, uint32_t n);
 uint8_t uart_getc(void);
+void uart_read(uint8_t *b, uint32_t n);
+
+int uart_try_putc(uint8_t c);
+uint32_t uart_try_write(const uint8_t *b, uint32_t n);
+int uart_try_getc(void);
+uint32_t uart_try_read(uint8_t *b, uint32_t n);
+uint32_t uart_rx_available(void);
+uint32_t uart_tx_free(void);
+void uart_flush(void);
+
+int uart_set_fifo(uint32_t rx, uint32_t tx);
+int uart_baud_valid(uint32_t baud);
+int uart_set_baud(uint32_t baud);
+uint32_t uart_get_baud(void);
+void uart_discard(void);
 
 void uart_break_enable(void);
 void uart_break_disable(void);
+uint32_t uart_irq(void);
+int uart_dma_channel(void);
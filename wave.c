@@ -0,0 +1,158 @@
+#include "bcm.h"
+#include "dma.h"
+#include "mmu.h"
+#include "timer.h"
+#include "wave.h"
+
+/*
+ * Clock do PWM: PLLD (500 MHz) / 50 = 10 MHz; com rng1 = 10, a FIFO é
+ * consumida a 1 MHz e as bordas ficam alinhadas ao clock de 10 MHz.
+ */
+#define CM_SENHA             (0x5a << 24)
+#define CM_ENAB              __bit(4)
+#define CM_BUSY              __bit(7)
+#define CM_SRC_PLLD          6
+#define PWM_DIVISOR          50
+#define PWM_RANGE            (10 * WAVE_TICK_US)
+
+#define PWM_CTL_PWEN1        __bit(0)
+#define PWM_CTL_USEF1        __bit(5)
+#define PWM_CTL_CLRF1        __bit(6)
+#define PWM_STA_FULL1        __bit(0)
+#define PWM_FIFO_MAX         16           // palavras na FIFO (8 segundo o manual)
+#define PWM_DMAC_ENAB        __bit(31)
+#define PWM_DMAC_PANIC(X)    ((X) << 8)
+#define PWM_DMAC_DREQ(X)     (X)
+#define DREQ_PWM             5
+
+#define MAX_FULL             0x3ffffff0
+#define MAX_LITE             0xfff0
+
+/*
+ * Blocos de controle (um por escrita nos GPIOs e um ou mais por espera) e
+ * as máscaras lidas por eles, como dois bancos de 32 bits.
+ */
+#define WAVE_MAX_CBS         (2 * WAVE_MAX_PASSOS + 64)
+static dma_cb_t cbs[WAVE_MAX_CBS] __attribute__((aligned(32)));
+static uint32_t mascaras[WAVE_MAX_PASSOS][2] __attribute__((aligned(32)));
+static uint32_t zero __attribute__((aligned(32)));
+
+static int canal = -1;
+static uint32_t periodo;
+
+/**
+ * Configura o PWM como marcador de tempo: FIFO a 1 palavra por tick,
+ * DREQ enquanto houver espaço. A FIFO começa cheia; vazia, ela aceitaria
+ * as primeiras palavras da primeira espera de uma vez, encurtando-a.
+ */
+static void inicia_pwm(void) {
+   PWM_REG(ctl) = 0;
+   CM_PWM_REG(ctl) = CM_SENHA | CM_SRC_PLLD;
+   while(CM_PWM_REG(ctl) & CM_BUSY) ;
+   CM_PWM_REG(div) = CM_SENHA | (PWM_DIVISOR << 12);
+   CM_PWM_REG(ctl) = CM_SENHA | CM_ENAB | CM_SRC_PLLD;
+   PWM_REG(rng1) = PWM_RANGE;
+   PWM_REG(dmac) = PWM_DMAC_ENAB | PWM_DMAC_PANIC(15) | PWM_DMAC_DREQ(15);
+   PWM_REG(ctl) = PWM_CTL_CLRF1;
+   delay_us(10);
+   for(int i=0; (i<PWM_FIFO_MAX) && !(PWM_REG(sta) & PWM_STA_FULL1); i++)
+      PWM_REG(fif1) = 0;
+   PWM_REG(ctl) = PWM_CTL_USEF1 | PWM_CTL_PWEN1;
+}
+
+/**
+ * Monta os blocos de espera de us microssegundos a partir de cbs[n].
+ * @return Próximo bloco livre, ou -1 se não couber.
+ */
+static int32_t espera(int32_t n, uint32_t us) {
+   uint32_t max = (canal < 7) ? MAX_FULL : MAX_LITE;
+   uint32_t len = 4 * (us / WAVE_TICK_US);
+   while(len) {
+      uint32_t k = (len > max) ? max : len;
+      if(n == WAVE_MAX_CBS) return -1;
+      cbs[n].ti = DMA_TI_NO_WIDE | DMA_TI_WAIT_RESP | DMA_TI_DEST_DREQ
+                | DMA_TI_PERMAP(DREQ_PWM);
+      cbs[n].saddr = BUS_ADDR(&zero);
+      cbs[n].daddr = PERIPH_BUS_ADDR(&PWM_REG(fif1));
+      cbs[n].length = k;
+      cbs[n].stride = 0;
+      n++;
+      len -= k;
+   }
+   return n;
+}
+
+/**
+ * Inicia a reprodução de uma forma de onda, interrompendo a anterior.
+ * @param p Passos.
+ * @param n Quantidade de passos (até WAVE_MAX_PASSOS).
+ * @param repete Volta ao primeiro passo após o último, até wave_stop.
+ * @return 0 em caso de sucesso, -1 se não houver canal de DMA, se os
+ *         passos não couberem nos blocos de controle ou se a repetição
+ *         não tiver nenhuma espera.
+ */
+int wave_play(const wave_passo_t *p, uint32_t n, int repete) {
+   int32_t k = 0;
+
+   wave_stop();
+   if((n == 0) || (n > WAVE_MAX_PASSOS)) return -1;
+   if((canal = dma_alloc()) < 0) return -1;
+
+   periodo = 0;
+   for(uint32_t i=0; i<n; i++) {
+      if(k == WAVE_MAX_CBS) {
+         k = -1;
+         break;
+      }
+      mascaras[i][0] = p[i].mask;
+      mascaras[i][1] = p[i].mask >> 32;
+      cbs[k].ti = DMA_TI_NO_WIDE | DMA_TI_WAIT_RESP | DMA_TI_SRC_INC | DMA_TI_DEST_INC;
+      cbs[k].saddr = BUS_ADDR(mascaras[i]);
+      cbs[k].daddr = p[i].liga ? PERIPH_BUS_ADDR(&GPIO_REG(gpset[0]))
+                               : PERIPH_BUS_ADDR(&GPIO_REG(gpclr[0]));
+      cbs[k].length = 8;
+      cbs[k].stride = 0;
+      k = espera(k + 1, p[i].us);
+      if(k < 0) break;
+      periodo += p[i].us;
+   }
+   if((k < 0) || (repete && (periodo == 0))) {
+      wave_stop();
+      return -1;
+   }
+
+   for(int32_t i=0; i<k; i++) cbs[i].nextcb = BUS_ADDR(&cbs[i + 1]);
+   cbs[k - 1].nextcb = repete ? BUS_ADDR(&cbs[0]) : 0;
+   cache_clean(cbs, k * sizeof(dma_cb_t));
+   cache_clean(mascaras, n * sizeof(mascaras[0]));
+   cache_clean(&zero, sizeof(zero));
+
+   inicia_pwm();
+   dma_start(canal, cbs);
+   return 0;
+}
+
+/**
+ * Interrompe a forma de onda; os GPIOs ficam no estado atual.
+ */
+void wave_stop(void) {
+   if(canal < 0) return;
+   dma_free(canal);
+   canal = -1;
+   PWM_REG(ctl) = 0;
+   PWM_REG(dmac) = 0;
+}
+
+/**
+ * Verifica se há uma forma de onda em reprodução.
+ */
+int wave_ativa(void) {
+   return (canal >= 0) && dma_busy(canal);
+}
+
+/**
+ * Duração da última forma de onda iniciada, em microssegundos.
+ */
+uint32_t wave_periodo(void) {
+   return periodo;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Gerador de formas de onda nos GPIOs: cada passo escreve uma máscara em
+ * gpset ou gpclr e espera um tempo. Os passos são convertidos em blocos de
+ * controle de DMA encadeados; as esperas escrevem na FIFO do PWM, que
+ * consome uma palavra a cada WAVE_TICK_US, de modo que a CPU não participa
+ * da reprodução.
+ */
+#define WAVE_MAX_PASSOS      512
+#define WAVE_TICK_US         1
+
+typedef struct {
+   uint64_t mask;                         // GPIOs (bit n = GPIO n)
+   int liga;                              // 1 = gpset, 0 = gpclr
+   uint32_t us;                           // espera após a escrita
+} wave_passo_t;
+
+int wave_play(const wave_passo_t *p, uint32_t n, int repete);
+void wave_stop(void);
+int wave_ativa(void);
+uint32_t wave_periodo(void);
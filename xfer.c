@@ -0,0 +1,283 @@
+#include "bcm.h"
+#include "uart.h"
+#include "xfer.h"
+#include "timer.h"
+#include "hex.h"
+#include "lz.h"
+
+#define CTRL_C               0x03
+#define ESCAPE               '}'
+
+#define TIMEOUT_ACK          1000000      // us sem confirmação antes de reenviar
+#define TIMEOUT_RX           5000000      // us sem dados antes de desistir
+#define MAX_REENVIOS         16
+
+/*
+ * Quadro sendo montado (pior caso: todos os bytes escapados; seq, tipo do
+ * bloco comprimido e dados).
+ */
+static uint8_t quadro[2 * (XFER_BLOCO + 2) + 6];
+static uint8_t dados_rx[XFER_BLOCO];
+static uint8_t comprimido[XFER_BLOCO + 1];
+
+/*
+ * Tabela de 4 bits do CRC-16/CCITT (polinômio 0x1021).
+ */
+static const uint16_t crc_tab[16] = {
+   0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+   0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+};
+
+/**
+ * Atualiza um CRC-16/CCITT (valor inicial 0xffff).
+ * @param crc CRC parcial.
+ * @param b Dados.
+ * @param n Quantidade de bytes.
+ */
+uint16_t xfer_crc16(uint16_t crc, const uint8_t *b, uint32_t n) {
+   while(n--) {
+      crc = (crc << 4) ^ crc_tab[(crc >> 12) ^ (*b >> 4)];
+      crc = (crc << 4) ^ crc_tab[(crc >> 12) ^ (*b & 0x0f)];
+      b++;
+   }
+   return crc;
+}
+
+static int precisa_escape(uint8_t c) {
+   return (c == '$') || (c == '#') || (c == ESCAPE) || (c == '*');
+}
+
+/**
+ * Recebe um caractere, desistindo após um intervalo sem dados.
+ * @param timeout Intervalo máximo em microssegundos.
+ * @return Caractere recebido ou -1.
+ */
+static int le_char(uint32_t timeout) {
+   uint32_t prazo = timer_deadline(timeout);
+   int c;
+   while((c = uart_try_getc()) < 0) {
+      if(timer_expired(prazo)) return -1;
+   }
+   return c;
+}
+
+/**
+ * Recebe um número hexadecimal de n dígitos.
+ * @return Valor recebido ou -1 em caso de erro.
+ */
+static int32_t le_hex(int n, uint32_t timeout) {
+   int32_t v = 0;
+   while(n--) {
+      int d = hex_value(le_char(timeout));
+      if(d < 0) return -1;
+      v = (v << 4) | d;
+   }
+   return v;
+}
+
+/**
+ * Envia um quadro completo.
+ * @param seq Número de sequência (8 bits).
+ * @param b Dados do quadro.
+ * @param n Quantidade de bytes.
+ */
+void xfer_put_frame(uint8_t seq, const uint8_t *b, uint32_t n) {
+   uint16_t crc = xfer_crc16(xfer_crc16(0xffff, &seq, 1), b, n);
+   uint32_t k = 0;
+
+   quadro[k++] = '$';
+   if(precisa_escape(seq)) {
+      quadro[k++] = ESCAPE;
+      quadro[k++] = seq ^ 0x20;
+   } else quadro[k++] = seq;
+   for(uint32_t i=0; i<n; i++) {
+      if(precisa_escape(b[i])) {
+         quadro[k++] = ESCAPE;
+         quadro[k++] = b[i] ^ 0x20;
+      } else quadro[k++] = b[i];
+   }
+   quadro[k++] = '#';
+   uint8_t c[2] = { crc >> 8, crc };
+   hex_encode((char*)quadro + k, c, 2);
+   k += 4;
+   uart_write(quadro, k);
+}
+
+/**
+ * Envia um bloco comprimido: tipo XFER_LZ e os dados comprimidos, ou tipo
+ * XFER_BRUTO e os dados originais se a compressão não reduzir o bloco.
+ * @return Tamanho do conteúdo do quadro.
+ */
+static uint32_t comprime(const uint8_t *b, uint32_t n) {
+   uint32_t k = lz_encode(comprimido + 1, n, b, n);
+   if(k == 0) {
+      comprimido[0] = XFER_BRUTO;
+      for(uint32_t i=0; i<n; i++) comprimido[i + 1] = b[i];
+      return n + 1;
+   }
+   comprimido[0] = XFER_LZ;
+   return k + 1;
+}
+
+/**
+ * Envia uma área de memória em quadros binários, mantendo até
+ * XFER_JANELA quadros sem confirmação (go-back-N).
+ * @param a Endereço inicial.
+ * @param s Quantidade de bytes.
+ * @param lz Comprime cada bloco (ver xfer.h).
+ * @param enviados Se diferente de 0, recebe a soma do conteúdo dos quadros
+ *                 (sem retransmissões).
+ * @return 0 em caso de sucesso, -1 se a transferência foi abortada.
+ */
+static int envia_area(const uint8_t *a, uint32_t s, int lz, uint32_t *enviados) {
+   uint32_t total = (s + XFER_BLOCO - 1) / XFER_BLOCO;
+   uint32_t base = 0, prox = 0, reenvios = 0, maior = 0;
+   uint32_t prazo = timer_deadline(TIMEOUT_ACK);
+
+   if(enviados) *enviados = 0;
+   while(base < total) {
+      /*
+       * Preenche a janela.
+       */
+      while((prox < total) && (prox - base < XFER_JANELA)) {
+         uint32_t k = s - prox * XFER_BLOCO;
+         if(k > XFER_BLOCO) k = XFER_BLOCO;
+         if(lz) {
+            k = comprime(a + prox * XFER_BLOCO, k);
+            xfer_put_frame(prox, comprimido, k);
+         } else xfer_put_frame(prox, a + prox * XFER_BLOCO, k);
+         if(enviados && (prox == maior)) {
+            *enviados += k;
+            maior++;
+         }
+         prox++;
+      }
+
+      /*
+       * Processa confirmações.
+       */
+      int c = uart_try_getc();
+      if(c < 0) {
+         if(timer_expired(prazo)) {
+            if(++reenvios > MAX_REENVIOS) return -1;
+            prox = base;                        // reenvia a janela inteira
+            prazo = timer_deadline(TIMEOUT_ACK);
+         }
+         continue;
+      }
+      if(c == CTRL_C) return -1;
+      if((c != '+') && (c != '-')) continue;
+
+      int32_t seq = le_hex(2, TIMEOUT_ACK);
+      if(seq < 0) continue;
+      uint32_t n = base + (((uint32_t)seq - base) & 0xff);
+      if(n >= prox) continue;                   // confirmação fora da janela
+      if(c == '+') base = n + 1;                // confirmação cumulativa
+      else base = prox = n;                     // n é o próximo esperado: reenvia
+      reenvios = 0;
+      prazo = timer_deadline(TIMEOUT_ACK);
+   }
+   return 0;
+}
+
+/**
+ * Envia uma área de memória em quadros binários.
+ * @param a Endereço inicial.
+ * @param s Quantidade de bytes.
+ * @return 0 em caso de sucesso, -1 se a transferência foi abortada.
+ */
+int xfer_send(const uint8_t *a, uint32_t s) {
+   return envia_area(a, s, 0, 0);
+}
+
+/**
+ * Envia uma área de memória em quadros binários com os blocos comprimidos.
+ * @param a Endereço inicial.
+ * @param s Quantidade de bytes.
+ * @param enviados Recebe a soma do conteúdo dos quadros.
+ * @return 0 em caso de sucesso, -1 se a transferência foi abortada.
+ */
+int xfer_send_lz(const uint8_t *a, uint32_t s, uint32_t *enviados) {
+   return envia_area(a, s, 1, enviados);
+}
+
+/**
+ * Recebe um quadro.
+ * @param seq Retorna o número de sequência.
+ * @return Quantidade de bytes em dados_rx, -1 em erro de CRC ou
+ *         formato, -2 se nada foi recebido no prazo.
+ */
+static int32_t le_quadro(uint8_t *seq) {
+   uint16_t crc;
+   int32_t n = -1, c;
+   int esc = 0;
+
+   do {
+      c = le_char(TIMEOUT_RX);
+      if(c < 0) return -2;
+      if(c == CTRL_C) return -2;
+   } while(c != '$');
+
+   for(;;) {
+      c = le_char(TIMEOUT_RX);
+      if(c < 0) return -2;
+      if(c == '#') break;
+      if(c == '$') return -1;                   // quadro truncado
+      if(c == ESCAPE) {
+         esc = 1;
+         continue;
+      }
+      if(esc) c ^= 0x20;
+      esc = 0;
+      if(n < 0) *seq = c;
+      else if(n < XFER_BLOCO) dados_rx[n] = c;
+      else return -1;
+      n++;
+   }
+   if(n < 0) return -1;
+
+   int32_t recebido = le_hex(4, TIMEOUT_RX);
+   crc = xfer_crc16(xfer_crc16(0xffff, seq, 1), dados_rx, n);
+   if(recebido != crc) return -1;
+   return n;
+}
+
+static void responde(char r, uint8_t seq) {
+   char m[3] = { r };
+   hex_encode(m + 1, &seq, 1);
+   uart_write((uint8_t*)m, 3);
+}
+
+/**
+ * Recebe quadros binários e grava os dados na memória.
+ * Quadros fora de ordem são descartados até a retransmissão do esperado.
+ * @param a Endereço inicial.
+ * @param s Quantidade de bytes.
+ * @return 0 em caso de sucesso, -1 se a transferência foi abortada.
+ */
+int xfer_recv(uint8_t *a, uint32_t s) {
+   uint32_t total = (s + XFER_BLOCO - 1) / XFER_BLOCO;
+   uint32_t esperado = 0;
+   int rejeitado = 0;
+   uint8_t seq;
+
+   while(esperado < total) {
+      uint32_t k = s - esperado * XFER_BLOCO;
+      if(k > XFER_BLOCO) k = XFER_BLOCO;
+
+      int32_t n = le_quadro(&seq);
+      if(n == -2) return -1;
+      if((n != (int32_t)k) || (seq != (uint8_t)esperado)) {
+         if(!rejeitado) responde('-', esperado);
+         rejeitado = 1;
+         continue;
+      }
+
+      uint8_t *d = a + esperado * XFER_BLOCO;
+      for(uint32_t i=0; i<k; i++) d[i] = dados_rx[i];
+      responde('+', seq);
+      rejeitado = 0;
+      esperado++;
+   }
+   return 0;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Transferência binária em quadros:
+ *   '$' <seq> <dados> '#' <crc16 em 4 caracteres hexadecimais>
+ * Os bytes '$', '#', '}' e '*' do conteúdo são enviados como '}' (c ^ 0x20).
+ * Cada quadro é confirmado com '+' <seq> ou rejeitado com '-' <seq>,
+ * com <seq> em dois caracteres hexadecimais.
+ */
+#define XFER_BLOCO           1024         // bytes de dados por quadro
+#define XFER_JANELA          8            // quadros enviados sem confirmação
+
+/*
+ * Nos quadros comprimidos (xfer_send_lz), o primeiro byte do conteúdo indica
+ * o formato dos XFER_BLOCO bytes (ou menos, no último quadro) da área:
+ */
+#define XFER_BRUTO           0            // dados sem compressão
+#define XFER_LZ              1            // bloco comprimido (ver lz.h)
+
+uint16_t xfer_crc16(uint16_t crc, const uint8_t *b, uint32_t n);
+void xfer_put_frame(uint8_t seq, const uint8_t *b, uint32_t n);
+int xfer_send(const uint8_t *a, uint32_t s);
+int xfer_send_lz(const uint8_t *a, uint32_t s, uint32_t *enviados);
+int xfer_recv(uint8_t *a, uint32_t s);